@@ -28,7 +28,9 @@
 #include "../interface/ProfilingTools.h"
 #include "../interface/GenerateOnly.h"
 #include "../interface/CombineLogger.h"
+#include "../interface/LimitTreeWriter.h"
 #include <map>
+#include <memory>
 
 using namespace std;
 
@@ -51,6 +53,7 @@ int main(int argc, char **argv) {
   int pickToy;
   int    seed;
   string toysFile;
+  string outputFormat;
 
   vector<string> librariesToLoad;
   vector<string> runtimeDefines;
@@ -107,6 +110,7 @@ int main(int argc, char **argv) {
     ("dataset,D",  po::value<string>(&dataset)->default_value("data_obs"), "Name of the dataset for observed limit - use this to replace dataset in workspace for example with a toy dataset. Format as file:workspace:object or file:object")
     ("dataMapName",  po::value<string>(&dataMapName)->default_value("data_obs"), "Name of the dataset for observed limit pattern in the datacard")
     ("toysFile",   po::value<string>(&toysFile)->default_value(""), "Read toy mc or other intermediate results from this file")
+    ("outputFormat", po::value<string>(&outputFormat)->default_value("ttree"), "Format of the output limit tree: 'ttree', or 'rntuple' (requires ROOT 6.36 or later, and is not readable by tools that expect a TTree)")
     ;
   combiner.miscOptions().add_options()
     ("igpMem", "Setup support for memory profiling using IgProf")
@@ -277,22 +281,28 @@ int main(int argc, char **argv) {
   TString fileName = "higgsCombine" + name + "."+whichMethod+"."+massName+toyName+"root";
 
   TFile *test = new TFile(fileName, "RECREATE"); outputFile = test;
-  TTree *t = new TTree("limit", "limit");
+  std::unique_ptr<LimitTreeWriter> t;
+  try {
+    t.reset(new LimitTreeWriter(test, "limit", "limit", LimitTreeWriter::parseFormat(outputFormat)));
+  } catch (std::exception &ex) {
+    cerr << "Error when configuring combine:\n\t" << ex.what() << std::endl;
+    return 2001;
+  }
   int syst, iToy, iSeed, iChannel; 
   double mass, limit, limitErr; 
-  t->Branch("limit",&limit,"limit/D");
-  t->Branch("limitErr",&limitErr,"limitErr/D");
-  t->Branch("mh",   &mass, "mh/D");
-  t->Branch("syst", &syst, "syst/I");
-  t->Branch("iToy", &iToy, "iToy/I");
-  t->Branch("iSeed", &iSeed, "iSeed/I");
-  t->Branch("iChannel", &iChannel, "iChannel/I");
-  t->Branch("t_cpu",   &t_cpu_,  "t_cpu/F");
-  t->Branch("t_real",  &t_real_, "t_real/F");
-  t->Branch("quantileExpected",  &g_quantileExpected_, "quantileExpected/F");
+  t->addBranch("limit",&limit,"limit/D");
+  t->addBranch("limitErr",&limitErr,"limitErr/D");
+  t->addBranch("mh",   &mass, "mh/D");
+  t->addBranch("syst", &syst, "syst/I");
+  t->addBranch("iToy", &iToy, "iToy/I");
+  t->addBranch("iSeed", &iSeed, "iSeed/I");
+  t->addBranch("iChannel", &iChannel, "iChannel/I");
+  t->addBranch("t_cpu",   &t_cpu_,  "t_cpu/F");
+  t->addBranch("t_real",  &t_real_, "t_real/F");
+  t->addBranch("quantileExpected",  &g_quantileExpected_, "quantileExpected/F");
   for (unsigned int mpi=0;mpi<modelParamNameVector_.size();++mpi){
 	std::string name = modelParamNameVector_[mpi];
-  	t->Branch(Form("%s",name.c_str()),  &modelParamValVector_[mpi]);
+  	t->addBranch(Form("%s",name.c_str()),  &modelParamValVector_[mpi]);
   }
   
   writeToysHere = test->mkdir("toys","toys"); 
@@ -349,15 +359,17 @@ int main(int argc, char **argv) {
   }
 
   try {
-     combiner.run(datacard, dataset, limit, limitErr, iToy, t, runToys);
+     combiner.run(datacard, dataset, limit, limitErr, iToy, t.get(), runToys);
      if (verbose>0) CombineLogger::instance().printLog(); 
   } catch (std::exception &ex) {
      cerr << "Error when running the combination:\n\t" << ex.what() << std::endl;
+     t.reset();
      test->Close();
      return 3001;
   }
   
-  test->WriteTObject(t);
+  t->write();
+  t.reset();
   test->Close();
 
   for(map<string, LimitAlgo *>::const_iterator i = methods.begin(); i != methods.end(); ++i)
@@ -1,6 +1,8 @@
 #ifndef HiggsAnalysis_CombinedLimit_Accumulators_h
 #define HiggsAnalysis_CombinedLimit_Accumulators_h
 
+#include <cmath>
+#include <cstdint>
 #include <vector>
 
 template <typename T> class NaiveAccumulator {
@@ -47,6 +49,89 @@ template <typename T> class KahanAccumulator {
         T sum_, compensation_;
 };
 
+template <typename T> class NeumaierAccumulator {
+    public:
+        NeumaierAccumulator() : sum_(0), compensation_(0) {}
+        NeumaierAccumulator(const T& value) : sum_(value), compensation_(0) {}
+        NeumaierAccumulator(const NeumaierAccumulator<T>& other) : sum_(other.sum_), compensation_(other.compensation_){}
+        // unlike KahanAccumulator, it keeps the low order bits also of increments larger than the running sum
+        NeumaierAccumulator& operator+=(const T& inc){
+          T sumnew = sum_ + inc;
+          compensation_ += (std::abs(sum_) >= std::abs(inc)) ? (sum_ - sumnew) + inc : (inc - sumnew) + sum_;
+          sum_ = sumnew;
+          return *this;
+        }
+        NeumaierAccumulator& operator+=(const NeumaierAccumulator<T>& other){
+          this->operator+=(other.sum_);
+          compensation_ += other.compensation_;
+          return *this;
+        }
+        NeumaierAccumulator& operator-=(const T& inc){ this->operator+=(-inc); return *this; }
+        NeumaierAccumulator& operator*=(const T& inc){ sum_ *= inc; compensation_ *= inc; return *this; }
+        NeumaierAccumulator& operator/=(const T& inc){ sum_ /= inc; compensation_ /= inc; return *this; }
+        NeumaierAccumulator operator+(const T& inc){ NeumaierAccumulator<T> tmp(*this);  tmp += inc; return tmp; }
+        NeumaierAccumulator operator-(const T& inc){ NeumaierAccumulator<T> tmp(*this);  tmp -= inc; return tmp; }
+        NeumaierAccumulator operator*(const T& inc){ NeumaierAccumulator<T> tmp(*this);  tmp *= inc; return tmp; }
+        NeumaierAccumulator operator/(const T& inc){ NeumaierAccumulator<T> tmp(*this);  tmp /= inc; return tmp; }
+        T sum() const { return sum_ + compensation_; }
+        operator T() const { return sum(); }
+    protected:
+        T sum_, compensation_;
+};
+
+/// Sums of arrays with a reduction tree that depends only on the number of terms, and not on the
+/// hardware or on how the work is split: the terms are grouped in blocks of kSumBlockSize, each
+/// block is summed by kSumLanes interleaved compensated accumulators (term i goes to lane i % kSumLanes,
+/// so that the compiler can keep the lanes in SIMD registers), and the blocks are then added pairwise.
+/// Evaluating any subtree of blocks separately gives the same result to the last bit.
+constexpr uint32_t kSumLanes = 8;
+constexpr uint32_t kSumBlockSize = 1024;
+
+template<typename T, typename F> NeumaierAccumulator<T> sumLanes(uint32_t begin, uint32_t end, const F & term) {
+    T sums[kSumLanes] = {}, comps[kSumLanes] = {};
+    uint32_t i = begin;
+    for (; i + kSumLanes <= end; i += kSumLanes) {
+        for (uint32_t k = 0; k < kSumLanes; ++k) {
+            // same error term as in NeumaierAccumulator, computed without branches (Knuth's TwoSum)
+            T inc = term(i + k);
+            T sumnew = sums[k] + inc;
+            T incpart = sumnew - sums[k];
+            comps[k] += (sums[k] - (sumnew - incpart)) + (inc - incpart);
+            sums[k] = sumnew;
+        }
+    }
+    NeumaierAccumulator<T> ret = 0;
+    for (uint32_t k = 0; k < kSumLanes; ++k) ret += sums[k];
+    for (; i < end; ++i) ret += term(i);
+    T comp = 0;
+    for (uint32_t k = 0; k < kSumLanes; ++k) comp += comps[k];
+    ret += comp;
+    return ret;
+}
+
+template<typename T, typename F> NeumaierAccumulator<T> sumPairwise(uint32_t begin, uint32_t end, const F & term) {
+    if (end - begin <= kSumBlockSize) return sumLanes<T>(begin, end, term);
+    // split at a block boundary, with the first half holding the extra block if the number of blocks is odd
+    uint32_t nblocks = (end - begin + kSumBlockSize - 1) / kSumBlockSize;
+    uint32_t mid = begin + ((nblocks + 1) / 2) * kSumBlockSize;
+    NeumaierAccumulator<T> ret = sumPairwise<T>(begin, mid, term);
+    ret += sumPairwise<T>(mid, end, term);
+    return ret;
+}
+
+/// sum of term(i) for i in [0, size), with term inlined in the lanes
+template<typename T, typename F> inline T sumPairwise(uint32_t size, const F & term) {
+    return sumPairwise<T>(0, size, term).sum();
+}
+
+template<typename T> inline T sumPairwise(const T * vals, uint32_t size) {
+    return sumPairwise<T>(size, [vals](uint32_t i) { return vals[i]; });
+}
+
+template<typename T> inline T sumPairwise(const std::vector<T, std::allocator<T>> & vals) {
+    return sumPairwise(vals.data(), vals.size());
+}
+
 template<typename T, class A> inline T sumWith(const std::vector<T> & vals) {
     A ret = 0;
     for (const T& v : vals) ret += v;
@@ -11,6 +11,7 @@
 #include "LimitAlgo.h"
 #include "utils.h"
 #include <memory>
+#include <vector>
 class RooRealVar;
 #include <RooAbsReal.h>
 #include <RooArgSet.h>
@@ -29,7 +30,17 @@ public:
   virtual bool runLimit(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint);
   std::vector<std::pair<float,float> > runLimitExpected(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint) ;
 
-  float findExpectedLimitFromCrossing(RooAbsReal &nll, RooRealVar *r, double rMin, double rMax, double nll0, double quantile) ; 
+  /// a conditional fit of the Asimov NLL at fixed r, with the values of the parameters after the fit
+  struct ProfilePoint {
+      ProfilePoint(double rVal, double nllVal, const RooAbsCollection &params) : r(rVal), nll(nllVal), snap(params) {}
+      double r, nll;
+      utils::CheapValueSnapshot snap;
+  };
+
+  /// if profile is not null, all the conditional fits done in the search are added to it
+  float findExpectedLimitFromCrossing(RooAbsReal &nll, RooRealVar *r, double rMin, double rMax, double nll0, double quantile, std::vector<ProfilePoint> *profile = nullptr) ; 
+  /// find the crossings of nll0 + thresholds[i] from a single adaptive scan of the profiled NLL, starting from the points already in the profile
+  std::vector<float> findExpectedLimitsFromProfile(RooAbsReal &nll, RooRealVar *r, std::vector<ProfilePoint> &profile, double nll0, double rBest, double median, double medianThreshold, const std::vector<double> &thresholds) ;
 
   const std::string& name() const override { static std::string name_ = "AsymptoticLimits"; return name_; }
 private:
@@ -41,6 +52,7 @@ private:
   static bool noFitAsimov_; 
   static bool useGrid_; 
   static bool newExpected_; 
+  static bool expectedFromProfile_; 
   static std::string minosAlgo_;
   //static std::string minimizerAlgo_;
   static std::string rule_;
@@ -69,6 +81,10 @@ private:
 
   RooAbsData *asimovDataset(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, bool overwrite=false);
   double getCLs(RooRealVar &r, double rVal, bool getAlsoExpected=false, double *limit=0, double *limitErr=0);
+  /// q_mu of the Asimov dataset at r = signalStrengthForExpected_, for doNonStandardAsimov_
+  double qMuNonStandardAsimov(RooAbsReal &nll, RooRealVar *r);
+  /// increase of the NLL w.r.t. the minimum at the expected limit for the given quantile
+  double expectedErrorLevel(double quantile, double qMuAsimov) const;
   
   TFile *gridFile_;
   TTree *limitsTree_;
@@ -9,7 +9,12 @@
  *
  */
 #include "LimitAlgo.h"
+#include <functional>
+#include <memory>
 class RooArgSet; 
+class RooArgList;
+class RooAbsPdf;
+class RooAbsReal;
 
 class BayesianToyMC : public LimitAlgo {
 public:
@@ -31,8 +36,19 @@ private:
   /// Safety factor for hint (integrate up to this number of times the hinted limit)
   static float hintSafetyFactor_;
 
+  /// number of processes used to run the tries (limits) or to evaluate the NLL at the sampled points (Bayes factors)
+  static unsigned int fork_;
+  /// sampler for the nuisances with gaussian constraints in the Bayes factors: random or sobol
+  static std::string sampler_;
+
   static std::vector<std::string> twoPoints_;
   std::pair<double,double> priorPredictiveDistribution(RooStats::ModelConfig *mc, RooAbsData &data, const RooArgSet *point=0, double *offset=0);
+  /// compute one limit with the BayesianCalculator, returns NaN if it fails
+  double runTry(RooStats::ModelConfig *mc_s, RooAbsData &data, RooAbsPdf *nuisancePdf) const;
+  /// values of the nll at npoints points, whose coordinates are stored one after the other in the order of vars
+  std::vector<double> evalNLL(RooAbsReal &nll, const RooArgList &vars, const std::vector<double> &points, unsigned int npoints) const;
+  /// run work(0) ... work(nproc-1) in forked processes, each with its own random seed, and return the concatenation of the results
+  static std::vector<double> evalWithFork(unsigned int nproc, const std::function<std::vector<double>(unsigned int)> &work);
 };
 
 #endif
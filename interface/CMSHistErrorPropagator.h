@@ -13,6 +13,7 @@
 #include "SimpleCacheSentry.h"
 #include "CMSHistFunc.h"
 #include "CMSHistV.h"
+#include "FullBarlowBeeston.h"
 
 class CMSHistErrorPropagator : public RooAbsReal {
 private:
@@ -65,6 +66,10 @@ public:
   RooArgList wrapperList() const;
   RooArgList const& coefList() const { return coeffs_; }
   RooArgList const& funcList() const { return funcs_; }
+  RooArgList const& binParList() const { return binpars_; }
+
+  // The templates of all the processes and the bin parameters, for the code generation
+  CMSHistFunc::FlatTemplates flatTemplates() const;
   
   std::map<std::string, Double_t> getProcessNorms() const;
 
@@ -72,6 +77,10 @@ public:
 
   void runBarlowBeeston() const;
 
+  // Also minimise analytically the per-process bin parameters, in the bins
+  // below the Poisson threshold
+  static void EnableFullBarlowBeeston();
+
 protected:
   RooRealProxy x_;
   RooListProxy funcs_;
@@ -94,12 +103,14 @@ protected:
   mutable std::vector<double> data_; //!
 
   mutable BarlowBeeston bb_; //!
+  mutable FullBarlowBeeston bbfull_; //!
 
   mutable bool initialized_; //! not to be serialized
 
   mutable int last_eval_; //! not to be serialized
 
   mutable bool analytic_bb_; //! not to be serialized
+  static bool enable_full_bb_; //! not to be serialized
 
   void initialize() const;
   void updateCache(int eval = 1) const;
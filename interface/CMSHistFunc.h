@@ -76,6 +76,24 @@ class CMSHistFunc : public RooAbsReal {
     LogQuadLinear
   };
 
+  // The templates of a set of processes with only vertical morphing, in flat
+  // arrays, as needed by the code generation
+  struct FlatTemplates {
+    int nBins = 0;
+    RooArgList morphs;                  // the distinct morphing parameters
+    std::vector<double> nominal;        // [process][bin]
+    std::vector<double> errors;         // [process][bin]
+    std::vector<int> logMorph;          // [process], 1 for LogQuadLinear
+    std::vector<double> smoothRegion;   // [process]
+    std::vector<int> morphOffset;       // the morphs of process p are [morphOffset[p], morphOffset[p+1])
+    std::vector<int> morphIndex;        // [morph], index in morphs of its parameter
+    std::vector<double> sum;            // [morph][bin]
+    std::vector<double> diff;           // [morph][bin]
+    std::vector<int> binParBin;         // [bin parameter], in the order of the list of bin parameters
+    std::vector<int> binParProc;        // [bin parameter]
+    std::vector<int> binParType;        // [bin parameter], 1: total error, 2: Poisson, 3: Gaussian
+  };
+
   CMSHistFunc();
 
   CMSHistFunc(const char* name, const char* title, RooRealVar& x,
@@ -139,10 +157,19 @@ class CMSHistFunc : public RooAbsReal {
   };
 
   inline FastTemplate const& errors() const { return binerrors_; }
+  // The stored templates: the nominal one and those of the morphing parameters
+  inline std::vector<FastTemplate> const& storage() const { return storage_; }
   inline FastHisto const& cache() const { return rebin_ ? rebin_cache_ : cache_; }
 
   CMSHistFuncWrapper const* wrapper() const;
 
+  RooArgList const& vmorphList() const { return vmorphs_; }
+  // True if the template only depends on vertical morphs, and so can be
+  // handled by appendFlatTemplates
+  bool hasOnlyVerticalMorphs() const;
+  // Append the nominal template, errors and vertical morphs of this process
+  void appendFlatTemplates(FlatTemplates& out) const;
+
   RooAbsReal const& getXVar() const;
 
   static void EnableFastVertical();
@@ -13,6 +13,7 @@
 #include "SimpleCacheSentry.h"
 #include "CMSHistFunc.h"
 #include "CMSHistV.h"
+#include "FullBarlowBeeston.h"
 
 class CMSHistSum : public RooAbsReal {
 private:
@@ -26,6 +27,13 @@ private:
     std::vector<double> gobs;
     std::vector<RooRealVar*> push_res;
   };
+  // A process whose template depends on a vertical morphing parameter, and
+  // the range of bins [lo, hi) that the parameter can change
+  struct MorphBlock {
+    unsigned proc;
+    unsigned lo;
+    unsigned hi;
+  };
 public:
 
   CMSHistSum();
@@ -62,19 +70,40 @@ public:
   void setAnalyticBarlowBeeston(bool flag) const;
 
   inline FastHisto const& cache() const { return cache_; }
+  // The nominal and vertical morphing templates, and the bin errors, of all the processes
+  std::vector<FastTemplate> const& storage() const { return storage_; }
+  std::vector<FastTemplate> const& binErrors() const { return binerrors_; }
 
   RooArgList const& coefList() const { return coeffpars_; }
+  RooArgList const& morphList() const { return morphpars_; }
+  RooArgList const& binParList() const { return binpars_; }
+
+  // The templates of all the processes and the bin parameters, for the code generation
+  CMSHistFunc::FlatTemplates flatTemplates() const;
   // RooArgList const& funcList() const { return funcs_; }
 
+  // Share the identical nominal templates and vmorph sum/diff pairs in
+  // storage_, and drop the vmorphs that have no effect (all-zero pairs).
+  // Returns the number of templates removed
+  unsigned compactStorage();
+  unsigned storageSize() const { return storage_.size(); }
+
   RooAbsReal const& getXVar() const { return x_.arg(); }
 
   static void EnableFastVertical();
+  // Recompute valsum_ from scratch at least every `period` updates, patching
+  // it in between with the changes of the affected processes only (1 = always)
+  static void SetFullUpdatePeriod(int period);
   friend class CMSHistV<CMSHistSum>;
 
   void injectExternalMorph(int idx, CMSExternalMorph& morph);
 
   void runBarlowBeeston() const;
 
+  // Also minimise analytically the per-process bin parameters, in the bins
+  // below the Poisson threshold
+  static void EnableFullBarlowBeeston();
+
 protected:
   RooRealProxy x_;
 
@@ -118,15 +147,25 @@ protected:
   mutable std::vector<double> data_; //!
 
   mutable BarlowBeeston bb_; //!
+  mutable FullBarlowBeeston bbfull_; //!
 
   mutable bool initialized_; //! not to be serialized
 
   mutable bool analytic_bb_; //! not to be serialized
+  static bool enable_full_bb_; //! not to be serialized
 
   mutable std::vector<double> vertical_prev_vals_; //! not to be serialized
   mutable int fast_mode_; //! not to be serialized
   static bool enable_fast_vertical_; //! not to be serialized
 
+  mutable std::vector<std::vector<MorphBlock>> morph_blocks_; //! for each vmorph
+  mutable std::vector<FastHisto> staged_; //! contribution of each process to valsum_, before the coefficient
+  mutable std::vector<unsigned> dirty_lo_; //! range of bins of each process changed since the last sum
+  mutable std::vector<unsigned> dirty_hi_; //!
+  mutable bool sums_valid_ = false; //! not to be serialized
+  mutable int n_incremental_ = 0; //! not to be serialized
+  static int full_update_period_; //! not to be serialized
+
   RooListProxy external_morphs_;
   std::vector<int> external_morph_indices_;
 
@@ -138,7 +177,10 @@ protected:
   void updateCache() const;
   inline double smoothStepFunc(double x, int const& ip) const;
 
+  void setupMorphBlocks() const;
   void updateMorphs() const;
+  inline void markDirty(unsigned ip, unsigned lo, unsigned hi) const;
+  void stageProcess(unsigned ip) const;
 
 
  private:
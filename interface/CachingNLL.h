@@ -1,8 +1,11 @@
 #ifndef HiggsAnalysis_CombinedLimit_CachingNLL_h
 #define HiggsAnalysis_CombinedLimit_CachingNLL_h
 
+#include <cstdint>
 #include <memory>
 #include <map>
+#include <string>
+#include <vector>
 #include <RooAbsPdf.h>
 #include <RooAddPdf.h>
 #include <RooRealSumPdf.h>
@@ -18,6 +21,9 @@
 #include "SimpleGaussianConstraint.h"
 #include "SimplePoissonConstraint.h"
 #include "SimpleConstraintGroup.h"
+#include "ConstraintBlock.h"
+#include "ProcessNormalizationEngine.h"
+#include "SimpleCacheSentry.h"
 
 class RooMultiPdf;
 class CMSHistSum;
@@ -128,6 +134,9 @@ class CachingAddNLL : public RooAbsReal {
         void clearConstantZeroPoint() ;
         void updateZeroPoint() { clearZeroPoint(); setZeroPoint(); }
         void propagateData();
+        /// NLL of the saturated model for the current data (a histogram of the data itself, normalized to the observed yield),
+        /// with the same constant terms as evaluate(). Returns NaN if a bin has a negative content.
+        double saturatedNLL() const ;
         void setAnalyticBarlowBeeston(bool flag);
         void runAnalyticBarlowBeeston();
         /// note: setIncludeZeroWeights(true) won't have effect unless you also re-call setData
@@ -183,13 +192,39 @@ class CachingSimNLL  : public RooAbsReal {
         void setChannelMasks(RooArgList const& args);
         void setAnalyticBarlowBeeston(bool flag);
         void setMaskNonDiscreteChannels(bool mask) ;
+        const RooAbsData *data() const { return dataOriginal_; }
+        /// ProfiledNLLStore::hashData of data(), computed on first use after each setData
+        std::uint64_t dataHash() const ;
+        /// true if saturatedNLL() can be used, i.e. if all the constraints are gaussian or poisson ones of the optimized kind
+        bool canComputeSaturatedNLL() const { return constrainPdfs_.empty(); }
+        /// NLL of the saturated model for the current data and parameters: each channel replaced by a histogram of its own data,
+        /// and all constraints at their maximum. If channelDiffs is not null, it is filled with the difference between the NLL
+        /// of each channel (indexed as the categories) and its saturated one.
+        double saturatedNLL(std::vector<double> *channelDiffs = nullptr) const ;
+        /// Evaluate each channel with the value of aliases[i] in place of that of par (aliases indexed as the categories, null = no alias),
+        /// so that a parameter can be split into one per channel without cloning the pdfs. par should be kept constant meanwhile.
+        /// A channel is evaluated again only if its own value of par, or one of its other parameters, changed since its last evaluation.
+        void setParameterAliases(RooRealVar &par, const std::vector<RooRealVar *> &aliases) ;
+        void clearParameterAliases() ;
+        /// the fast gaussian and poisson constraints, evaluated together (nullptr if they are grouped, or if there are none)
+        const ConstraintBlock *constraintBlock() const { return constraintBlock_.get(); }
         friend class CachingAddNLL;
         // trap this call, since we don't care about propagating it to the sub-components
         void constOptimizeTestStatistic(ConstOpCode opcode, Bool_t doAlsoTrackingOpt=kTRUE) override { }
     private:
         void setup_();
+        /// build the NLLs of the live channels (not masked) that are not built yet, release those of the channels masked by
+        /// channelMasks_ for more than keepMaskedEvals_ evaluations, and update the parameters if the live channels changed
+        void syncChannels_();
+        void buildChannel_(std::size_t idx);
+        /// delete the NLL of a channel, with the analytic Barlow-Beeston switched off first
+        void releaseChannel_(CachingAddNLL *nll);
+        void updateParameters_();
+        bool isChannelMasked_(std::size_t idx) const { return !channelMasks_.empty() && channelMasks_[idx]->getVal() != 0.; }
         RooSimultaneous   *pdfOriginal_;
         const RooAbsData  *dataOriginal_;
+        mutable std::uint64_t dataHash_ = 0;
+        mutable bool       dataHashValid_ = false;
         const RooArgSet   *nuis_;
         RooSetProxy        params_, catParams_;
         RooArgSet piecesForCloning_;
@@ -200,7 +235,15 @@ class CachingSimNLL  : public RooAbsReal {
         std::vector<SimplePoissonConstraint *>   constrainPdfsFastPoisson_;
         std::vector<bool>                        constrainPdfsFastPoissonOwned_;
         std::vector<SimpleConstraintGroup>       constrainPdfGroups_;
-        std::vector<CachingAddNLL*>     pdfs_;
+        std::vector<CachingAddNLL*>     pdfs_;          // null if the channel has no pdf, or its NLL is not built
+        std::vector<RooAbsPdf *>        channelPdfs_;   // the pdf of each channel, from which pdfs_ are built on demand
+        std::vector<std::string>        channelLabels_;
+        std::vector<bool>               channelLive_;   // not masked by channelMasks_, when the parameters were last updated
+        std::vector<unsigned>           maskedEvals_;   // evaluations since the channel was masked by channelMasks_
+        RooArgSet                       constraintParams_;
+        bool zeroPointSet_ = false, constantZeroPointCleared_ = false, analyticBarlowBeeston_ = false;
+        std::unique_ptr<ProcessNormalizationEngine> normEngine_;
+        std::unique_ptr<ConstraintBlock> constraintBlock_;
         std::unique_ptr<TList>            dataSets_;
         std::vector<RooDataSet *>       datasets_;
         static bool noDeepLEE_;
@@ -211,9 +254,22 @@ class CachingSimNLL  : public RooAbsReal {
         std::vector<double> constrainZeroPointsFastPoisson_;
         std::vector<RooAbsReal*> channelMasks_;
         std::vector<bool>        internalMasks_;
+        mutable std::vector<double> channelVals_; // NLL of each channel in the last evaluation (0 if masked)
         RooArgSet                activeParameters_, activeCatParameters_;
         double                   maskingOffset_ = 0;     // offset to ensure that interal or constraint masking doesn't change NLL value
         double                   maskingOffsetZero_ = 0; // and associated zero point
+        RooRealVar                *aliasedPar_ = nullptr;
+        std::vector<RooRealVar *>  aliases_;
+        std::vector<std::unique_ptr<SimpleCacheSentry>> aliasSentries_; // by channel: the parameters of its NLL but par (null if it does not depend on par)
+        mutable std::vector<double> aliasVals_;   // by channel: the value of par in its last evaluation (NaN if it must be evaluated again)
+        mutable std::vector<double> aliasNLLs_;   // by channel: the NLL of its last evaluation
+        /// the value of par for channel idx (parVal if it has no alias)
+        double aliasValue_(std::size_t idx, double parVal) const { return aliases_[idx] ? aliases_[idx]->getVal() : parVal; }
+        /// true if channel idx depends on par, and neither its value of par nor its other parameters changed since its last evaluation
+        bool aliasCacheGood_(std::size_t idx, double parVal) const ;
+        void applyAlias_(std::size_t idx, double parVal) const ;
+        /// rebuild the sentries of the built channels, and mark all of them to be evaluated again
+        void resetAliasCache_() ;
 };
 
 }
@@ -11,6 +11,7 @@
 
 class TDirectory;
 class TTree;
+class LimitTreeWriter;
 class LimitAlgo;
 class RooWorkspace;
 class RooAbsData;
@@ -49,7 +50,7 @@ public:
   boost::program_options::options_description & miscOptions() { return miscOptions_; }    
   void applyOptions(const boost::program_options::variables_map &vm) ;
   
-  void run(TString hlfFile, const std::string &dataset, double &limit, double &limitErr, int &iToy, TTree *tree, int nToys);
+  void run(TString hlfFile, const std::string &dataset, double &limit, double &limitErr, int &iToy, LimitTreeWriter *tree, int nToys);
 
   /// Set a specific toy to run method on when using --toysFile / --toys
   static void setPickToy(int pickToy);
@@ -120,7 +121,7 @@ private:
   std::vector<std::string> librariesToLoad_;
   std::vector<std::string> modelPoints_;
   
-  static TTree *tree_;
+  static LimitTreeWriter *tree_;
 
   static std::vector<std::pair<RooAbsReal*,float> > trackedParametersMap_;
   static std::vector<std::pair<RooRealVar*,float> > trackedErrorsMap_;
@@ -4,28 +4,100 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Log a printf-style message, formatting it only if the rate limit of this call site allows it. Safe to use in hot paths.
+/// Usage: COMBINE_LOG("CachingNLL.cc", __LINE__, __func__, "underflow in %s", pdf->GetName());
+#define COMBINE_LOG(FILE, LINE, FUNC, ...) do { \
+		static CombineLogger::Site combineLogSite_(FILE, LINE); \
+		if (combineLogSite_.accept()) CombineLogger::instance().log(combineLogSite_, CombineLogger::format(__VA_ARGS__), FUNC); \
+	} while (0)
 
 class CombineLogger
 {
-	public: 
-		static int nLogs;
+	public:
+		static std::atomic<int> nLogs;
+
+		/// State of a call site of COMBINE_LOG: counts, rate limit and deduplication of repeated messages.
+		/// The first burst messages of each site are always accepted, then at most perSecond per second.
+		class Site {
+			public:
+				Site(const char *file, int line) ;
+				bool accept() ;
+			private:
+				friend class CombineLogger;
+				const char *file_;
+				int line_;
+				std::atomic<unsigned long> calls_{0}, suppressed_{0}, repeated_{0}, totalSuppressed_{0}, totalRepeated_{0};
+				std::atomic<std::size_t> lastHash_{0};
+				std::atomic<long long> windowStart_{0};
+				std::atomic<unsigned int> inWindow_{0};
+				std::atomic<bool> registered_{false};
+		};
 
 		static CombineLogger& instance();
-		
+
 		static void setName(const char* _fName){
 			fName=_fName;
 		};
+		static void setRateLimit(unsigned int burst, unsigned int perSecond) {
+			burst_ = burst; perSecond_ = perSecond;
+		}
 
 		void log(const std::string & _file, const int _lineN, const std::string& _logmsg, const std::string& _function);
+		void log(Site &site, const std::string& _logmsg, const char *_function);
+		/// print the number of messages, and write a summary of the suppressed ones to the log file
 		void printLog();
+		/// wait until all the messages so far are written to the log file
+		void flush();
+
+		static std::string format(const char *fmt, ...)
+#ifdef __GNUC__
+			__attribute__((format(printf, 1, 2)))
+#endif
+			;
 
 	protected:
-		// Static variable for the instance  
+		// Static variable for the instance
 		static CombineLogger* pL;
 
 		static const char*  fName;
+		static unsigned int burst_, perSecond_;
 		std::ofstream outStream;
 		CombineLogger();
 		virtual ~CombineLogger();
+
+	private:
+		/// bounded multi-producer queue (D. Vyukov's algorithm): pushing never blocks, messages are dropped if it's full
+		struct Slot {
+			std::atomic<std::size_t> seq;
+			std::string text;
+		};
+		enum { Capacity = 4096 };
+		std::vector<Slot> ring_;
+		std::atomic<std::size_t> head_{0}, tail_{0};
+		std::atomic<unsigned long> dropped_{0};
+
+		/// writer thread, and the mutex for the consumer side of the queue and for the file
+		std::thread *writer_ = nullptr;
+		std::mutex writeMutex_;
+		std::condition_variable wakeUp_;
+		std::atomic<bool> stop_{false}, synchronous_{false};
+		std::mutex sitesMutex_;
+		std::vector<Site *> sites_;
+
+		void push(std::string &&line);
+		/// write out all queued messages; requires writeMutex_
+		void drain_();
+		void writerLoop_();
+		void registerSite_(Site *site);
+		static void atExit_();
+		static void prepareFork_();
+		static void afterForkParent_();
+		static void afterForkChild_();
 };
-#endif
\ No newline at end of file
+#endif
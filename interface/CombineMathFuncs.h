@@ -97,6 +97,101 @@ inline void fastVerticalInterpHistPdf2D2(int nBinsX, int nBinsY, int nCoefs, dou
    }
 }
 
+// Template of one process of a CMSHistFunc or of a CMSHistSum with only
+// vertical morphs, as in CMSHistFunc::updateCache
+inline void cmsHistProcess(int nBins, int nMorphs, double const *morphVals, int const *morphIndex,
+                           double const *nominal, double const *morphsSum, double const *morphsDiff,
+                           int logMorph, double smoothRegion, double *out)
+{
+   for (int iBin = 0; iBin < nBins; ++iBin) {
+      out[iBin] = logMorph ? (nominal[iBin] > 0 ? std::log(nominal[iBin]) : -999.) : nominal[iBin];
+   }
+
+   for (int iMorph = 0; iMorph < nMorphs; ++iMorph) {
+      double const *sum = morphsSum + iMorph * nBins;
+      double const *diff = morphsDiff + iMorph * nBins;
+      double x = morphVals[morphIndex[iMorph]];
+      double a = 0.5 * x;
+      double b = smoothStepFunc(x, smoothRegion);
+      for (int iBin = 0; iBin < nBins; ++iBin) {
+         out[iBin] += a * (diff[iBin] + b * sum[iBin]);
+      }
+   }
+
+   if (logMorph) {
+      // the normalization is the nominal one
+      double nominalSum = 0.0;
+      double morphedSum = 0.0;
+      for (int iBin = 0; iBin < nBins; ++iBin) {
+         out[iBin] = std::exp(out[iBin]);
+         nominalSum += nominal[iBin];
+         morphedSum += out[iBin];
+      }
+      double scale = nominalSum / morphedSum;
+      for (int iBin = 0; iBin < nBins; ++iBin) {
+         out[iBin] *= scale;
+      }
+   }
+
+   for (int iBin = 0; iBin < nBins; ++iBin) {
+      out[iBin] = std::max(1e-9, out[iBin]);
+   }
+}
+
+// Sum of the processes of a CMSHistSum or CMSHistErrorPropagator, with the
+// bin parameters (1: total error, 2: Poisson, 3: Gaussian) applied
+inline void cmsHistSum(int nBins, int nProcs, double const *coeffs, double const *morphVals,
+                       double const *nominal, double const *errors, int const *logMorph, double const *smoothRegion,
+                       int const *morphOffset, int const *morphIndex, double const *morphsSum, double const *morphsDiff,
+                       int nBinPars, double const *binParVals, int const *binParBin, int const *binParProc,
+                       int const *binParType, double *procVals, double *out)
+{
+   for (int iBin = 0; iBin < nBins; ++iBin) {
+      out[iBin] = 0.0;
+   }
+
+   for (int iProc = 0; iProc < nProcs; ++iProc) {
+      double *proc = procVals + iProc * nBins;
+      int first = morphOffset[iProc];
+      cmsHistProcess(nBins, morphOffset[iProc + 1] - first, morphVals, morphIndex + first, nominal + iProc * nBins,
+                     morphsSum + first * nBins, morphsDiff + first * nBins, logMorph[iProc], smoothRegion[iProc], proc);
+      for (int iBin = 0; iBin < nBins; ++iBin) {
+         out[iBin] += coeffs[iProc] * proc[iBin];
+      }
+   }
+
+   for (int iPar = 0; iPar < nBinPars; ++iPar) {
+      int iBin = binParBin[iPar];
+      int iProc = binParProc[iPar];
+      double x = binParVals[iPar];
+      if (binParType[iPar] == 1) {
+         double err2 = 0.0;
+         for (int jProc = 0; jProc < nProcs; ++jProc) {
+            double e = coeffs[jProc] * errors[jProc * nBins + iBin];
+            err2 += e * e;
+         }
+         out[iBin] += std::sqrt(err2) * x;
+      } else if (binParType[iPar] == 2) {
+         out[iBin] += (x - 1.) * procVals[iProc * nBins + iBin] * coeffs[iProc];
+      } else if (binParType[iPar] == 3) {
+         out[iBin] += x * errors[iProc * nBins + iBin] * coeffs[iProc];
+      }
+   }
+
+   for (int iBin = 0; iBin < nBins; ++iBin) {
+      out[iBin] = std::max(1e-9, out[iBin]);
+   }
+}
+
+inline double cmsHistIntegral(int nBins, double const *vals, double const *binWidth)
+{
+   double integral = 0.0;
+   for (int iBin = 0; iBin < nBins; ++iBin) {
+      integral += vals[iBin] * binWidth[iBin];
+   }
+   return integral;
+}
+
 inline double logKappaForX(double theta, double logKappaLow, double logKappaHigh)
 {
    double logKappa = 0.0;
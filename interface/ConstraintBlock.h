@@ -0,0 +1,61 @@
+#ifndef HiggsAnalysis_CombinedLimit_ConstraintBlock_h
+#define HiggsAnalysis_CombinedLimit_ConstraintBlock_h
+/** \class ConstraintBlock
+ *
+ * Evaluation of all the SimpleGaussianConstraint and SimplePoissonConstraint terms of a model at once.
+ *
+ * The constants of the constraints (scale, log-gamma, zero point) are stored in contiguous arrays, and
+ * so are the values of their inputs (x and mean for the gaussians, observed and mean for the poissons),
+ * which are gathered from the list of the distinct inputs when any of them has changed. The sums of the
+ * log values are then computed by the vectorized kernels, without going through the constraint objects.
+ *
+ * The derivatives of -log(constraints) with respect to the inputs (the mean of the poisson constraints
+ * being an input on its own, even if it is a function) can be computed together with the value.
+ *
+ */
+#include <cstdint>
+#include <vector>
+#include <RooArgList.h>
+#include "SimpleCacheSentry.h"
+
+class RooAbsReal;
+class SimpleGaussianConstraint;
+class SimplePoissonConstraint;
+
+class ConstraintBlock {
+    public:
+        ConstraintBlock(const std::vector<SimpleGaussianConstraint *> &gaus, const std::vector<SimplePoissonConstraint *> &pois) ;
+
+        std::size_t size() const { return gausScale_.size() + poisLogGamma_.size(); }
+        /// the distinct inputs of the constraints, i.e. the columns of the derivatives
+        const RooArgList &inputs() const { return inputList_; }
+
+        /// sum of the log values of all the constraints, plus their zero points
+        double logVal() const { update(); return logVal_; }
+        /// as logVal(), and also fill grad and hessDiag with the first derivatives and the diagonal of the
+        /// second derivatives of -logVal() with respect to the inputs
+        double logVal(std::vector<double> &grad, std::vector<double> &hessDiag) const ;
+
+        void setZeroPoint() ;
+        void clearZeroPoint() ;
+
+    private:
+        /// gather the inputs and recompute the sums, if any of the inputs has changed
+        void update() const ;
+
+        RooArgList inputList_;
+        std::vector<const RooAbsReal *> inputs_;
+
+        // gaussians: columns of x and mean, and constants
+        std::vector<uint32_t> gausXCol_, gausMeanCol_;
+        std::vector<double> gausScale_, gausZero_;
+        // poissons: columns of observed and mean, and constants
+        std::vector<uint32_t> poisObsCol_, poisMeanCol_;
+        std::vector<double> poisLogGamma_, poisZero_;
+
+        mutable SimpleCacheSentry sentry_;
+        mutable std::vector<double> inputVals_, gausX_, gausMean_, poisObs_, poisMean_, workingArea_;
+        mutable double logVal_ = 0;
+};
+
+#endif
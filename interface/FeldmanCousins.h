@@ -4,11 +4,15 @@
  *
  * Compute limit using FeldmanCousins++ 
  *
+ * By default, the boundary of the region is found by bisection with HybridNew (see HybridNew::runFeldmanCousins);
+ * option --rooStatsFC uses RooStats::FeldmanCousins instead.
+ *
  * \author Giovanni Petrucciani (UCSD)
  *
  *
  */
 #include "LimitAlgo.h"
+#include "HybridNew.h"
 
 class FeldmanCousins : public LimitAlgo {
 public:
@@ -23,6 +27,12 @@ public:
 private:
   static float toysFactor_;
   static float rAbsAccuracy_, rRelAccuracy_;
+  static bool rooStatsFC_;
+  static unsigned int nToys_, rays_, fork_;
+  static double pAccuracy_;
+  HybridNew hybridNew_;
+
+  bool runRooStats(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint);
 };
 
 #endif
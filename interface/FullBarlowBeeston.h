@@ -0,0 +1,54 @@
+#ifndef FullBarlowBeeston_h
+#define FullBarlowBeeston_h
+#include <vector>
+
+class RooAbsReal;
+class RooRealVar;
+
+/*
+ * Analytic minimisation of the per-process bin parameters (the "full" Barlow-Beeston
+ * case), shared by CMSHistSum and CMSHistErrorPropagator.
+ *
+ * In a bin with observed events d, expected events v at the nominal, gaussian parameters
+ * t_i (yield + a_i * t_i, constraint N(g_i | t_i, 1)) and poisson parameters k_i
+ * (yield + b_i * k_i - s_i, with b_i = s_i / n_i, constraint Poisson(g_i | k_i)), the
+ * NLL is stationary for
+ *     t_i = g_i - a_i * u,  k_i = g_i / (1 + b_i * u),  with u = 1 - d / nu(u)
+ * and nu(u) the total expected events. All the parameters of a bin are then found by
+ * solving this one equation for u, with a bracketed Newton method.
+ *
+ * The bins are stored in CSR format: the terms of bin use[r] are [row[r], row[r+1]).
+ */
+struct FullBarlowBeeston {
+  enum TermType { Poisson = 2, Gaussian = 3 };  // same codes as the bin types
+
+  bool init = false;
+  std::vector<unsigned> use;  // bins
+  std::vector<unsigned> row;
+  // per term
+  std::vector<unsigned> proc;
+  std::vector<unsigned> type;
+  std::vector<double> gobs;
+  std::vector<double> invn;  // 1/n of the poisson terms
+  std::vector<RooRealVar*> push_res;
+  // to be filled before each solve(): per bin, the observed and nominal expected events,
+  // and per term, a_i for the gaussian terms and s_i for the poisson ones
+  std::vector<double> dat;
+  std::vector<double> valsum;
+  std::vector<double> scale;
+  // per bin, the solution for u, used as a starting point for the next one
+  std::vector<double> u;
+
+  // Add the floating parameters of bin j, given the bin parameters of its processes
+  // (nullptr for the ones without). The global observables are read from their
+  // gaussian or poisson constraints. The parameters are set constant.
+  void addBin(unsigned j, std::vector<unsigned> const& types, std::vector<RooAbsReal*> const& binpars);
+  // Finish the setup, after all the bins have been added
+  void finalize();
+  // Solve for all the bins, and set the parameters
+  void solve();
+  // Release the parameters and clear everything
+  void clear();
+};
+
+#endif
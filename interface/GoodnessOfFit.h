@@ -24,6 +24,9 @@ public:
   void applyOptions(const boost::program_options::variables_map &vm) override ;
 
   virtual bool runSaturatedModel(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint);
+  /// Compute the saturated model NLL directly from the data, after the nominal fit. Returns false if this is not possible
+  /// for this model or dataset (and then runSaturatedModel should be used); ok is set to the outcome otherwise.
+  bool runSaturatedModelDirect(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooAbsData &data, double &limit, bool &ok);
   virtual bool runKSandAD(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint, bool kolmo);
   void initKSandAD(RooStats::ModelConfig *mc_s);
   double EvaluateADDistance(RooAbsPdf& pdf, RooAbsData& data, RooRealVar& observable, bool kolmo);
@@ -46,6 +49,9 @@ protected:
   static std::string setParametersForFit_;
   static std::string setParametersForEval_;
 
+  static bool saturatedFit_;
+  static bool saturatedPerChannel_;
+
   // Return a pdf that matches this data perfectly.
   RooAbsPdf *makeSaturatedPdf(RooAbsData &data);
   mutable std::vector<RooAbsData*> tempData_;
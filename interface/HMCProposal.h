@@ -0,0 +1,85 @@
+#ifndef HiggsAnalysis_CombinedLimit_HMCProposal_h
+#define HiggsAnalysis_CombinedLimit_HMCProposal_h
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <Rtypes.h>
+
+class RooAbsData;
+class RooAbsPdf;
+class RooFitResult;
+class RooRealVar;
+#include <RooArgSet.h>
+#include <RooAbsReal.h>
+#include <TMatrixD.h>
+#include <TMatrixDSym.h>
+
+#include <RooStats/ProposalFunction.h>
+
+/** Hamiltonian Monte Carlo proposal
+ *
+ * Each proposal is a leapfrog trajectory in the parameter space, driven by the gradient of the NLL
+ * and by a random gaussian momentum. The trajectory has a fixed number of steps (this is plain HMC, not NUTS).
+ * The gradient is computed with forward finite differences, since the combine NLL has no analytic
+ * gradient, so each leapfrog step costs n+1 NLL evaluations for n parameters. The mass matrix is the inverse
+ * of the covariance matrix from a fit, if provided. The step size is tuned with dual averaging during
+ * the first proposals, and then kept fixed. The kinetic energy enters the Metropolis-Hastings acceptance
+ * through GetProposalDensity, so the chain samples the correct posterior.
+ */
+class HMCProposal : public RooStats::ProposalFunction {
+
+   public:
+      HMCProposal() : RooStats::ProposalFunction() {}
+      HMCProposal(RooAbsPdf &pdf, RooAbsData &data, const RooFitResult *fit, int steps, double stepSize, int adaptSteps) ;
+
+      // Populate xPrime with a new proposed point
+      void Propose(RooArgSet& xPrime, RooArgSet& x) override;
+
+      // Determine whether or not the proposal density is symmetric for
+      // points x1 and x2 - that is, whether the probabilty of reaching x2
+      // from x1 is equal to the probability of reaching x1 from x2
+      Bool_t IsSymmetric(RooArgSet& x1, RooArgSet& x2) override ;
+
+      // Return the probability of proposing the point x1 given the starting
+      // point x2
+      Double_t GetProposalDensity(RooArgSet& x1, RooArgSet& x2) override;
+
+      ~HMCProposal() override {}
+
+      /// current step size (in units of the fit uncertainties)
+      double stepSize() const { return stepSize_; }
+      /// number of NLL evaluations done so far
+      long nllEvaluations() const { return nllEvals_; }
+
+      ClassDefOverride(HMCProposal,1) // Hamiltonian Monte Carlo proposal, using the gradient of the NLL
+
+    private:
+        std::unique_ptr<RooAbsReal> nll_;
+        RooArgSet                   params_;
+        /// covariance matrix from the fit, and the names of its parameters
+        TMatrixDSym                 fitCov_;
+        std::vector<std::string>    fitNames_;
+        /// parameters that are stepped, and their position in the sets passed to Propose
+        std::vector<RooRealVar *>   vars_;
+        std::vector<int>            index_;
+        /// lower triangular L with L L^T = covariance, and the finite difference step of each parameter
+        TMatrixD                    chol_;
+        std::vector<double>         delta_;
+        int    steps_ = 10, adaptSteps_ = 0, proposed_ = 0;
+        long   nllEvals_ = 0;
+        double stepSize_ = 0.1;
+        /// dual averaging state
+        double mu_ = 0, hBar_ = 0, logStepSizeBar_ = 0;
+        /// kinetic energy at the start and end of the last trajectory, and where it ended
+        double kinetic0_ = 0, kinetic1_ = 0;
+        std::vector<double> lastProposed_;
+
+        void init(RooArgSet &x) ;
+        /// set the parameters to x, and return the NLL and its gradient
+        double nllAndGradient(const std::vector<double> &x, std::vector<double> &grad) ;
+        bool inRange(const std::vector<double> &x) const ;
+        bool isLastProposed(RooArgSet &x) const ;
+};
+
+#endif
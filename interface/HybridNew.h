@@ -10,10 +10,15 @@
  */
 #include "LimitAlgo.h"
 #include <algorithm> 
+#include <limits>
+#include <memory>
+#include <RooAbsData.h>
 #include <RooStats/ModelConfig.h>
 #include <RooStats/HybridCalculator.h>
 #include <RooStats/ToyMCSampler.h>
 #include <TF1.h>
+#include "HypoTestResultGrid.h"
+#include "ProfiledLikelihoodRatioTestStatExt.h"
 
 class RooRealVar;
 class TGraphErrors;
@@ -30,6 +35,10 @@ public:
   virtual bool runSignificance(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint);
   virtual bool runSinglePoint(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint);
   virtual bool runTestStatistics(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint);
+  /// Feldman-Cousins interval (one POI) or contour (two POIs), bisecting the boundary of the acceptance region with frequentist toys
+  virtual bool runFeldmanCousins(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint);
+  /// Configure for runFeldmanCousins, used by the FeldmanCousins method in place of the command line options of HybridNew
+  void setupFeldmanCousins(unsigned int nToys, double clsAccuracy, double rAbsAccuracy, double rRelAccuracy, unsigned int rays, unsigned int fork, bool reuseToys, float mass) ;
   const std::string & name() const override {
     static const std::string name("HybridNew");
     return name;
@@ -49,6 +58,7 @@ private:
   static RooArgSet           rValues_;  // values of the parameters
   static unsigned int iterations_;
   static bool saveHybridResult_, readHybridResults_; 
+  static std::string gridFormat_;
   static std::string gridFile_;
   static bool expectedFromGrid_, clsQuantiles_; 
   static float quantileForExpectedFromGrid_;
@@ -58,6 +68,8 @@ private:
   static bool noUpdateGrid_; 
   static unsigned int fork_;
   static bool importanceSamplingNull_, importanceSamplingAlt_;
+  static bool reuseToys_;
+  static float reuseToysMinESS_;
   static std::string algo_;
   static std::string mode_;
   static std::string plot_;
@@ -74,6 +86,7 @@ private:
   static float maxProbability_;
   static float confidenceToleranceForToyScaling_;
   static float adaptiveToys_;
+  static unsigned int fcRays_;
 
   static double EPS;
   // graph, used to compute the limit, not just for plotting!
@@ -93,6 +106,23 @@ private:
     RooArgSet cleanupList;
   };
 
+  /// toys thrown at one value of the POI and kept in memory, to be reused at nearby values
+  struct ToyPool {
+    RooArgSet genSnapshot; // parameters used to generate the toys
+    std::vector<std::unique_ptr<RooAbsData>> toys;
+    std::vector<std::unique_ptr<RooArgSet>>  globalObs;
+    // fits of each toy, reused at the next values of the POI (with the LHC test statistic)
+    std::vector<std::unique_ptr<ProfiledLikelihoodTestStatOpt::FitCache>> fits;
+    // NLL of each toy at genSnapshot, computed with poolNLL_
+    std::vector<double> anchorNLL;
+    void clear() { toys.clear(); globalObs.clear(); fits.clear(); anchorNLL.clear(); }
+  };
+  std::map<double, ToyPool> sbToyPools_; // S+B toys, by anchor value of the POI
+  ToyPool bToyPool_;                     // B-only toys, which do not depend on the POI
+  std::unique_ptr<RooAbsReal> poolNLL_;  // NLL used to compute the likelihood ratio weights
+  RooAbsPdf *poolNLLPdf_ = nullptr;
+  double lastPoolTarget_ = std::numeric_limits<double>::quiet_NaN();
+
   void validateOptions() ;
 
   // make sure our rValues_ is contains all pois in the model, and does not contain anything else
@@ -119,8 +149,15 @@ private:
   void applySignalQuantile(RooStats::HypoTestResult &hcres);
   RooStats::HypoTestResult *evalGeneric(RooStats::HybridCalculator &hc, bool forceNoFork=false);
   RooStats::HypoTestResult *evalWithFork(RooStats::HybridCalculator &hc);
+  RooStats::HypoTestResult *evalWithToyPool(RooStats::HybridCalculator &hc);
+  void fillToyPool(ToyPool &pool, RooStats::ToyMCSampler &sampler, const RooStats::ModelConfig &model, int nToys);
+  std::vector<double> toyPoolWeights(ToyPool &pool, const RooAbsCollection &target, RooAbsPdf &pdf, const RooArgSet *globalObs, double &ess);
+  void clearToyPools();
   // RooStats::HypoTestResult *evalFrequentist(RooStats::HybridCalculator &hc);  // cross-check implementation, 
   RooStats::HypoTestResult *readToysFromFile(const RooAbsCollection & rVals);
+  /// save the result for --saveHybridResult, as a HypoTestResult object or as an entry of the columnar grid
+  void saveHybridResult(const RooStats::HypoTestResult &result, const RooAbsCollection & rVals);
+  std::unique_ptr<HypoTestResultGrid> gridWriter_;
 
   std::map<double, RooStats::HypoTestResult *> grid_;
 
@@ -131,11 +168,15 @@ private:
   std::pair<double,double> updateGridPoint(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, std::map<double, RooStats::HypoTestResult *>::iterator point);
   std::pair<double,double> interpolateAndUncert(TGraphErrors *gr, double clsTarget);
   std::vector<std::pair<double, double> > findIntervalsFromSplines(TGraphErrors *limitPlot_,double clsTarget);
+  /// Boundary of the FC acceptance region along origin + t * direction, for t in [0, tMax]. Returns (t, uncertainty on t), with t = tMax if the boundary is not crossed.
+  std::pair<double,double> findBoundaryFC(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, const RooArgList &pois, const std::vector<double> &origin, const std::vector<double> &direction, double tStart, double tMax, double clsTarget, bool &ok);
 
 
   void useGrid();
 
   bool doFC_;
+  /// values of the POIs on the boundary of a two-dimensional FC region, saved in the limit tree
+  std::vector<float> fcPoiValues_;
   
 };
 
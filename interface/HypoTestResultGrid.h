@@ -0,0 +1,75 @@
+#ifndef HiggsAnalysis_CombinedLimit_HypoTestResultGrid_h
+#define HiggsAnalysis_CombinedLimit_HypoTestResultGrid_h
+/** \class HypoTestResultGrid
+ *
+ * Columnar storage of the test statistic distributions of HybridNew grids.
+ *
+ * Each result saved by a job at a given parameter point is one entry of a TTree,
+ * holding the values of the POIs, the observed test statistic and the toy values
+ * and weights of the null and alternate distributions as contiguous arrays.
+ * Trees from many jobs are merged with hadd, and the readers only load the arrays
+ * of the entries at the requested points, merging them in a single pass.
+ *
+ */
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class TDirectory;
+class TTree;
+class RooAbsCollection;
+namespace RooStats { class HypoTestResult; }
+
+class HypoTestResultGrid {
+    public:
+        /// create a grid for writing, with one column for each of these POIs
+        explicit HypoTestResultGrid(const RooAbsCollection &pois) ;
+        ~HypoTestResultGrid() ;
+
+        /// add this result, computed at this point and mass
+        void fill(const RooStats::HypoTestResult &result, const RooAbsCollection &point, float mass) ;
+        /// save the entries filled since the last call in this directory: the tree is attached to it on the first
+        /// call, and then owned by it, and only the new entries and the tree header are written at each call
+        void write(TDirectory *dir) ;
+
+        /// name of the tree in the toys directory
+        static const char *treeName() { return "HypoTestGrid"; }
+        /// true if there's a grid stored in this directory
+        static bool exists(TDirectory *dir) ;
+        /// merge all results at this point and mass, or return 0 if there are none.
+        /// POIs that are not columns of the grid are not used to select the results.
+        static RooStats::HypoTestResult * read(TDirectory *dir, const RooAbsCollection &point, float mass, int verbose = 0) ;
+        /// merge all results for a single POI with value in [min, max], adding them to the results already in the grid
+        static void readAll(TDirectory *dir, const char *poiName, float mass, double min, double max, std::map<double, RooStats::HypoTestResult *> &grid, int verbose = 0) ;
+
+    private:
+        /// the columns of one entry
+        struct Row {
+            float mass = 0;
+            double testStatData = 0;
+            bool pValueIsRightTail = true, backgroundIsAlt = false;
+            std::vector<double> *nullValues = nullptr, *nullWeights = nullptr, *altValues = nullptr, *altWeights = nullptr;
+        };
+        TTree *tree_;
+        bool ownTree_ = true; // until attached to a directory
+        std::vector<std::string> poiNames_;
+        std::vector<double> poiValues_;
+        std::vector<double> nullValues_, nullWeights_, altValues_, altWeights_;
+        Row row_;
+
+        /// accumulates the entries of one parameter point
+        struct Merger {
+            bool pValueIsRightTail = true, backgroundIsAlt = false;
+            double testStatData = 0;
+            std::vector<double> nullValues, nullWeights, altValues, altWeights;
+            int entries = 0;
+            void add(const Row &row) ;
+            RooStats::HypoTestResult *release() ;
+        };
+        /// bind the columns of a grid being read; returns false if any of the POIs is missing
+        static bool bind(TTree *tree, Row &row, const std::vector<std::string> &poiNames, std::vector<double> &poiValues) ;
+        static bool sameValue(double a, double b) ;
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef HiggsAnalysis_CombinedLimit_LimitTreeWriter_h
+#define HiggsAnalysis_CombinedLimit_LimitTreeWriter_h
+/** \class LimitTreeWriter
+ *
+ * Output of the results of combine (the "limit" tree), either as a TTree (default) or as an RNTuple
+ * (ROOT 6.36 or later). Each commit fills one entry with the current values of the registered columns;
+ * the buffering and compression are left to ROOT (TTree baskets, RNTuple pages and clusters).
+ *
+ * Columns can be added after the first commit, as some methods of combine do: in the TTree the branch
+ * is added as with TTree::Branch, and in the RNTuple the field is added with a model update, so that
+ * it reads back as zero (or an empty string) for the earlier entries.
+ *
+ * Commits are thread-safe.
+ *
+ */
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <Rtypes.h>
+
+class TDirectory;
+class TTree;
+
+class LimitTreeWriter {
+public:
+  enum Format { TTreeFormat, RNTupleFormat };
+  LimitTreeWriter(TDirectory *dir, const char *name, const char *title, Format format = TTreeFormat) ;
+  ~LimitTreeWriter() ;
+
+  /// Add a column, read from address at each commit. The type is taken from the leaflist, as for TTree::Branch ("name/D", "name/F", "name/I" or "name/O")
+  void addBranch(const char *name, void *address, const char *leaflist) ;
+  /// Add a column of strings
+  void addBranch(const char *name, std::string *address) ;
+  /// Fill an entry with the current values of all the columns
+  void commit() ;
+  /// Save the tree in its directory (or close the RNTuple). Nothing can be committed afterwards.
+  void write() ;
+
+  Long64_t entries() const ;
+  /// The underlying TTree (nullptr for the RNTuple format)
+  TTree *tree() const { return tree_; }
+
+  /// "ttree" or "rntuple"
+  static Format parseFormat(const std::string &name) ;
+
+private:
+  struct Column {
+      std::string name;
+      char type; // one of D, F, I, O, S
+      void *address;
+      std::shared_ptr<void> field; // where the RNTuple reads from at each fill
+  };
+  struct RNTupleOutput;
+
+  TDirectory *dir_;
+  std::string name_;
+  Format format_;
+  Long64_t entries_ = 0;
+  bool closed_ = false;
+  TTree *tree_ = nullptr;
+  std::unique_ptr<RNTupleOutput> rntuple_;
+  std::vector<Column> columns_;
+  mutable std::mutex mutex_;
+
+  Column &addColumn_(const char *name, void *address, char type) ;
+  /// create the RNTuple with the columns registered so far, if not done yet
+  void openRNTuple_() ;
+};
+
+#endif
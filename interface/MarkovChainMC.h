@@ -10,6 +10,7 @@
  */
 #include "LimitAlgo.h"
 #include <TList.h>
+#include <vector>
 class RooArgSet;
 namespace RooStats { class MarkovChain; }
 
@@ -23,7 +24,7 @@ public:
     return name;
   }
 private:
-  enum ProposalType { FitP, UniformP, MultiGaussianP, TestP };
+  enum ProposalType { FitP, UniformP, MultiGaussianP, TestP, HMCP };
   static std::string proposalTypeName_;
   static ProposalType proposalType_;
   static bool runMinos_, noReset_, updateProposalParams_, updateHint_;
@@ -51,6 +52,12 @@ private:
   static bool mergeChains_; 
   /// Read chains from file instead of running them 
   static bool readChains_;
+  /// Run this number of chains at the same time, in forked processes
+  static unsigned int parallelChains_;
+  /// Stop running chains once the Gelman-Rubin R-hat of the POI is below this value (0 = always run all tries)
+  static float maxRHat_;
+  /// ... and the effective sample size of the POI, summed over all chains, is above this value
+  static float minESS_;
   /// Mass of the Higgs boson (goes into the name of the saved chains)
   float mass_;
   /// Number of degrees of freedom of the problem, approximately
@@ -62,16 +69,44 @@ private:
   static float        proposalHelperWidthRangeDivisor_, proposalHelperUniformFraction_;
   static float        cropNSigmas_;
   static int          debugProposal_;
+  /// Leapfrog steps per proposal, initial step size and number of proposals used to tune it for the 'hmc' proposal
+  static unsigned int hmcSteps_, hmcAdaptSteps_;
+  static float        hmcStepSize_;
   ///
   static std::vector<std::string> discreteModelPoints_;
   mutable std::vector<RooArgSet>  discreteModelPointSets_;
 
   mutable TList chains_;
 
+  /// Values and weights of the POI in a chain after burn-in, enough to merge chains and compute diagnostics
+  struct CompactChain {
+      double limit = 0;
+      int    size = 0; // number of entries in the original chain
+      std::vector<double> poi, weight;
+      mutable double ess = -1; // effective sample size, computed on first use (-1 = not yet)
+      long   nllEvals = 0; // NLL evaluations done by the proposal, if it counts them (hmc)
+  };
+  mutable std::vector<CompactChain> compactChains_;
+
   // return number of items in chain, 0 for error
   int runOnce(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint) const ;
 
+  /// run this number of chains in forked processes, adding them to compactChains_; returns the number of successful ones
+  int runParallel(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, const double *hint, unsigned int nchains) const ;
+
   RooStats::MarkovChain *mergeChains(const RooArgSet &poi, const std::vector<double> &limits) const;
+  /// same as mergeChains + limitFromChain, but working directly on compactChains_
+  double limitFromCompactChains(const std::vector<double> &limits) const;
+  void mergeRange(const std::vector<double> &limits, double &lmin, double &lmax) const;
+  CompactChain compactChain(const RooStats::MarkovChain &chain, const char *poiName, double limit) const;
+  static bool writeCompactChain(const char *fileName, const CompactChain &chain);
+  static bool readCompactChain(const char *fileName, CompactChain &chain);
+  /// Gelman-Rubin potential scale reduction factor of the POI across the chains
+  static double gelmanRubin(const std::vector<CompactChain> &chains);
+  /// effective sample size of the POI in one chain, from the batch means of the steps (cached in the chain)
+  static double effectiveSampleSize(const CompactChain &chain);
+  /// true if the chains run so far satisfy the convergence criteria
+  bool converged() const;
   void readChains(const RooArgSet &poi, std::vector<double> &limits);
   void limitFromChain(double &limit, double &limitErr, const RooArgSet &poi, RooStats::MarkovChain &chain, int burnInSteps=-1 /* -1 = use default */) ;
   void limitAndError(double &limit, double &limitErr, const std::vector<double> &limits) const ;
@@ -4,6 +4,8 @@
 #include <RooAbsReal.h>
 #include "RooListProxy.h"
 
+class ProcessNormalizationEngine;
+
 //_________________________________________________
 /*
 BEGIN_HTML
@@ -35,6 +37,10 @@ class ProcessNormalization : public RooAbsReal {
       RooArgList const &asymmThetaList() const { return asymmThetaList_; }
       RooArgList const &otherFactorList() const { return otherFactorList_; }
 
+      /// take the log-normal factor from entry index of engine in evaluate() (nullptr to compute it here)
+      void setEngine(const ProcessNormalizationEngine *engine, unsigned int index) { engine_ = engine; engineIndex_ = index; setValueDirty(); }
+      const ProcessNormalizationEngine *engine() const { return engine_; }
+
     protected:
         Double_t evaluate() const override;
 #if ROOT_VERSION_CODE >= ROOT_VERSION(6,32,0)
@@ -56,6 +62,8 @@ class ProcessNormalization : public RooAbsReal {
         mutable std::vector<double> otherFactorListVec_; //! Don't serialize me
         mutable std::vector<double> logAsymmKappaLow_; //! Don't serialize me
         mutable std::vector<double> logAsymmKappaHigh_; //! Don't serialize me
+        const ProcessNormalizationEngine *engine_ = nullptr; //! Don't serialize me
+        unsigned int engineIndex_ = 0; //! Don't serialize me
 
   ClassDefOverride(ProcessNormalization,1) // Process normalization interpolator 
 };
@@ -0,0 +1,76 @@
+#ifndef HiggsAnalysis_CombinedLimit_ProcessNormalizationEngine_h
+#define HiggsAnalysis_CombinedLimit_ProcessNormalizationEngine_h
+/** \class ProcessNormalizationEngine
+ *
+ * Evaluation of the log-normal part of all the ProcessNormalization objects of a model at once.
+ *
+ * The symmetric and asymmetric log-kappas of all the processes are stored as two sparse
+ * (processes x nuisances) matrices in CSR format, over the list of the distinct nuisances.
+ * When any nuisance has changed, the values of all the nuisances are read once, the log of the
+ * normalizations is computed with one sparse matrix-vector product (plus the interpolation of the
+ * asymmetric kappas), and the exponentials are taken in one vectorized call.
+ *
+ * The ProcessNormalization objects attached to the engine take the factor from it in evaluate(),
+ * and multiply it by their nominal value and other factors. Several engines can be built on the same
+ * model (e.g. by two NLLs): the last one built takes over the objects, and when an engine is deleted its
+ * objects are handed over to the most recent other engine that contains them, or detached if there is none.
+ *
+ */
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <RooArgList.h>
+#include "SimpleCacheSentry.h"
+
+class RooAbsArg;
+class RooAbsReal;
+class ProcessNormalization;
+
+class ProcessNormalizationEngine {
+    public:
+        /// collect all the ProcessNormalization objects among the components of model, and attach them to this engine
+        ProcessNormalizationEngine(const RooAbsArg &model) ;
+        ~ProcessNormalizationEngine() ;
+
+        std::size_t nProcesses() const { return procs_.size(); }
+        const std::vector<ProcessNormalization *> &processes() const { return procs_; }
+        /// the distinct nuisances, i.e. the columns of the matrices
+        const RooArgList &nuisances() const { return thetaList_; }
+
+        /// exp of the sum of the log-normal terms of process i
+        double logNormalFactor(std::size_t i) const { update(); return expLogVal_[i]; }
+
+        /// pattern of the jacobian of the normalizations with respect to the nuisances, in CSR format:
+        /// the entries of process i are in [jacobianRowStart()[i], jacobianRowStart()[i+1]),
+        /// and jacobianColumns() holds the index of their nuisance
+        const std::vector<uint32_t> &jacobianRowStart() const { return jacRow_; }
+        const std::vector<uint32_t> &jacobianColumns() const { return jacCol_; }
+        /// fill out with d(normalization)/d(nuisance) for all the entries of the pattern,
+        /// at the current values of the nuisances and of the other factors
+        void jacobian(std::vector<double> &out) const ;
+
+    private:
+        /// recompute all the factors, if any of the nuisances has changed
+        void update() const ;
+
+        std::vector<ProcessNormalization *> procs_;
+        std::unordered_map<const ProcessNormalization *, uint32_t> procIndex_;
+        /// all the engines alive, in order of creation
+        static std::vector<ProcessNormalizationEngine *> engines_;
+        RooArgList thetaList_;
+        std::vector<RooAbsReal *> thetas_;
+
+        // symmetric log-kappas
+        std::vector<uint32_t> symRow_, symCol_, symJac_;
+        std::vector<double> symLogKappa_;
+        // asymmetric log-kappas
+        std::vector<uint32_t> asymRow_, asymCol_, asymJac_;
+        std::vector<double> asymLogKappaLo_, asymLogKappaHi_;
+        // merged pattern of the two, for the jacobian
+        std::vector<uint32_t> jacRow_, jacCol_;
+
+        mutable SimpleCacheSentry sentry_;
+        mutable std::vector<double> thetaVals_, logVal_, expLogVal_;
+};
+
+#endif
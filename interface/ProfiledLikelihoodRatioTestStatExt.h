@@ -64,6 +64,20 @@ class ProfiledLikelihoodTestStatOpt : public RooStats::TestStatistic {
         void setPrintLevel(Int_t level) { verbosity_ = level; }
 
         void SetOneSided(OneSidedness oneSided) { oneSided_ = oneSided; }
+
+        /// Fits of one dataset kept by the caller, to evaluate it again at another value of the POI: the unconditional
+        /// fit is reused as it is, and the conditional fit starts from the last one. Only used with one POI.
+        struct FitCache {
+            unsigned long nllGeneration = 0; // 0 = empty
+            double nullNLL = 0, bestFitR = 0;
+            RooArgSet bestFitState;
+            bool hasConditional = false;
+            RooArgSet conditionalState;
+        };
+        /// the cache used by the next calls to Evaluate (null = none), it must stay alive meanwhile
+        void setFitCache(FitCache *cache) { fitCache_ = cache; }
+        /// number of minimizations done so far
+        unsigned long nFits() const { return nFits_; }
     private:
 
         RooAbsPdf *pdf_;
@@ -75,6 +89,8 @@ class ProfiledLikelihoodTestStatOpt : public RooStats::TestStatistic {
         RooArgList gobsParams_, gobs_;
         Int_t verbosity_;
         OneSidedness oneSided_;
+        FitCache *fitCache_ = nullptr;
+        unsigned long nllGeneration_ = 0, nFits_ = 0;
 
         // create NLL. if returns true, it can be kept, if false it should be deleted at the end of Evaluate
         bool createNLLWrapper(RooAbsPdf &pdf, RooAbsData &data) ;
@@ -0,0 +1,86 @@
+#ifndef HiggsAnalysis_CombinedLimit_ProfiledNLLStore_h
+#define HiggsAnalysis_CombinedLimit_ProfiledNLLStore_h
+/** \class ProfiledNLLStore
+ *
+ * On-disk store of the results of the minimizations done by the CascadeMinimizer, that can be shared by
+ * many combine jobs on the same workspace.
+ *
+ * Each record is keyed by a hash of the workspace (see hashWorkspace), of the dataset, of the minimizer settings, of the floating
+ * parameters and of the values of all the constant ones (i.e. of the POI point, of the frozen parameters and of
+ * the global observables), and holds the profiled NLL and the values of the floating parameters after the fit.
+ *
+ * The file is an append-only sequence of records. It is memory-mapped when it is opened, while the records
+ * added afterwards by other jobs (which lock the file with fcntl while appending) are seen only by the jobs started later.
+ *
+ */
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class RooAbsData;
+class RooWorkspace;
+
+class ProfiledNLLStore {
+    public:
+        /// WarmStart: start the fit from the stored parameters; SkipFit: just set the stored parameters, and don't fit at all
+        enum Mode { WarmStart, SkipFit };
+
+        struct Entry {
+            double nll = 0;
+            int status = 0;
+            std::vector<double> values;
+        };
+
+        /// 64-bit FNV-1a hash
+        class Hasher {
+            public:
+                Hasher &add(const void *data, std::size_t size) ;
+                Hasher &add(double x) { return add(&x, sizeof(double)); }
+                Hasher &add(std::uint64_t x) { return add(&x, sizeof(std::uint64_t)); }
+                Hasher &add(const std::string &str) { add(std::uint64_t(str.size())); return add(str.data(), str.size()); }
+                std::uint64_t value() const { return value_; }
+            private:
+                std::uint64_t value_ = 14695981039346656037ULL;
+        };
+
+        /// open the store (creating the file if needed); it stays open until the end of the job
+        static void open(const std::string &fileName, Mode mode) ;
+        /// the store in use, or nullptr if there is none
+        static ProfiledNLLStore *instance() { return instance_; }
+
+        Mode mode() const { return mode_; }
+        /// hash of the workspace, to be set after loading it
+        void setContext(std::uint64_t hash) { context_ = hash; }
+        std::uint64_t context() const { return context_; }
+
+        bool lookup(std::uint64_t key, Entry &entry) const ;
+        void save(std::uint64_t key, const Entry &entry) ;
+
+        /// hash of the names, classes and servers of all the components of the workspace, of the ranges and values
+        /// of its variables and constants, of the states of its categories, of its datasets, and of the templates
+        /// of the histogram functions (CMSHistFunc, CMSHistSum, RooHistFunc and RooHistPdf)
+        static std::uint64_t hashWorkspace(const RooWorkspace &w) ;
+        /// hash of all the entries of the dataset (values of the observables and weights)
+        static std::uint64_t hashData(const RooAbsData &data) ;
+
+    private:
+        ProfiledNLLStore(const std::string &fileName, Mode mode) ;
+        ~ProfiledNLLStore() ;
+
+        static ProfiledNLLStore *instance_;
+
+        std::string fileName_;
+        Mode mode_;
+        std::uint64_t context_ = 0;
+        int fd_ = -1;
+        /// the file as it was when it was opened, and the offset of the last record for each key
+        const char *map_ = nullptr;
+        std::size_t mapSize_ = 0;
+        std::unordered_map<std::uint64_t, std::size_t> index_;
+        /// records saved by this job
+        std::unordered_map<std::uint64_t, Entry> saved_;
+};
+
+#endif
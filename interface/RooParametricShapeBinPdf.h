@@ -12,6 +12,7 @@ class RooAbsReal;
 #include "Riostream.h"
 #include "TMath.h"
 #include <TH1.h>
+#include <vector>
 
 //---------------------------------------------------------------------------
 class RooParametricShapeBinPdf : public RooAbsPdf
@@ -49,6 +50,29 @@ protected:
    Double_t xMin;        // X min
 
    Double_t evaluate() const override;
+
+   /// Integrals of the shape in all bins, computed together and cached on the values of its parameters:
+   /// with closed-form antiderivatives for exponential and power-law shapes, and otherwise with
+   /// Gauss-Legendre quadrature on a grid of nodes shared by all bins
+   enum ShapeFamily { GenericShape, ExponentialShape, PowerLawShape };
+   mutable ShapeFamily family_ = GenericShape; //!
+   mutable RooArgList shapePars_; //! parameters of the shape, used to check if the cache is valid
+   mutable std::vector<double> shapeParVals_; //!
+   mutable std::vector<double> binIntegrals_; //!
+   mutable std::vector<double> nodeX_, nodeW_; //! Gauss-Legendre nodes and weights, nodes per bin
+   mutable std::vector<double> glX_, glW_; //! Gauss-Legendre nodes and weights on [-1,1]
+   mutable int glUpdates_ = 0; //! number of times the Gauss-Legendre integrals were computed
+   mutable bool glFallback_ = false; //! the quadrature was not accurate enough, use the per-bin RooFit integrals
+   mutable bool cacheInit_ = false; //!
+   void initCache() const ;
+   /// true if the bin integrals come from the per-bin RooFit integral objects
+   bool perBinIntegrals() const ;
+   /// recompute binIntegrals_ if the shape parameters changed
+   void updateBinIntegrals() const ;
+   bool closedFormIntegrals() const ;
+   void gaussLegendreIntegrals() const ;
+   /// compare the quadrature with the same rule applied to the two halves of each bin
+   bool gaussLegendreAccurate() const ;
 private:
    RooPlot* plotOn(RooPlot* frame, 
               const RooCmdArg& arg1=RooCmdArg::none(), const RooCmdArg& arg2=RooCmdArg::none(),
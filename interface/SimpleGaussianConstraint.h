@@ -18,7 +18,10 @@ class SimpleGaussianConstraint : public RooGaussian {
 #if ROOT_VERSION_CODE < ROOT_VERSION(6,26,0)
         // function was upstreamed to RooGaussian in ROOT 6.26
         const RooAbsReal & getX() const { return x.arg(); }
+        const RooAbsReal & getMean() const { return mean.arg(); }
 #endif
+        /// -0.5/sigma^2, so that getLogValFast() = getScale() * (x - mean)^2
+        double getScale() const { return scale_; }
 
         double getLogValFast() const { 
             if (_valueDirty) {
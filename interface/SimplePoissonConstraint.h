@@ -18,6 +18,9 @@ class SimplePoissonConstraint : public RooPoisson {
         inline ~SimplePoissonConstraint() override { }
 
         const RooAbsReal & getMean() const { return mean.arg(); }
+        const RooAbsReal & getObserved() const { return x.arg(); }
+        /// log(Gamma(x+1)), computed once from the value of x at construction
+        double getLogGamma() const { return logGamma_; }
 
         double getLogValFast() const { 
             if (_valueDirty) {
@@ -40,6 +43,14 @@ class SimplePoissonConstraint : public RooPoisson {
             return _value;
         }
 
+        /// value of getLogValFast() at its maximum, i.e. for mean == x
+        double getLogValMax() const {
+            Double_t observed = x;
+            if (std::abs(observed)<1e-10) return 0;
+            if (observed<1000000) return - ( - observed * log(observed) + observed + logGamma_ );
+            return log(observed)/2;
+        }
+
         static RooPoisson * make(RooPoisson &c) ;
     private:
         double logGamma_;
@@ -0,0 +1,51 @@
+#ifndef HiggsAnalysis_CombinedLimit_WorkspaceSlimmer_h
+#define HiggsAnalysis_CombinedLimit_WorkspaceSlimmer_h
+/** \class WorkspaceSlimmer
+ *
+ * Rewrite a workspace keeping only what is needed to run on it: the pdfs of the ModelConfigs and everything
+ * they depend on, the datasets, the named sets, the snapshots, and the RooArgSets stored as generic objects
+ * (e.g. discreteParams). The other objects left over by text2workspace are dropped: in particular the
+ * CMSHistFuncs that have been merged into a CMSHistSum, together with their CMSHistFuncWrappers, which
+ * otherwise hold a second copy of all the templates. The wrappers of CMSHistFuncs that are still part of
+ * the model (e.g. through a CMSHistErrorPropagator) are kept.
+ *
+ * The identical templates of each CMSHistSum are then shared, and its vertical morphs with no effect dropped
+ * (see CMSHistSum::compactStorage).
+ *
+ * The slimmed workspace is a new one, built by importing the objects to keep from the input one.
+ *
+ */
+#include <cstddef>
+#include <string>
+
+class RooWorkspace;
+
+class WorkspaceSlimmer {
+    public:
+        struct Report {
+            unsigned nodesIn = 0, nodesOut = 0;
+            unsigned dataIn = 0, dataOut = 0;
+            unsigned genericIn = 0, genericOut = 0;
+            unsigned templatesIn = 0, templatesOut = 0;
+            double slimTime = 0;
+            // only filled by slim() if timeRead is true: size of the streamed workspaces, and time to read them back
+            std::size_t bytesIn = 0, bytesOut = 0;
+            double readTimeIn = 0, readTimeOut = 0;
+            void print() const ;
+        };
+
+        WorkspaceSlimmer(int verbose = 0) : verbose_(verbose) {}
+
+        /// a new slimmed copy of the workspace, owned by the caller
+        RooWorkspace *slim(RooWorkspace &in, bool timeRead = false) ;
+        const Report &report() const { return report_; }
+
+        /// stream the workspace to a buffer, and return the number of bytes and the time taken to read it back
+        static std::size_t measure(RooWorkspace &w, double &readTime) ;
+
+    private:
+        int verbose_;
+        Report report_;
+};
+
+#endif
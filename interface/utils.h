@@ -4,6 +4,7 @@
 #include <vector>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <TGraphAsymmErrors.h>
 #include <TString.h>
 #include <RooHistError.h>
@@ -43,19 +44,34 @@ namespace utils {
     // Clone a function and all its branch nodes that depends on the observables. on request, clone also leaf nodes (i.e. RooRealVars)
     RooAbsReal *fullCloneFunc(const RooAbsReal *pdf, const RooArgSet &obs, RooArgSet &holder, bool cloneLeafNodes=false) ;
 
+    /// Answers arg.dependsOn(observables) for all the nodes of a graph, remembering the answer for each node,
+    /// so that each node is visited only once however many times it is shared (e.g. the constraint terms
+    /// repeated in every channel). The graph must not be changed while the cache is in use.
+    class DependencyCache {
+        public:
+            explicit DependencyCache(const RooAbsCollection &observables) ;
+            bool dependsOn(const RooAbsArg &arg) ;
+        private:
+            std::unordered_set<const TNamed *> names_;
+            std::unordered_map<const RooAbsArg *, bool> memo_;
+    };
+
     /// Create a pdf which depends only on observables, and collect the other constraint terms
     /// Will return 0 if it's all constraints, &pdf if it's all observables, or a new pdf if it's something mixed
     /// In the last case, you're the owner of the returned pdf.
     RooAbsPdf *factorizePdf(const RooArgSet &observables, RooAbsPdf &pdf, RooArgList &constraints);
+    RooAbsPdf *factorizePdf(DependencyCache &deps, RooAbsPdf &pdf, RooArgList &constraints);
 
     /// collect factors depending on observables in obsTerms, and all others in constraints
     void factorizePdf(RooStats::ModelConfig &model, RooAbsPdf &pdf, RooArgList &obsTerms, RooArgList &constraints, bool debug=false);
     void factorizePdf(const RooArgSet &observables, RooAbsPdf &pdf, RooArgList &obsTerms, RooArgList &constraints, bool debug=false);
+    void factorizePdf(DependencyCache &deps, RooAbsPdf &pdf, RooArgList &obsTerms, RooArgList &constraints);
     RooAbsPdf *makeNuisancePdf(RooStats::ModelConfig &model, const char *name="nuisancePdf") ;
     RooAbsPdf *makeNuisancePdf(RooAbsPdf &pdf, const RooArgSet &observables, const char *name="nuisancePdf") ;
 
     /// factorize a RooAbsReal
     void factorizeFunc(const RooArgSet &observables, RooAbsReal &pdf, RooArgList &obsTerms, RooArgList &otherTerms, bool keepDuplicates = true, bool debug=false);
+    void factorizeFunc(DependencyCache &deps, RooAbsReal &pdf, RooArgList &obsTerms, RooArgList &otherTerms, bool keepDuplicates = true);
 #if ROOT_VERSION_CODE < ROOT_VERSION(6,28,0)
     /// workaround for RooProdPdf::components()
     RooArgList factors(const RooProduct &prod) ;
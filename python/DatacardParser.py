@@ -134,6 +134,13 @@ def addDatacardParserOptions(parser):
         action="store_true",
         help="Use memory-optimized CMSHistSum instead of CMSHistErrorPropagator",
     )
+    parser.add_option(
+        "--parallel-shapes",
+        dest="parallelShapes",
+        default=0,
+        type="int",
+        help="Build the pdfs of the channels made of histogram templates in this number of parallel processes, one channel per process",
+    )
     parser.add_option(
         "--no-optimize-pdfs",
         dest="noOptimizePdf",
@@ -1,10 +1,13 @@
+import multiprocessing
+import os
 import os.path
+import tempfile
 from collections import defaultdict
 from math import *
 from sys import exit, stderr, stdout
 
 import ROOT
-from HiggsAnalysis.CombinedLimit.ModelTools import ModelBuilder
+from HiggsAnalysis.CombinedLimit.ModelTools import ModelBuilder, SafeWorkspaceImporter
 
 from .DataFrameWrapper import DataFrameWrapper
 
@@ -21,6 +24,24 @@ def RooArgSet_add_patched(self, obj, *args, **kwargs):
 ROOT.RooArgSet.add = RooArgSet_add_patched
 
 
+# files with these extensions are read as dataframes, all the others as ROOT files
+_dataFrameExtensions = [".csv", ".json", ".html", ".pkl", ".xlsx", ".h5", ".parquet"]
+
+
+def findShapeFile(basedir, fname):
+    if not os.path.exists(fname) and not os.path.isabs(fname) and os.path.exists(basedir + "/" + fname):
+        return basedir + "/" + fname
+    return fname
+
+
+# the builder of the running text2workspace, for the worker processes forked by ShapeBuilder.buildChannelsInParallel
+_parallelBuilder = None
+
+
+def buildChannelPdfs(channel):
+    return _parallelBuilder.buildChannelPdfs(channel)
+
+
 class FileCache:
     def __init__(self, basedir, maxsize=250):
         self._basedir = basedir
@@ -39,13 +60,11 @@ class FileCache:
                 for k in keys[: self._maxsize // 2]:
                     self._files[k][0].Close()
                     del self._files[k]
-            trueFName = fname
-            if not os.path.exists(trueFName) and not os.path.isabs(trueFName) and os.path.exists(self._basedir + "/" + trueFName):
-                trueFName = self._basedir + "/" + trueFName
+            trueFName = findShapeFile(self._basedir, fname)
             # interpret file from extension - csv, json, html, pkl, xlsx, h5, parquet
             filepath = trueFName.split(":")[0]
             filename, ext = os.path.splitext(filepath)
-            if ext in [".csv", ".json", ".html", ".pkl", ".xlsx", ".h5", ".parquet"]:
+            if ext in _dataFrameExtensions:
                 filehandle = DataFrameWrapper(trueFName, ext)
             else:
                 # fallback to ROOT file
@@ -74,6 +93,7 @@ class ShapeBuilder(ModelBuilder):
         self._get_pdf_cache = {}
         self._shape2data_cache = {}
         self._shape2pdf_cache = {}
+        self._extra_norm_cache = {}
 
     ## ------------------------------------------
     ## -------- ModelBuilder interface ----------
@@ -102,6 +122,8 @@ class ShapeBuilder(ModelBuilder):
             self.doCombinedDataset()
 
     def doIndividualModels(self):
+        if self.options.parallelShapes > 1:
+            self.buildChannelsInParallel(self.options.parallelShapes)
         if self.options.verbose:
             stderr.write("Creating pdfs for individual modes (%d): " % len(self.DC.bins))
             stderr.flush()
@@ -459,6 +481,61 @@ class ShapeBuilder(ModelBuilder):
     ## --------------------------------------
     ## -------- High level helpers ----------
     ## --------------------------------------
+    def channelProcesses(self, channel):
+        """The processes that have a pdf in this channel, as in doIndividualModels"""
+        return [p for p in self.DC.exp[channel].keys() if self.DC.exp[channel][p] != 0 and self.physics.getYieldScale(channel, p) != 0]
+
+    def buildChannelPdfs(self, channel):
+        """Build the pdfs and the extra normalization terms of all the processes of a channel, and save them in a
+        workspace in a temporary file. Returns (channel, file name, {process: (pdf name, extra normalization)})"""
+        wsp = ROOT.RooWorkspace("w_" + channel, "")
+        importer = SafeWorkspaceImporter(wsp)
+        ret = {}
+        for p in self.channelProcesses(channel):
+            pdf = self.getPdf(channel, p)
+            extranorm = self.getExtraNorm(channel, p)
+            importer(pdf, ROOT.RooFit.RecycleConflictNodes(), ROOT.RooFit.Silence())
+            for X in extranorm or []:
+                if isinstance(X, str) and not self.out.function(X):
+                    importer(self.getObj(X), ROOT.RooFit.RecycleConflictNodes(), ROOT.RooFit.Silence())
+            ret[p] = (pdf.GetName(), extranorm)
+        fd, fname = tempfile.mkstemp(prefix="combine_%s_" % channel, suffix=".root")
+        os.close(fd)
+        wsp.writeToFile(fname)
+        return channel, fname, ret
+
+    def buildChannelsInParallel(self, nworkers):
+        """Build the pdfs of the channels made only of histogram templates in nworkers processes, forked from this one
+        once the parameters and normalizations are in the workspace. Each process builds one channel, reading its
+        histograms itself, and exits, so that no process holds the templates of more than one channel. The results are
+        imported one channel at a time, with the parameters they share recycled from the workspace"""
+        channels = []
+        for b in self.DC.bins:
+            shapes = [self.getShape(b, p) for p in self.channelProcesses(b)]
+            if shapes and all(s and s.ClassName().startswith("TH1") for s in shapes):
+                channels.append(b)
+        if not channels:
+            return
+        if self.options.verbose:
+            stderr.write("Building the pdfs of %d channels in %d processes\n" % (len(channels), nworkers))
+        global _parallelBuilder
+        _parallelBuilder = self
+        with multiprocessing.get_context("fork").Pool(min(nworkers, len(channels)), maxtasksperchild=1) as pool:
+            for b, fname, pdfs in pool.imap_unordered(buildChannelPdfs, channels):
+                tfile = ROOT.TFile.Open(fname)
+                wsp = tfile.Get("w_" + b)
+                for p, (name, extranorm) in pdfs.items():
+                    self.out.safe_import(wsp.arg(name), ROOT.RooFit.RecycleConflictNodes(), ROOT.RooFit.Silence())
+                    self._get_pdf_cache[(b, p)] = self.out.arg(name)
+                    for X in extranorm or []:
+                        if isinstance(X, str) and X not in self.objstore and not self.out.function(X):
+                            self.out.safe_import(wsp.arg(X), ROOT.RooFit.RecycleConflictNodes(), ROOT.RooFit.Silence())
+                            self.objstore[X] = self.out.function(X)
+                    self._extra_norm_cache[(b, p)] = extranorm
+                tfile.Close()
+                os.remove(fname)
+        _parallelBuilder = None
+
     def prepareAllShapes(self):
         shapeTypes = []
         shapeBins = {}
@@ -672,44 +749,10 @@ class ShapeBuilder(ModelBuilder):
                 )
             return _cache[(channel, process, syst)]
         postFix = "Sig" if (process in self.DC.isSignal and self.DC.isSignal[process]) else "Bkg"
-        bentry = None
-        if channel in self.DC.shapeMap:
-            bentry = self.DC.shapeMap[channel]
-        elif "*" in self.DC.shapeMap:
-            bentry = self.DC.shapeMap["*"]
-        else:
-            raise KeyError("Shape map has no entry for channel '%s'" % (channel))
-        names = []
-        if process in bentry:
-            names = bentry[process]
-        elif "*" in bentry:
-            names = bentry["*"]
-        elif process in self.DC.shapeMap["*"]:
-            names = self.DC.shapeMap["*"][process]
-        elif "*" in self.DC.shapeMap["*"]:
-            names = self.DC.shapeMap["*"]["*"]
-        else:
-            raise KeyError(f"Shape map has no entry for process '{process}', channel '{channel}'")
-        if len(names) == 1 and names[0] == "FAKE":
+        resolved = self.resolveShape(channel, process, syst, allowNoSyst)
+        if resolved is None:
             return None
-        if syst != "":
-            if len(names) == 2:
-                if allowNoSyst:
-                    return None
-                raise RuntimeError("Cannot find systematic " + syst + f" for process '{process}', channel '{channel}'")
-            names = [names[0], names[2]]
-        else:
-            names = [names[0], names[1]]
-        strmass = "%d" % self.options.mass if self.options.mass % 1 == 0 else str(self.options.mass)
-        finalNames = [x.replace("$PROCESS", process).replace("$CHANNEL", channel).replace("$SYSTEMATIC", syst).replace("$MASS", strmass) for x in names]
-        for mp in self.options.modelparams:
-            if len(mp.split("=")) != 2:
-                raise RuntimeError("No value found for keyword in %s (use --keyword-value WORD=VALUE)" % mp)
-            mpname, mpv = mp.split("=")
-            protected_kwords = ["PROCESS", "CHANNEL", "SYSTEMATIC", "MASS"]
-            if mpname in protected_kwords:
-                raise RuntimeError("Cannot use the following keywords (already assigned in combine): $" + " $".join(protected_kwords))
-            finalNames = [fn.replace("$%s" % mpname, mpv) for fn in finalNames]
+        names, finalNames = resolved
         file = self._fileCache[finalNames[0]]
         objname = finalNames[1]
         if not file:
@@ -845,6 +888,49 @@ class ShapeBuilder(ModelBuilder):
             _cache[(channel, process, syst)] = ret
             return ret
 
+    def resolveShape(self, channel, process, syst="", allowNoSyst=False):
+        """Patterns of the file and object names for this shape, and the names with all the keywords replaced.
+        None for fake shapes, or for missing systematics if allowNoSyst"""
+        bentry = None
+        if channel in self.DC.shapeMap:
+            bentry = self.DC.shapeMap[channel]
+        elif "*" in self.DC.shapeMap:
+            bentry = self.DC.shapeMap["*"]
+        else:
+            raise KeyError("Shape map has no entry for channel '%s'" % (channel))
+        names = []
+        if process in bentry:
+            names = bentry[process]
+        elif "*" in bentry:
+            names = bentry["*"]
+        elif process in self.DC.shapeMap["*"]:
+            names = self.DC.shapeMap["*"][process]
+        elif "*" in self.DC.shapeMap["*"]:
+            names = self.DC.shapeMap["*"]["*"]
+        else:
+            raise KeyError(f"Shape map has no entry for process '{process}', channel '{channel}'")
+        if len(names) == 1 and names[0] == "FAKE":
+            return None
+        if syst != "":
+            if len(names) == 2:
+                if allowNoSyst:
+                    return None
+                raise RuntimeError("Cannot find systematic " + syst + f" for process '{process}', channel '{channel}'")
+            names = [names[0], names[2]]
+        else:
+            names = [names[0], names[1]]
+        strmass = "%d" % self.options.mass if self.options.mass % 1 == 0 else str(self.options.mass)
+        finalNames = [x.replace("$PROCESS", process).replace("$CHANNEL", channel).replace("$SYSTEMATIC", syst).replace("$MASS", strmass) for x in names]
+        for mp in self.options.modelparams:
+            if len(mp.split("=")) != 2:
+                raise RuntimeError("No value found for keyword in %s (use --keyword-value WORD=VALUE)" % mp)
+            mpname, mpv = mp.split("=")
+            protected_kwords = ["PROCESS", "CHANNEL", "SYSTEMATIC", "MASS"]
+            if mpname in protected_kwords:
+                raise RuntimeError("Cannot use the following keywords (already assigned in combine): $" + " $".join(protected_kwords))
+            finalNames = [fn.replace("$%s" % mpname, mpv) for fn in finalNames]
+        return names, finalNames
+
     def getData(self, channel, process, syst="", _cache=None):
         return self.shape2Data(self.getShape(channel, process, syst), channel, process)
 
@@ -1099,6 +1185,8 @@ class ShapeBuilder(ModelBuilder):
         return shapeUp != None
 
     def getExtraNorm(self, channel, process):
+        if (channel, process) in self._extra_norm_cache:
+            return self._extra_norm_cache[(channel, process)]
         if channel in self.selfNormBins and self.DC.binParFlags[channel][2] in [2]:
             if self.options.verbose > 1:
                 print(f"Skipping getExtraNorm for ({channel},{process})")
@@ -0,0 +1,54 @@
+#!/usr/bin/env python3
+import os
+import sys
+import time
+from optparse import OptionParser
+
+import ROOT
+
+ROOT.PyConfig.IgnoreCommandLineOptions = True
+ROOT.gROOT.SetBatch(True)
+ROOT.gSystem.Load("libHiggsAnalysisCombinedLimit")
+
+parser = OptionParser(
+    usage="usage: %prog [options] input.root output.root",
+    description="Write a slimmed copy of a workspace made by text2workspace.py, keeping only what is needed to run combine on it: the pdfs of the ModelConfigs and everything they depend on, the datasets, the named sets and the snapshots. The identical templates of the CMSHistSums are shared. Reports the sizes and the reading times of the input and output workspaces.",
+)
+parser.add_option("-w", "--workspace", dest="workspace", default="w", help="Name of the workspace [%default]")
+parser.add_option("-v", "--verbose", dest="verbose", default=0, type="int", help="Verbosity level")
+(options, args) = parser.parse_args()
+if len(args) != 2:
+    parser.print_usage()
+    sys.exit(1)
+
+
+def readWorkspace(fname):
+    start = time.time()
+    fin = ROOT.TFile.Open(fname)
+    if not fin:
+        raise RuntimeError("Cannot open %s" % fname)
+    ws = fin.Get(options.workspace)
+    if not ws:
+        raise RuntimeError("No workspace %s in %s" % (options.workspace, fname))
+    return fin, ws, time.time() - start
+
+
+fin, win, _ = readWorkspace(args[0])
+slimmer = ROOT.WorkspaceSlimmer(options.verbose)
+wout = slimmer.slim(win)
+ROOT.SetOwnership(wout, True)
+wout.writeToFile(args[1])
+del wout
+fin.Close()
+
+# read both again, now that the libraries and dictionaries are loaded
+readTimes = []
+for fname in args:
+    f, w, t = readWorkspace(fname)
+    readTimes.append(t)
+    f.Close()
+
+if not options.verbose:
+    slimmer.report().print()
+print("    file size:       %8.2f MB -> %8.2f MB" % (os.path.getsize(args[0]) / 1048576.0, os.path.getsize(args[1]) / 1048576.0))
+print("    file read time:  %8.2f s  -> %8.2f s" % tuple(readTimes))
@@ -1,4 +1,7 @@
 #include <stdexcept>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 #include "../interface/AsymptoticLimits.h"
 #include <RooRealVar.h>
@@ -32,6 +35,7 @@ bool  AsymptoticLimits::picky_ = false;
 bool  AsymptoticLimits::noFitAsimov_ = false; 
 bool  AsymptoticLimits::useGrid_ = false; 
 bool  AsymptoticLimits::newExpected_ = true; 
+bool  AsymptoticLimits::expectedFromProfile_ = true; 
 std::string AsymptoticLimits::minosAlgo_ = "stepping"; 
 //std::string AsymptoticLimits::minimizerAlgo_ = "Minuit2";
 //float       AsymptoticLimits::minimizerTolerance_ = 0.01;
@@ -59,6 +63,7 @@ LimitAlgo("AsymptoticLimits specific options") {
         ("noFitAsimov", "Use the pre-fit asimov dataset")
 	("getLimitFromGrid", boost::program_options::value<std::string>(&gridFileName_), "Calculates the limit from a grid of r,cls values")
         ("newExpected", boost::program_options::value<bool>(&newExpected_)->default_value(newExpected_), "Use the new formula for expected limits (default is true)")
+        ("expectedFromProfile", boost::program_options::value<bool>(&expectedFromProfile_)->default_value(expectedFromProfile_), "With --newExpected, get all the expected quantiles from a single adaptive scan of the profiled likelihood of the asimov dataset, instead of a separate search for each (default is true)")
         ("minosAlgo", boost::program_options::value<std::string>(&minosAlgo_)->default_value(minosAlgo_), "Algorithm to use to get the median expected limit: 'minos' (fastest), 'bisection', 'stepping' (default, most robust)")
         ("strictBounds", "Take --rMax as a strict upper bound")
     ;
@@ -425,7 +430,12 @@ std::vector<std::pair<float,float> > AsymptoticLimits::runLimitExpected(RooWorks
 
     // 3) get ingredients for equation 37
     double nll0 = nll->getVal();
-    double median = findExpectedLimitFromCrossing(*nll, r, r->getMin(), r->getMax(), nll0, 0.5);
+    // the other quantiles can be read from the same scan of the profiled NLL, reusing the fits done to find the median
+    bool fromProfile = newExpected_ && expectedFromProfile_ && minosAlgo_ != "minos";
+    std::vector<ProfilePoint> profile;
+    if (fromProfile) profile.emplace_back(r->getVal(), nll0, *params_);
+    double rBest = r->getVal();
+    double median = findExpectedLimitFromCrossing(*nll, r, r->getMin(), r->getMax(), nll0, 0.5, fromProfile ? &profile : nullptr);
     double sigma  = median / ROOT::Math::normal_quantile(1-(doCLs_ ? 0.5:1.0)*(1-cl),1.0);
     double alpha = 1-cl;
     if (verbose > 0) { 
@@ -435,9 +445,20 @@ std::vector<std::pair<float,float> > AsymptoticLimits::runLimitExpected(RooWorks
     }
 
     const double quantiles[5] = { 0.025, 0.16, 0.50, 0.84, 0.975 };
+    std::vector<float> limitsFromProfile;
+    if (fromProfile && !std::isnan(median)) {
+        double qMuAsimov = doNonStandardAsimov_ ? qMuNonStandardAsimov(*nll, r) : 0;
+        std::vector<double> thresholds;
+        for (int iq = 0; iq < 5; ++iq) if (iq != 2) thresholds.push_back(expectedErrorLevel(quantiles[iq], qMuAsimov));
+        limitsFromProfile = findExpectedLimitsFromProfile(*nll, r, profile, nll0, rBest, median, expectedErrorLevel(0.5, qMuAsimov), thresholds);
+        limitsFromProfile.insert(limitsFromProfile.begin()+2, median);
+    }
     for (int iq = 0; iq < 5; ++iq) {
         double N = ROOT::Math::normal_quantile(quantiles[iq], 1.0);
-        if (newExpected_ && iq != 2) { // the median is exactly the same in the two methods
+        if (!limitsFromProfile.empty() && iq != 2) {
+            limit = limitsFromProfile[iq];
+            if (std::isnan(limit)) { expected.clear(); break; } 
+        } else if (newExpected_ && iq != 2) { // the median is exactly the same in the two methods
             std::string minosAlgoBackup = minosAlgo_;
             if (minosAlgo_ == "stepping") minosAlgo_ = "bisection";
             switch (iq) {
@@ -460,44 +481,48 @@ std::vector<std::pair<float,float> > AsymptoticLimits::runLimitExpected(RooWorks
 
 }
 
-float AsymptoticLimits::findExpectedLimitFromCrossing(RooAbsReal &nll, RooRealVar *r, double rMin, double rMax, double nll0, double pb) {
-    // EQ 37 of CMS NOTE 2011-005 or CCGV Eqn 88:https://arxiv.org/abs/1007.1727
-    //   mu_N = sigma * ( normal_quantile_c( (1-cl) * normal_cdf(N) ) + N )
-    // --> (mu_N/sigma) = N + normal_quantile_c( (1-cl) * (1-Pb) ) but in our code here we refer to pb=1-Pb
-    // but qmu = (mu_N/sigma)^2
-    // --> qmu = [ N + normal_quantile_c( (1-cl)*(1-Pb) ) ]^2
-    // remember that qmu = 2*nll
-    // if we assumed that qmu is quadratic then were done. in this function, we dont make this assumption and instead find the 
-    // crossing value of mu that gives the specified qmu in the above.
-    // note that as in CCGV the asymptotic formula for upper limits in qmu and qmutilde are identical so can use qmu here.
+double AsymptoticLimits::qMuNonStandardAsimov(RooAbsReal &nll, RooRealVar *r) {
+    // Need to find q(0) 
+    r->setVal(0); r->setConstant(true);
+    CascadeMinimizer minim2(nll, CascadeMinimizer::Constrained);
+    if (hasDiscreteParams_) minim2.minimize(verbose-2);
+    else minim2.improve(verbose-2);
+    double q_At_0 = 2*nll.getVal();
+    r->setVal(signalStrengthForExpected_);
+    if (hasDiscreteParams_) minim2.minimize(verbose-2);
+    else minim2.improve(verbose-2);
+    double q_At_muA = 2*nll.getVal();
+    r->setConstant(false);
+    return q_At_0-q_At_muA;
+}
 
+double AsymptoticLimits::expectedErrorLevel(double pb, double qMuAsimov) const {
     // only need to modify the value of pb compared to the typical case where mu'=0 for the asimov dataset
     double pb_expected = pb;     
     double N = ROOT::Math::normal_quantile(pb, 1.0);
-    
-    // Things get tricker here so first, we use the Asimov value of the test stat and plug it into 
     if (doNonStandardAsimov_) {
-        
-        // std::cout << "Using non-standard asimov dataset with signal strength " << signalStrengthForExpected_ << std::endl;
-        // Need to find q(0) 
-        r->setVal(0); r->setConstant(true);
-        CascadeMinimizer minim2(nll, CascadeMinimizer::Constrained);
-        if (hasDiscreteParams_) minim2.minimize(verbose-2);
-        else minim2.improve(verbose-2);
-        double q_At_0 = 2*nll.getVal();
-        r->setVal(signalStrengthForExpected_);
-        if (hasDiscreteParams_) minim2.minimize(verbose-2);
-        else minim2.improve(verbose-2);
-        double q_At_muA = 2*nll.getVal();
-        r->setConstant(false);
-
-        double qMuAsimov =  q_At_0-q_At_muA;
         double N_for_expected = N+sqrt(qMuAsimov);
         pb_expected = ROOT::Math::normal_cdf(N_for_expected, 1.0); 
         // std::cout << "  --> this gives pb = " << pb_expected << " (N=" << N_for_expected << ")" << std::endl;
     }
+    return 0.5 * pow(N+ROOT::Math::normal_quantile_c((doCLs_ ? pb_expected:1.)*(1-cl),1.0), 2);
+}
 
-    double errorlevel = 0.5 * pow(N+ROOT::Math::normal_quantile_c((doCLs_ ? pb_expected:1.)*(1-cl),1.0), 2);
+float AsymptoticLimits::findExpectedLimitFromCrossing(RooAbsReal &nll, RooRealVar *r, double rMin, double rMax, double nll0, double pb, std::vector<ProfilePoint> *profile) {
+    // EQ 37 of CMS NOTE 2011-005 or CCGV Eqn 88:https://arxiv.org/abs/1007.1727
+    //   mu_N = sigma * ( normal_quantile_c( (1-cl) * normal_cdf(N) ) + N )
+    // --> (mu_N/sigma) = N + normal_quantile_c( (1-cl) * (1-Pb) ) but in our code here we refer to pb=1-Pb
+    // but qmu = (mu_N/sigma)^2
+    // --> qmu = [ N + normal_quantile_c( (1-cl)*(1-Pb) ) ]^2
+    // remember that qmu = 2*nll
+    // if we assumed that qmu is quadratic then were done. in this function, we dont make this assumption and instead find the 
+    // crossing value of mu that gives the specified qmu in the above.
+    // note that as in CCGV the asymptotic formula for upper limits in qmu and qmutilde are identical so can use qmu here.
+
+    // Things get tricker for a non-standard asimov dataset: we use the Asimov value of the test stat to modify pb
+    double qMuAsimov = doNonStandardAsimov_ ? qMuNonStandardAsimov(nll, r) : 0;
+    double errorlevel = expectedErrorLevel(pb, qMuAsimov);
+    auto record = [&](double nllVal) { if (profile) profile->emplace_back(r->getVal(), nllVal, *params_); };
     int minosStat = -1;
     if (minosAlgo_ == "minos") {
         double rMax0 = r->getMax();
@@ -558,6 +583,7 @@ float AsymptoticLimits::findExpectedLimitFromCrossing(RooAbsReal &nll, RooRealVa
                 }
                 if (!ok && picky_) break; else minosStat = 0;
                 double here = nll.getVal();
+                record(here);
                 if (verbose > 1) CombineLogger::instance().log("AsymptoticLimits.cc",__LINE__,std::string(Form("At %s = %f:\tdelta(nll) = %.5f\n", r->GetName(), rCross, here-nll0)),__func__);
                 if (fabs(here - threshold) < 0.05*minim2.tolerance()) break;
                 if (here < threshold) rMin = rCross; else rMax = rCross;
@@ -582,6 +608,7 @@ float AsymptoticLimits::findExpectedLimitFromCrossing(RooAbsReal &nll, RooRealVa
                 }
                 if (!ok && picky_) break; else minosStat = 0;
                 double here = nll.getVal();
+                record(here);
                 if (verbose > 1) CombineLogger::instance().log("AsymptoticLimits.cc",__LINE__,std::string(Form("At %s = %f:\tdelta(nll) = %.5f\n", r->GetName(), rCross, here-nll0)),__func__);
                 if (fabs(here - threshold) < 0.05*minim2.tolerance()) break;
                 if (here < threshold) { 
@@ -639,6 +666,7 @@ float AsymptoticLimits::findExpectedLimitFromCrossing(RooAbsReal &nll, RooRealVa
                         if (!ok && picky_) return std::numeric_limits<float>::quiet_NaN();
                     }
                     double nll_1_prof = nll.getVal();
+                    record(nll_1_prof);
                     kappa = (nll_1 - nll_1_prof) / std::pow(r_1 - r_0,2);
                     if (verbose > 1) CombineLogger::instance().log("AsymptoticLimits.cc",__LINE__,std::string(Form("At %s = %f:\tdelta(nll unprof) = %.5f\tdelta(nll prof) = %.5f\tkappa=%.5f\n", r->GetName(), r_1, nll_1-nll0, nll.getVal()-nll0, kappa)),__func__);
                     if (nll_1_prof > threshold) { 
@@ -683,6 +711,7 @@ float AsymptoticLimits::findExpectedLimitFromCrossing(RooAbsReal &nll, RooRealVa
                }
                if (!ok && picky_) return std::numeric_limits<float>::quiet_NaN();
                double nll_prof = nll.getVal();
+               record(nll_prof);
                if (verbose > 1) CombineLogger::instance().log("AsymptoticLimits.cc",__LINE__,std::string(Form("At %s = %f:\tdelta(nll unprof) = %.5f\tdelta(nll prof) = %.5f\tdelta(nll appr) = %.5f\n", r->GetName(), rCross, nll_unprof-nll0, nll_prof-nll0, nll_unprof-nll0 - kappa*std::pow(rCross-r_1,2))),__func__);
                if (fabs(nll_prof - threshold) < 0.1*minim2.tolerance()) { break; }
                // not yet bang on, so update r_0, kappa
@@ -704,6 +733,110 @@ float AsymptoticLimits::findExpectedLimitFromCrossing(RooAbsReal &nll, RooRealVa
     return std::numeric_limits<float>::quiet_NaN();
 }
 
+namespace {
+    /// Solve y(x) = target in [x[k], x[k+1]], where y(x) is the monotone piecewise-cubic (Fritsch-Butland) interpolation of the points (x, y).
+    /// Requires y[k] < target <= y[k+1].
+    double invertMonotoneSpline(const std::vector<double> &x, const std::vector<double> &y, unsigned int k, double target) {
+        auto secant = [&](unsigned int i) { return (y[i+1]-y[i])/(x[i+1]-x[i]); };
+        auto tangent = [&](unsigned int i) {
+            if (i == 0) return secant(0);
+            if (i+1 == x.size()) return secant(i-1);
+            double d0 = secant(i-1), d1 = secant(i);
+            if (d0*d1 <= 0) return 0.;
+            double h0 = x[i]-x[i-1], h1 = x[i+1]-x[i];
+            double w0 = 2*h1 + h0, w1 = h1 + 2*h0;
+            return (w0+w1)/(w0/d0 + w1/d1);
+        };
+        double h = x[k+1]-x[k], m0 = tangent(k)*h, m1 = tangent(k+1)*h;
+        double lo = 0, hi = 1;
+        for (int i = 0; i < 60; ++i) {
+            double t = 0.5*(lo+hi), t2 = t*t, t3 = t2*t;
+            double yt = (2*t3-3*t2+1)*y[k] + (t3-2*t2+t)*m0 + (-2*t3+3*t2)*y[k+1] + (t3-t2)*m1;
+            if (yt < target) lo = t; else hi = t;
+        }
+        return x[k] + 0.5*(lo+hi)*h;
+    }
+}
+
+std::vector<float> AsymptoticLimits::findExpectedLimitsFromProfile(RooAbsReal &nll, RooRealVar *r, std::vector<ProfilePoint> &profile, double nll0, double rBest, double median, double medianThreshold, const std::vector<double> &thresholds) {
+    // All the expected limits are crossings of the same profiled NLL curve with different thresholds (see findExpectedLimitFromCrossing),
+    // so we build a single scan of it, and read all the crossings from a monotone spline through the points.
+    // The spline is in sqrt(2*deltaNLL), which is linear in r if the NLL is quadratic, and it is refined by a conditional fit
+    // only where the crossing is not yet known to within rAbsAccuracy_/rRelAccuracy_. Each fit starts from the parameters
+    // of the closest point already profiled.
+    std::vector<float> ret(thresholds.size(), std::numeric_limits<float>::quiet_NaN());
+    r->setConstant(true);
+    CascadeMinimizer minim2(nll, CascadeMinimizer::Constrained);
+    double rMaxHard = 100*std::max(r->getMax(), median);
+    int nfits = 0;
+    std::vector<double> xs, ys;
+    std::vector<unsigned int> index;
+    for (unsigned int iq = 0, nq = thresholds.size(); iq < nq; ++iq) {
+        double target = sqrt(2*thresholds[iq]);
+        double rFitted = std::numeric_limits<double>::quiet_NaN();
+        for (int iter = 0; iter < 30; ++iter) {
+            // points of the scan above the minimum, sorted in r, keeping the best fit for duplicates
+            index.clear();
+            for (unsigned int i = 0, n = profile.size(); i < n; ++i) if (profile[i].r >= rBest) index.push_back(i);
+            std::sort(index.begin(), index.end(), [&profile](unsigned int a, unsigned int b) { return profile[a].r < profile[b].r || (profile[a].r == profile[b].r && profile[a].nll < profile[b].nll); });
+            xs.clear(); ys.clear();
+            for (unsigned int i : index) {
+                if (!xs.empty() && profile[i].r == xs.back()) continue;
+                xs.push_back(profile[i].r);
+                ys.push_back(sqrt(2*std::max(profile[i].nll - nll0, 0.)));
+            }
+            // next estimate of the crossing
+            double rEst; bool bracketed = false;
+            unsigned int k = 0;
+            while (k+1 < xs.size() && !(ys[k] < target && target <= ys[k+1])) ++k;
+            if (k+1 < xs.size()) {
+                bracketed = true;
+                rEst = invertMonotoneSpline(xs, ys, k, target);
+                double rTol = std::max(rRelAccuracy_*rEst, rAbsAccuracy_);
+                // the crossing is known well enough if it's bracketed tightly, or if the last fit moved it by less than the tolerance
+                if (xs[k+1]-xs[k] < rTol || fabs(rEst - rFitted) < rTol) { ret[iq] = rEst; break; }
+            } else if (!xs.empty() && ys.back() >= target) {
+                ret[iq] = xs.front(); break; // no crossing above the minimum
+            } else {
+                // extrapolate beyond the last point, linearly if there are two, or from the median if we don't know the slope
+                double slope = (xs.size() >= 2 ? (ys.back()-ys[xs.size()-2])/(xs.back()-xs[xs.size()-2]) : 0);
+                double slopeMedian = sqrt(2*medianThreshold)/std::max(median-rBest, rAbsAccuracy_);
+                if (slope <= 0) slope = slopeMedian;
+                rEst = xs.back() + (target - ys.back())/slope;
+                if (strictBounds_) {
+                    if (xs.back() >= r->getMax()) { ret[iq] = r->getMax(); break; }
+                    rEst = std::min(rEst, r->getMax());
+                } else {
+                    if (rEst > rMaxHard) break;
+                    if (rEst >= r->getMax()) r->setMax(rEst*1.1);
+                }
+            }
+            // profile at the estimate, starting from the closest point
+            unsigned int closest = index.front();
+            for (unsigned int i : index) if (fabs(profile[i].r - rEst) < fabs(profile[closest].r - rEst)) closest = i;
+            profile[closest].snap.writeTo(*params_);
+            r->setVal(rEst);
+            bool ok = true;
+            {
+                CloseCoutSentry sentry2(verbose < 3);
+                if (hasDiscreteParams_) ok = minim2.minimize(verbose-2);
+                else ok = minim2.improve(verbose-2);
+            }
+            ++nfits;
+            if (!ok && picky_) break;
+            double here = nll.getVal();
+            if (verbose > 1) CombineLogger::instance().log("AsymptoticLimits.cc",__LINE__,std::string(Form("At %s = %f:\tdelta(nll) = %.5f (%s)\n", r->GetName(), rEst, here-nll0, bracketed ? "interpolated" : "extrapolated")),__func__);
+            profile.emplace_back(rEst, here, *params_);
+            rFitted = rEst;
+            if (fabs(here - nll0 - thresholds[iq]) < 0.05*minim2.tolerance()) { ret[iq] = rEst; break; }
+        }
+        if (std::isnan(ret[iq]) && verbose > 1) CombineLogger::instance().log("AsymptoticLimits.cc",__LINE__,std::string(Form("[WARNING] search for crossing of %s at delta(nll) = %g failed", r->GetName(), thresholds[iq])),__func__);
+    }
+    r->setConstant(false);
+    if (verbose > 1) CombineLogger::instance().log("AsymptoticLimits.cc",__LINE__,std::string(Form("Found the expected limits with %d conditional fits after the median", nfits)),__func__);
+    return ret;
+}
+
 float AsymptoticLimits::calculateLimitFromGrid(RooRealVar *r , double quantile, double alpha){	
 	
 	int iq = 0;
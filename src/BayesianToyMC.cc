@@ -1,7 +1,18 @@
 #include <stdexcept>
 #include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <limits>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
 #include "../interface/BayesianToyMC.h"
 #include "RooRealVar.h"
+#include "RooCategory.h"
+#include "RooGaussian.h"
+#include "RooRandom.h"
 #include "RooArgSet.h"
 #include "RooUniform.h"
 #include "RooProdPdf.h"
@@ -12,6 +23,9 @@
 #include "RooStats/ModelConfig.h"
 #include "RooStats/RooStatsUtils.h"
 #include <Math/DistFuncMathCore.h>
+#include <Math/ProbFuncMathCore.h>
+#include <Math/QuasiRandom.h>
+#include <TString.h>
 
 #include "../interface/Combine.h"
 #include "../interface/CachingNLL.h"
@@ -24,6 +38,8 @@ std::string BayesianToyMC::integrationType_ = "toymc";
 unsigned int BayesianToyMC::tries_ = 1;
 float BayesianToyMC::hintSafetyFactor_ = 5.;
 std::vector<std::string> BayesianToyMC::twoPoints_;
+unsigned int BayesianToyMC::fork_ = 0;
+std::string BayesianToyMC::sampler_ = "random";
 
 BayesianToyMC::BayesianToyMC() :
     LimitAlgo("BayesianToyMC specific options")
@@ -36,7 +52,11 @@ BayesianToyMC::BayesianToyMC() :
                 boost::program_options::value<float>(&hintSafetyFactor_)->default_value(hintSafetyFactor_),
                 "Set range of integration equal to this number of times the hinted limit")
         ("twoPoints",
-                boost::program_options::value<std::vector<std::string> >(&twoPoints_)->multitoken(), "Compute BF comparing two points in parameter space");
+                boost::program_options::value<std::vector<std::string> >(&twoPoints_)->multitoken(), "Compute BF comparing two points in parameter space")
+        ("fork", boost::program_options::value<unsigned int>(&fork_)->default_value(fork_),
+                "Use this number of processes to run the tries when computing limits, or to evaluate the likelihood at the sampled points when computing Bayes factors (0 = no forking)")
+        ("sampler", boost::program_options::value<std::string>(&sampler_)->default_value(sampler_),
+                "Sampler used for the nuisance parameters with gaussian constraints when computing Bayes factors: 'random', or 'sobol' for a randomly shifted quasi-random Sobol sequence (up to 40 parameters)");
         ;
 }
 
@@ -49,6 +69,7 @@ void BayesianToyMC::applyOptions(const boost::program_options::variables_map &vm
     }
     if (!twoPoints_.empty() && twoPoints_.size() != 2) throw std::logic_error("twoPoints option requires exactly two points\n");
     if (!twoPoints_.empty() && !doSignificance_) throw std::logic_error("twoPoints option works with --significance\n"); 
+    if (sampler_ != "random" && sampler_ != "sobol") throw std::invalid_argument("BayesianToyMC: option --sampler must be 'random' or 'sobol'");
 }
 bool BayesianToyMC::run(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint) {
   if (doSignificance_) return runBayesFactor(w,mc_s,mc_b,data,limit,limitErr,hint);
@@ -71,36 +92,34 @@ bool BayesianToyMC::run(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::
     mc_s = mc_noNuis.get();
   }
   std::unique_ptr<RooAbsPdf> nuisancePdf;
+  if (integrationType_ == "toymc") {
+      nuisancePdf.reset(utils::makeNuisancePdf(*mc_s));
+      // turn off optimization of constraint terms in the NLL, otherwise
+      // it does not divide properly by the nuisance pdf
+      cacheutils::CachingSimNLL::forceUnoptimizedConstraints();
+  }
   for (;;) {
     limit = 0; limitErr = 0; bool rerun = false;
-    for (unsigned int i = 0; i < tries_; ++i) {
-        BayesianCalculator bcalc(data, *mc_s);
-        bcalc.SetLeftSideTailFraction(0);
-        bcalc.SetConfidenceLevel(cl); 
-        if (!integrationType_.empty()) bcalc.SetIntegrationType(integrationType_.c_str());
-        if (numIters_) bcalc.SetNumIters(numIters_);
-        if (integrationType_ == "toymc") {
-            if (nuisancePdf.get() == 0)  nuisancePdf.reset(utils::makeNuisancePdf(*mc_s));
-            bcalc.ForceNuisancePdf(*nuisancePdf);
-            // turn off optimization of constraint terms in the NLL, otherwise
-            // it does not divide properly by the nuisance pdf
-            cacheutils::CachingSimNLL::forceUnoptimizedConstraints();
-        }
-        // get the interval
-        std::unique_ptr<SimpleInterval> bcInterval(bcalc.GetInterval());
-        if (bcInterval.get() == 0) return false;
-        double lim = bcInterval->UpperLimit();
-        // check against bound
-        if (lim >= 0.5*r->getMax()) { 
-            std::cout << "Limit " << r->GetName() << " < " << lim << "; " << r->GetName() << " max < " << r->getMax() << std::endl;
-            if (r->getMax()/rMax > 20) return false;
-            r->setMax(r->getMax()*2); 
-            rerun = true; break;
+    for (unsigned int i = 0; i < tries_ && !rerun; ) {
+        unsigned int batch = std::min(std::max(fork_, 1u), tries_ - i);
+        std::vector<double> lims;
+        if (batch > 1) lims = evalWithFork(batch, [&](unsigned int) { return std::vector<double>(1, runTry(mc_s, data, nuisancePdf.get())); });
+        else lims.push_back(runTry(mc_s, data, nuisancePdf.get()));
+        for (double lim : lims) {
+            if (std::isnan(lim)) return false;
+            // check against bound
+            if (lim >= 0.5*r->getMax()) { 
+                std::cout << "Limit " << r->GetName() << " < " << lim << "; " << r->GetName() << " max < " << r->getMax() << std::endl;
+                if (r->getMax()/rMax > 20) return false;
+                r->setMax(r->getMax()*2); 
+                rerun = true; break;
+            }
+            // add to running sum(x) and sum(x2)
+            limit    += lim;
+            limitErr += lim*lim;
+            if (tries_ > 1 && verbose > 1) std::cout << " - limit from try " << i << ": " << lim << std::endl;
+            ++i;
         }
-        // add to running sum(x) and sum(x2)
-        limit    += lim;
-        limitErr += lim*lim;
-        if (tries_ > 1 && verbose > 1) std::cout << " - limit from try " << i << ": " << lim << std::endl;
     }
     if (rerun) continue;
     limit /= tries_; 
@@ -118,6 +137,19 @@ bool BayesianToyMC::run(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::
   return true;
 }
 
+double BayesianToyMC::runTry(RooStats::ModelConfig *mc_s, RooAbsData &data, RooAbsPdf *nuisancePdf) const {
+    BayesianCalculator bcalc(data, *mc_s);
+    bcalc.SetLeftSideTailFraction(0);
+    bcalc.SetConfidenceLevel(cl); 
+    if (!integrationType_.empty()) bcalc.SetIntegrationType(integrationType_.c_str());
+    if (numIters_) bcalc.SetNumIters(numIters_);
+    if (nuisancePdf) bcalc.ForceNuisancePdf(*nuisancePdf);
+    // get the interval
+    std::unique_ptr<SimpleInterval> bcInterval(bcalc.GetInterval());
+    if (bcInterval.get() == 0) return std::numeric_limits<double>::quiet_NaN();
+    return bcInterval->UpperLimit();
+}
+
 bool BayesianToyMC::runBayesFactor(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint) {
     std::pair<double,double> ppS, ppB;
     double offset = std::numeric_limits<double>::quiet_NaN();
@@ -178,8 +210,38 @@ std::pair<double,double> BayesianToyMC::priorPredictiveDistribution(RooStats::Mo
   // Set the point we're running at
   if (point != 0) params->assignValueOnly(*point);
 
+  // the parameters that change from one point to the next
+  RooArgList vars;
+  for (RooAbsArg *a : *params) {
+      if ((withSystematics && mc->GetNuisanceParameters() && mc->GetNuisanceParameters()->find(a->GetName())) ||
+          poiToGen.find(a->GetName()) || otherParams.find(a->GetName())) vars.add(*a);
+  }
+  unsigned int nvars = vars.getSize();
+
+  // with the sobol sampler, the nuisances with gaussian constraints are drawn by inverting their (truncated) cdf
+  struct GaussianNuisance { RooRealVar *var; const RooAbsReal *centre, *sigma; int index; };
+  std::vector<GaussianNuisance> gaussians;
+  if (sampler_ == "sobol" && nuisancePdf.get() != 0) {
+      for (RooAbsArg *c : static_cast<RooProdPdf &>(*nuisancePdf).pdfList()) {
+          RooGaussian *gaus = dynamic_cast<RooGaussian *>(c);
+          if (gaus == 0) continue;
+          const RooAbsReal *nuis = &gaus->getX(), *centre = &gaus->getMean();
+          if (!mc->GetNuisanceParameters()->find(nuis->GetName())) std::swap(nuis, centre);
+          int index = vars.index(nuis->GetName());
+          if (index == -1 || !mc->GetNuisanceParameters()->find(nuis->GetName())) continue;
+          if (gaussians.size() == 40) {
+              std::cout << "BayesianToyMC: the Sobol sequence is limited to 40 parameters, the others will be sampled randomly." << std::endl;
+              break;
+          }
+          gaussians.push_back(GaussianNuisance{static_cast<RooRealVar *>(&vars[index]), centre, &gaus->getSigma(), index});
+      }
+      if (verbose) std::cout << "Sampling " << gaussians.size() << " nuisances with a Sobol sequence." << std::endl;
+  }
+  std::unique_ptr<ROOT::Math::QuasiRandomSobol> sobol(gaussians.empty() ? nullptr : new ROOT::Math::QuasiRandomSobol(gaussians.size()));
+  std::vector<double> qrng(gaussians.size()), shift(gaussians.size());
+
   // start running
-  std::vector<double> results; double sum = 0;
+  std::vector<double> results, tryMeans; double sum = 0;
   for (unsigned int t = 0; t < tries_; ++t) {
       std::unique_ptr<RooDataSet> nuisanceValues, poiValues;
       if (withSystematics) nuisanceValues.reset(nuisancePdf->generate(*mc->GetNuisanceParameters(), numIters_));
@@ -187,12 +249,34 @@ std::pair<double,double> BayesianToyMC::priorPredictiveDistribution(RooStats::Mo
         if (mc->GetPriorPdf() == 0) throw std::logic_error(std::string("Missing prior in model: ")+ mc->GetName());
         poiValues.reset(mc->GetPriorPdf()->generate(poiToGen, numIters_));
       }
+      // a random shift of the sequence for each try, so that the tries are independent
+      for (double &x : shift) x = RooRandom::uniform();
+      // first sample all the points, then evaluate the likelihood at each of them
+      std::vector<double> points; points.reserve(numIters_ * nvars);
       for (int i = 0; i < numIters_; ++i) {
         if (nuisanceValues.get() != 0) *params = *nuisanceValues->get(i);
         if (poiValues.get() != 0) *params = *poiValues->get(i);
         if (otherParams.getSize()) RooStats::RandomizeCollection(otherParams);
-        if (verbose > 2) { std::cout << "\n\n==== POINT "<< t << ","<<i<<" ====" << std::endl; params->Print("V"); }
-        double nllVal = nll->getVal();
+        if (sobol.get()) {
+            sobol->Next(&qrng[0]);
+            for (unsigned int k = 0, nk = gaussians.size(); k < nk; ++k) {
+                const GaussianNuisance &g = gaussians[k];
+                double c = g.centre->getVal(), sigma = g.sigma->getVal();
+                double lo = ROOT::Math::normal_cdf((g.var->getMin()-c)/sigma), hi = ROOT::Math::normal_cdf((g.var->getMax()-c)/sigma);
+                double u = qrng[k] + shift[k]; if (u >= 1) u -= 1;
+                u = std::min(std::max(lo + u*(hi-lo), 1e-15), 1-1e-15);
+                g.var->setVal(c + sigma*ROOT::Math::normal_quantile(u, 1.0));
+            }
+        }
+        for (RooAbsArg *a : vars) {
+            RooCategory *cat = dynamic_cast<RooCategory *>(a);
+            points.push_back(cat ? cat->getCurrentIndex() : static_cast<RooAbsReal *>(a)->getVal());
+        }
+      }
+      std::vector<double> nllVals = evalNLL(*nll, vars, points, numIters_);
+      double tryMean = 0;
+      for (int i = 0; i < numIters_; ++i) {
+        double nllVal = nllVals[i];
         if (offset) { 
             if (std::isnan(*offset)) *offset = nllVal; 
             nllVal -= *offset; 
@@ -200,7 +284,9 @@ std::pair<double,double> BayesianToyMC::priorPredictiveDistribution(RooStats::Mo
         if (verbose > 1) std::cout << "nll[" << t << ","<<i<<"] = " << nllVal << ", p = " << std::exp(-nllVal) << std::endl;
         results.push_back(std::exp(-nllVal));
         sum += results.back();
+        tryMean += results.back()/numIters_;
       }
+      tryMeans.push_back(tryMean);
   }
   double n = results.size();
   sum /= n; 
@@ -211,6 +297,94 @@ std::pair<double,double> BayesianToyMC::priorPredictiveDistribution(RooStats::Mo
   }
   sum += sumd/numIters_; 
   double err = std::sqrt((sumd2/numIters_ - std::pow(sumd/numIters_,2))/numIters_);
+  if (sobol.get() && tries_ > 1) {
+      // the points of a quasi-random sequence are not independent, so use the spread of the (independent) tries
+      double var = 0;
+      for (double m : tryMeans) var += std::pow(m - sum, 2);
+      err = std::sqrt(var/((tries_-1)*tries_));
+  }
   return std::make_pair(sum,err);
 }
 
+std::vector<double> BayesianToyMC::evalNLL(RooAbsReal &nll, const RooArgList &vars, const std::vector<double> &points, unsigned int npoints) const {
+  unsigned int nvars = vars.getSize();
+  auto evalRange = [&](unsigned int begin, unsigned int end) {
+      std::vector<double> ret; ret.reserve(end - begin);
+      for (unsigned int i = begin; i < end; ++i) {
+          for (unsigned int j = 0; j < nvars; ++j) {
+              RooCategory *cat = dynamic_cast<RooCategory *>(&vars[j]);
+              if (cat) cat->setIndex(int(points[i*nvars+j]));
+              else static_cast<RooRealVar &>(vars[j]).setVal(points[i*nvars+j]);
+          }
+          if (verbose > 2) { std::cout << "\n\n==== POINT " << i << " ====" << std::endl; vars.Print("V"); }
+          ret.push_back(nll.getVal());
+      }
+      return ret;
+  };
+  if (fork_ <= 1 || npoints < 2*fork_) return evalRange(0, npoints);
+  unsigned int chunk = (npoints + fork_ - 1)/fork_;
+  return evalWithFork(fork_, [&](unsigned int ich) { return evalRange(std::min(ich*chunk, npoints), std::min((ich+1)*chunk, npoints)); });
+}
+
+std::vector<double> BayesianToyMC::evalWithFork(unsigned int nproc, const std::function<std::vector<double>(unsigned int)> &work) {
+  char tmpfile[999]; snprintf(tmpfile, 998, "%s/bayes-XXXXXX", P_tmpdir);
+  int fd = mkstemp(tmpfile); close(fd); unlink(tmpfile);
+
+  std::vector<UInt_t> newSeeds(nproc);
+  for (unsigned int ich = 0; ich < nproc; ++ich) newSeeds[ich] = RooRandom::integer(std::numeric_limits<UInt_t>::max()-1);
+  fflush(stdout); fflush(stderr);
+  std::vector<pid_t> pids;
+  for (unsigned int ich = 0; ich < nproc; ++ich) {
+      pid_t pid = fork();
+      if (pid == -1) throw std::runtime_error("BayesianToyMC: fork failed");
+      if (pid == 0) { // child: do the work, and pass the result back to the parent through a file, preceded by its size
+          RooRandom::randomGenerator()->SetSeed(newSeeds[ich]);
+          bool ok = false;
+          try {
+              std::vector<double> res = work(ich);
+              FILE *f = fopen(TString::Format("%s.%d", tmpfile, ich), "wb");
+              if (f) {
+                  std::uint64_t n = res.size();
+                  ok = fwrite(&n, sizeof(n), 1, f) == 1 && fwrite(res.data(), sizeof(double), res.size(), f) == res.size();
+                  ok = (fclose(f) == 0) && ok;
+              }
+          } catch (std::exception &ex) {
+              std::cerr << "BayesianToyMC: process " << ich << " failed: " << ex.what() << std::endl;
+          }
+          fflush(stdout); fflush(stderr);
+          _exit(ok ? 0 : 1); // don't run the destructors of the objects owned by the parent (e.g. the output file)
+      }
+      pids.push_back(pid);
+  }
+  std::vector<bool> exitedOk(nproc, false);
+  for (unsigned int ich = 0; ich < nproc; ++ich) {
+      int cstatus, ret;
+      do { ret = waitpid(pids[ich], &cstatus, 0); } while (ret == -1 && errno == EINTR);
+      if (ret == -1) throw std::runtime_error("Didn't wait for child");
+      exitedOk[ich] = WIFEXITED(cstatus) && WEXITSTATUS(cstatus) == 0;
+  }
+
+  std::vector<double> result;
+  std::string error;
+  for (unsigned int ich = 0; ich < nproc; ++ich) {
+      TString fname = TString::Format("%s.%d", tmpfile, ich);
+      FILE *f = fopen(fname.Data(), "rb");
+      if (f == 0) {
+          if (error.empty()) error = TString::Format("BayesianToyMC: process %u didn't leave its output", ich).Data();
+          continue;
+      }
+      std::uint64_t n = 0, nread = 0;
+      bool ok = fread(&n, sizeof(n), 1, f) == 1;
+      if (ok) {
+          double buff[1024]; size_t nbuff;
+          while ((nbuff = fread(buff, sizeof(double), 1024, f)) > 0) { result.insert(result.end(), buff, buff + nbuff); nread += nbuff; }
+          ok = (nread == n);
+      }
+      fclose(f);
+      unlink(fname.Data());
+      if (!exitedOk[ich] && error.empty()) error = TString::Format("BayesianToyMC: process %u failed", ich).Data();
+      else if (!ok && error.empty()) error = TString::Format("BayesianToyMC: the output of process %u is truncated", ich).Data();
+  }
+  if (!error.empty()) throw std::runtime_error(error);
+  return result;
+}
@@ -17,6 +17,8 @@
 
 #define HFVERBOSE 0
 
+bool CMSHistErrorPropagator::enable_full_bb_ = false;
+
 CMSHistErrorPropagator::CMSHistErrorPropagator() : initialized_(false) {}
 
 CMSHistErrorPropagator::CMSHistErrorPropagator(const char* name,
@@ -211,6 +213,22 @@ void CMSHistErrorPropagator::runBarlowBeeston() const {
   for (unsigned j = 0; j < n; ++j) {
     if (toterr_[bb_.use[j]] > 0.) bb_.push_res[j]->setVal(bb_.res[j]);
   }
+  if (!bbfull_.init) return;
+  for (unsigned r = 0; r < bbfull_.use.size(); ++r) {
+    const unsigned j = bbfull_.use[r];
+    const double w = cache_.GetWidth(j);
+    bbfull_.dat[r] = data_[j];
+    bbfull_.valsum[r] = valsum_[j] * w;
+    for (unsigned t = bbfull_.row[r]; t < bbfull_.row[r + 1]; ++t) {
+      const unsigned i = bbfull_.proc[t];
+      if (bbfull_.type[t] == FullBarlowBeeston::Gaussian) {
+        bbfull_.scale[t] = vfuncs_[i]->errors()[j] * coeffvals_[i] * w;
+      } else {
+        bbfull_.scale[t] = vfuncs_[i]->cache()[j] * coeffvals_[i] * w;
+      }
+    }
+  }
+  bbfull_.solve();
 }
 
 void CMSHistErrorPropagator::setAnalyticBarlowBeeston(bool flag) const {
@@ -228,6 +246,7 @@ void CMSHistErrorPropagator::setAnalyticBarlowBeeston(bool flag) const {
     bb_.gobs.clear();
     bb_.push_res.clear();
     bb_.init = false;
+    bbfull_.clear();
   }
   if (flag && data_.size()) {
     for (unsigned j = 0; j < bintypes_.size(); ++j) {
@@ -257,6 +276,12 @@ void CMSHistErrorPropagator::setAnalyticBarlowBeeston(bool flag) const {
     bb_.toterr.resize(n);
     bb_.res.resize(n);
     bb_.init = true;
+    if (enable_full_bb_) {
+      for (unsigned j = 0; j < bintypes_.size(); ++j) {
+        if (bintypes_[j][0] != 0 && bintypes_[j][0] != 1) bbfull_.addBin(j, bintypes_[j], vbinpars_[j]);
+      }
+      bbfull_.finalize();
+    }
   }
 }
 
@@ -443,6 +468,22 @@ void CMSHistErrorPropagator::applyErrorShifts(unsigned idx,
   }
 }
 
+CMSHistFunc::FlatTemplates CMSHistErrorPropagator::flatTemplates() const {
+  initialize();
+  CMSHistFunc::FlatTemplates out;
+  for (auto const* func : vfuncs_) func->appendFlatTemplates(out);
+  for (unsigned j = 0; j < bintypes_.size(); ++j) {
+    for (unsigned i = 0; i < bintypes_[j].size(); ++i) {
+      if (bintypes_[j][i] >= 1 && bintypes_[j][i] < 4) {
+        out.binParBin.push_back(j);
+        out.binParProc.push_back(i);
+        out.binParType.push_back(bintypes_[j][i]);
+      }
+    }
+  }
+  return out;
+}
+
 std::unique_ptr<RooArgSet> CMSHistErrorPropagator::getSentryArgs() const {
   // We can do this without initialising because we're going to hand over
   // the sentry directly
@@ -503,6 +544,10 @@ Double_t CMSHistErrorPropagator::analyticalIntegral(Int_t code,
   return 0;
 }
 
+void CMSHistErrorPropagator::EnableFullBarlowBeeston() {
+  enable_full_bb_ = true;
+}
+
 void CMSHistErrorPropagator::setData(RooAbsData const& data) const {
   updateCache(1);
   data_.clear();
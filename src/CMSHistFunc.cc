@@ -1,6 +1,7 @@
 #include "../interface/CMSHistFunc.h"
 #include "../interface/CMSHistFuncWrapper.h"
 #include "../interface/Accumulators.h"
+#include <stdexcept>
 #include <vector>
 #include <ostream>
 #include <memory>
@@ -1211,6 +1212,56 @@ CMSHistFuncWrapper const* CMSHistFunc::wrapper() const {
   return nullptr;
 }
 
+bool CMSHistFunc::hasOnlyVerticalMorphs() const {
+  return hmorphs_.getSize() == 0 && !rebin_ && external_morph_.getSize() == 0 && morph_strategy_ == 0;
+}
+
+void CMSHistFunc::appendFlatTemplates(FlatTemplates& out) const {
+  if (!hasOnlyVerticalMorphs()) {
+    throw std::runtime_error(std::string("CMSHistFunc ") + GetName() + ": only vertical morphing is supported here");
+  }
+  unsigned nb = cache_.size();
+  if (out.morphOffset.empty()) {
+    out.nBins = nb;
+    out.morphOffset.push_back(0);
+  } else if (out.nBins != int(nb)) {
+    throw std::runtime_error(std::string("CMSHistFunc ") + GetName() + ": binning differs from the other processes");
+  }
+  FastTemplate const& nominal = storage_[getIdx(0, 0, 0, 0)];
+  for (unsigned i = 0; i < nb; ++i) {
+    out.nominal.push_back(nominal[i]);
+    out.errors.push_back(binerrors_[i]);
+  }
+  out.logMorph.push_back(vtype_ == VerticalSetting::LogQuadLinear);
+  out.smoothRegion.push_back(vsmooth_par_);
+  for (int v = 1; v < vmorphs_.getSize() + 1; ++v) {
+    RooAbsArg* par = vmorphs_.at(v - 1);
+    int index = out.morphs.index(par);
+    if (index == -1) {
+      index = out.morphs.getSize();
+      out.morphs.add(*par);
+    }
+    out.morphIndex.push_back(index);
+    // same as the single point case of updateCache
+    FastTemplate lo = storage_[getIdx(0, 0, v, 0)];
+    FastTemplate hi = storage_[getIdx(0, 0, v, 1)];
+    if (vtype_ == VerticalSetting::QuadLinear) {
+      hi.Subtract(nominal);
+      lo.Subtract(nominal);
+    } else if (vtype_ == VerticalSetting::LogQuadLinear) {
+      hi.LogRatio(nominal);
+      lo.LogRatio(nominal);
+    }
+    FastTemplate sum = nominal, diff = nominal;
+    FastTemplate::SumDiff(hi, lo, sum, diff);
+    for (unsigned i = 0; i < nb; ++i) {
+      out.sum.push_back(sum[i]);
+      out.diff.push_back(diff[i]);
+    }
+  }
+  out.morphOffset.push_back(out.morphIndex.size());
+}
+
 RooAbsReal const& CMSHistFunc::getXVar() const {
   return x_.arg();
 }
@@ -1,9 +1,12 @@
 #include "../interface/CMSHistSum.h"
 #include "../interface/CMSHistFuncWrapper.h"
+#include <algorithm>
 #include <stdexcept>
 #include <vector>
 #include <ostream>
 #include <memory>
+#include <string_view>
+#include <unordered_map>
 #include "Math/ProbFuncMathCore.h"
 #include "Math/QuantFuncMathCore.h"
 #include "RooRealProxy.h"
@@ -18,6 +21,8 @@
 #define HFVERBOSE 0
 
 bool CMSHistSum::enable_fast_vertical_ = false;
+int CMSHistSum::full_update_period_ = 100;
+bool CMSHistSum::enable_full_bb_ = false;
 
 CMSHistSum::CMSHistSum() : initialized_(false), fast_mode_(0) {}
 
@@ -243,6 +248,12 @@ void CMSHistSum::initialize() const {
   scaledbinmods_.resize(n_procs_, std::vector<double>(nb, 0.));
   coeffvals_.resize(n_procs_, 0.);
 
+  setupMorphBlocks();
+  staged_.resize(n_procs_, cache_);
+  dirty_lo_.resize(n_procs_, 0);
+  dirty_hi_.resize(n_procs_, nb);
+  sums_valid_ = false;
+
   sentry_.addVars(morphpars_);
   sentry_.addVars(coeffpars_);
   binsentry_.addVars(binpars_);
@@ -259,23 +270,94 @@ void CMSHistSum::initialize() const {
   initialized_ = true;
 }
 
+void CMSHistSum::setupMorphBlocks() const {
+  unsigned nb = cache_.size();
+  // Map each vmorph to the processes and bins it affects. The normalisation
+  // of log-morphed processes is fixed, so there it affects all the bins.
+  morph_blocks_.assign(n_morphs_, std::vector<MorphBlock>());
+  for (int iv = 0; iv < n_morphs_; ++iv) {
+    for (int ip = 0; ip < n_procs_; ++ip) {
+      int code = vmorph_fields_[ip * n_morphs_ + iv];
+      if (code == -1) continue;
+      MorphBlock block{unsigned(ip), 0, nb};
+      if (vtype_[ip] != CMSHistFunc::VerticalSetting::LogQuadLinear) {
+        block.lo = nb;
+        block.hi = 0;
+        for (unsigned j = 0; j < nb; ++j) {
+          if (storage_[code][j] != 0. || storage_[code + 1][j] != 0.) {
+            block.lo = std::min(block.lo, j);
+            block.hi = j + 1;
+          }
+        }
+        if (block.lo >= block.hi) continue;
+      }
+      morph_blocks_[iv].push_back(block);
+    }
+  }
+}
+
 void CMSHistSum::updateMorphs() const {
   // set up pointers ahead of time for quick loop
   std::vector<CMSExternalMorph*> process_morphs(compcache_.size(), nullptr);
-  // if any external morphs are dirty, disable fast_mode_
+  // if any external morphs are dirty, disable fast_mode_ and rebuild everything
+  bool rebuild_all = vertical_prev_vals_.size() == 0;
   for(size_t i=0; i < external_morph_indices_.size(); ++i) {
     auto* morph = static_cast<CMSExternalMorph*>(external_morphs_.at(i));
     process_morphs[external_morph_indices_[i]] = morph;
     if (morph->hasChanged()) {
       fast_mode_ = 0;
+      rebuild_all = true;
     }
   }
-  // If we're not in fast mode, need to reset all the compcache_
   #if HFVERBOSE > 0
   std::cout << "fast_mode_ = " << fast_mode_ << std::endl;
   #endif
-  for (unsigned ip = 0; ip < compcache_.size(); ++ip) {
-    if (fast_mode_ == 0) {
+  int n_morphs = vmorphpars_.size();
+
+  if (vertical_prev_vals_.size() == 0) {
+    vertical_prev_vals_.resize(n_morphs);
+  }
+  std::vector<double> xvals(n_morphs);
+  for (int iv = 0; iv < n_morphs; ++iv) xvals[iv] = vmorphpars_[iv]->getVal();
+
+  if (fast_mode_ == 1) {
+    // Apply the change of each vmorph that moved since the last eval to the
+    // processes it affects
+    for (int iv = 0; iv < n_morphs; ++iv) {
+      double x = xvals[iv];
+      if (x == vertical_prev_vals_[iv]) {
+        #if HFVERBOSE > 0
+        std::cout << "Skipping " << vmorphpars_[iv]->GetName() << ", prev = now = " << x << std::endl;
+        #endif
+        continue;
+      }
+      #if HFVERBOSE > 0
+      std::cout << "Updating " << vmorphpars_[iv]->GetName() << ", prev =  " << vertical_prev_vals_[iv] << ", now = " << x << std::endl;
+      #endif
+      double xold = vertical_prev_vals_[iv];
+      for (auto const& block : morph_blocks_[iv]) {
+        int code = vmorph_fields_[block.proc * n_morphs + iv];
+        compcache_[block.proc].DiffMeld(storage_[code + 1], storage_[code + 0], 0.5*x, smoothStepFunc(x, block.proc), 0.5*xold, smoothStepFunc(xold, block.proc));
+        markDirty(block.proc, block.lo, block.hi);
+      }
+    }
+  } else {
+    // Rebuild from the nominal template only the processes affected by the
+    // vmorphs that moved since the last eval
+    std::vector<bool> rebuild(compcache_.size(), rebuild_all);
+    if (rebuild_all) {
+      for (unsigned ip = 0; ip < compcache_.size(); ++ip) markDirty(ip, 0, valsum_.size());
+    } else {
+      for (int iv = 0; iv < n_morphs; ++iv) {
+        if (xvals[iv] == vertical_prev_vals_[iv]) continue;
+        for (auto const& block : morph_blocks_[iv]) {
+          rebuild[block.proc] = true;
+          markDirty(block.proc, block.lo, block.hi);
+        }
+      }
+    }
+    for (unsigned ip = 0; ip < compcache_.size(); ++ip) {
+      if (!rebuild[ip]) continue;
       compcache_[ip].CopyValues(storage_[process_fields_[ip]]);
       if ( process_morphs[ip] != nullptr ) {
         auto& extdata = process_morphs[ip]->batchGetBinValues();
@@ -286,47 +368,30 @@ void CMSHistSum::updateMorphs() const {
       if (vtype_[ip] == CMSHistFunc::VerticalSetting::LogQuadLinear) {
         compcache_[ip].Log();
       }
+      for (int iv = 0; iv < n_morphs; ++iv) {
+        int code = vmorph_fields_[ip * n_morphs + iv];
+        if (code == -1) continue;
+        compcache_[ip].Meld(storage_[code + 1], storage_[code + 0], 0.5*xvals[iv], smoothStepFunc(xvals[iv], ip));
+      }
     }
   }
-  int n_morphs = vmorphpars_.size();
-
-  if (vertical_prev_vals_.size() == 0) {
-    vertical_prev_vals_.resize(n_morphs);
-  }
-  // Loop through vmorphs
-  for (unsigned iv = 0; iv < vmorphpars_.size(); ++iv) {
-    double x = vmorphpars_[iv]->getVal();
-    if (fast_mode_ == 1 && (x == vertical_prev_vals_[iv])) {
-      #if HFVERBOSE > 0
-      std::cout << "Skipping " << vmorphpars_[iv]->GetName() << ", prev = now = " << x << std::endl;
-      #endif
-      continue;
-    }
-    #if HFVERBOSE > 0
-    if (fast_mode_ == 1) {
-      std::cout << "Updating " << vmorphpars_[iv]->GetName() << ", prev =  " << vertical_prev_vals_[iv] << ", now = " << x << std::endl;
-    }
-    #endif
+  vertical_prev_vals_ = xvals;
 
+  if (enable_fast_vertical_) fast_mode_ = 1;
+}
 
-    // If in fast made, check if the value has changed since the last eval,
-    // and if it hasn't, skip it
+inline void CMSHistSum::markDirty(unsigned ip, unsigned lo, unsigned hi) const {
+  dirty_lo_[ip] = std::min(dirty_lo_[ip], lo);
+  dirty_hi_[ip] = std::max(dirty_hi_[ip], hi);
+}
 
-    // For each vmorph need to know the list of processes we apply to
-    for (unsigned ip = 0; ip < compcache_.size(); ++ip) {
-      int code = vmorph_fields_[ip * n_morphs + iv];
-      if (code == -1) continue;
-      if (fast_mode_ == 1) {
-        double xold = vertical_prev_vals_[iv];
-        compcache_[ip].DiffMeld(storage_[code + 1], storage_[code + 0], 0.5*x, smoothStepFunc(x, ip), 0.5*xold, smoothStepFunc(xold, ip));
-      } else {
-        compcache_[ip].Meld(storage_[code + 1], storage_[code + 0], 0.5*x, smoothStepFunc(x, ip));
-      }
-    }
-    vertical_prev_vals_[iv] = x;
+void CMSHistSum::stageProcess(unsigned ip) const {
+  staged_[ip] = compcache_[ip];
+  if (vtype_[ip] == CMSHistFunc::VerticalSetting::LogQuadLinear) {
+    staged_[ip].Exp();
+    staged_[ip].Scale(storage_[process_fields_[ip]].Integral() / staged_[ip].Integral());
   }
-
-  if (enable_fast_vertical_) fast_mode_ = 1;
+  staged_[ip].CropUnderflows();
 }
 
 inline double CMSHistSum::smoothStepFunc(double x, int const& ip) const {
@@ -347,27 +412,55 @@ void CMSHistSum::updateCache() const {
       std::cout << "Calling updateMorphs\n";
     #endif
     updateMorphs();
-    for (unsigned i = 0; i < vcoeffpars_.size(); ++i) {
-      // vfuncs_[i]->updateCache();
-      coeffvals_[i] = vcoeffpars_[i]->getVal();
-    }
-    #if HFVERBOSE > 0
-      std::cout << "Updated coeffs\n";
-    #endif
+    unsigned nb = valsum_.size();
+    if (sums_valid_ && n_incremental_ + 1 < full_update_period_) {
+      // Patch the sums with the processes that changed since the last update
+      bool errors_changed = false;
+      for (unsigned i = 0; i < vcoeffpars_.size(); ++i) {
+        double coeff = vcoeffpars_[i]->getVal();
+        double old_coeff = coeffvals_[i];
+        unsigned lo = dirty_lo_[i], hi = dirty_hi_[i];
+        if (coeff != old_coeff) {
+          lo = 0;
+          hi = nb;
+          double delta = coeff * coeff - old_coeff * old_coeff;
+          for (unsigned j = 0; j < nb; ++j) err2sum_[j] += delta * binerrors_[i][j] * binerrors_[i][j];
+          errors_changed = true;
+        }
+        if (lo >= hi) continue;
+        for (unsigned j = lo; j < hi; ++j) valsum_[j] -= old_coeff * staged_[i][j];
+        if (dirty_lo_[i] < dirty_hi_[i]) stageProcess(i);
+        for (unsigned j = lo; j < hi; ++j) valsum_[j] += coeff * staged_[i][j];
+        coeffvals_[i] = coeff;
+        dirty_lo_[i] = nb;
+        dirty_hi_[i] = 0;
+      }
+      if (errors_changed) {
+        for (unsigned j = 0; j < nb; ++j) toterr_[j] = std::sqrt(std::max(err2sum_[j], 0.));
+      }
+      ++n_incremental_;
+    } else {
+      for (unsigned i = 0; i < vcoeffpars_.size(); ++i) {
+        // vfuncs_[i]->updateCache();
+        coeffvals_[i] = vcoeffpars_[i]->getVal();
+      }
+      #if HFVERBOSE > 0
+        std::cout << "Updated coeffs\n";
+      #endif
 
-    valsum_.Clear();
-    std::fill(err2sum_.begin(), err2sum_.end(), 0.);
-    for (unsigned i = 0; i < vcoeffpars_.size(); ++i) {
-      staging_ = compcache_[i];
-      if (vtype_[i] == CMSHistFunc::VerticalSetting::LogQuadLinear) {
-        staging_.Exp();
-        staging_.Scale(storage_[process_fields_[i]].Integral() / staging_.Integral());
+      valsum_.Clear();
+      std::fill(err2sum_.begin(), err2sum_.end(), 0.);
+      for (unsigned i = 0; i < vcoeffpars_.size(); ++i) {
+        stageProcess(i);
+        dirty_lo_[i] = nb;
+        dirty_hi_[i] = 0;
+        vectorized::mul_add(nb, coeffvals_[i], &(staged_[i][0]), &valsum_[0]);
+        vectorized::mul_add_sqr(nb, coeffvals_[i], &(binerrors_[i][0]), &err2sum_[0]);
       }
-      staging_.CropUnderflows();
-      vectorized::mul_add(valsum_.size(), coeffvals_[i], &(staging_[0]), &valsum_[0]);
-      vectorized::mul_add_sqr(valsum_.size(), coeffvals_[i], &(binerrors_[i][0]), &err2sum_[0]);
+      vectorized::sqrt(nb, &err2sum_[0], &toterr_[0]);
+      sums_valid_ = true;
+      n_incremental_ = 0;
     }
-    vectorized::sqrt(valsum_.size(), &err2sum_[0], &toterr_[0]);
     cache_ = valsum_;
     #if HFVERBOSE > 0
       std::cout << "Updated cache\n";
@@ -434,6 +527,22 @@ void CMSHistSum::runBarlowBeeston() const {
   for (unsigned j = 0; j < n; ++j) {
     if (toterr_[bb_.use[j]] > 0.) bb_.push_res[j]->setVal(bb_.res[j]);
   }
+  if (!bbfull_.init) return;
+  for (unsigned r = 0; r < bbfull_.use.size(); ++r) {
+    const unsigned j = bbfull_.use[r];
+    const double w = cache_.GetWidth(j);
+    bbfull_.dat[r] = data_[j];
+    bbfull_.valsum[r] = valsum_[j] * w;
+    for (unsigned t = bbfull_.row[r]; t < bbfull_.row[r + 1]; ++t) {
+      const unsigned i = bbfull_.proc[t];
+      if (bbfull_.type[t] == FullBarlowBeeston::Gaussian) {
+        bbfull_.scale[t] = binerrors_[i][j] * coeffvals_[i] * w;
+      } else {
+        bbfull_.scale[t] = compcache_[i][j] * coeffvals_[i] * w;
+      }
+    }
+  }
+  bbfull_.solve();
 }
 
 void CMSHistSum::setAnalyticBarlowBeeston(bool flag) const {
@@ -451,6 +560,7 @@ void CMSHistSum::setAnalyticBarlowBeeston(bool flag) const {
     bb_.gobs.clear();
     bb_.push_res.clear();
     bb_.init = false;
+    bbfull_.clear();
   }
   if (flag && data_.size()) {
     for (unsigned j = 0; j < bintypes_.size(); ++j) {
@@ -480,6 +590,12 @@ void CMSHistSum::setAnalyticBarlowBeeston(bool flag) const {
     bb_.toterr.resize(n);
     bb_.res.resize(n);
     bb_.init = true;
+    if (enable_full_bb_) {
+      for (unsigned j = 0; j < bintypes_.size(); ++j) {
+        if (bintypes_[j][0] != 0 && bintypes_[j][0] != 1) bbfull_.addBin(j, bintypes_[j], vbinpars_[j]);
+      }
+      bbfull_.finalize();
+    }
   }
 }
 
@@ -654,6 +770,110 @@ RooArgList * CMSHistSum::setupBinPars(double poissonThreshold) {
   return res;
 }
 
+unsigned CMSHistSum::compactStorage() {
+  auto hashOf = [](FastTemplate const& t) -> std::size_t {
+    if (t.size() == 0) return 0;
+    return std::hash<std::string_view>()(std::string_view(reinterpret_cast<const char*>(&t[0]), t.size() * sizeof(FastTemplate::T)));
+  };
+  auto same = [](FastTemplate const& a, FastTemplate const& b) {
+    if (a.size() != b.size()) return false;
+    for (unsigned j = 0; j < a.size(); ++j) {
+      if (a[j] != b[j]) return false;
+    }
+    return true;
+  };
+  auto isZero = [](FastTemplate const& t) {
+    for (unsigned j = 0; j < t.size(); ++j) {
+      if (t[j] != 0.) return false;
+    }
+    return true;
+  };
+
+  // Copy the n templates at storage_[idx] to compact, unless the same ones
+  // are already there, and return their new position. The nominal templates
+  // and the sum/diff pairs are looked up separately, as a pair has to stay
+  // contiguous
+  std::vector<FastTemplate> compact;
+  auto store = [&](std::unordered_multimap<std::size_t, int>& seen, int idx, unsigned n) {
+    std::size_t h = 0;
+    for (unsigned k = 0; k < n; ++k) h = h * 31 + hashOf(storage_[idx + k]);
+    auto range = seen.equal_range(h);
+    for (auto it = range.first; it != range.second; ++it) {
+      bool found = true;
+      for (unsigned k = 0; k < n && found; ++k) found = same(compact[it->second + k], storage_[idx + k]);
+      if (found) return it->second;
+    }
+    int pos = compact.size();
+    for (unsigned k = 0; k < n; ++k) compact.push_back(storage_[idx + k]);
+    seen.emplace(h, pos);
+    return pos;
+  };
+
+  std::unordered_multimap<std::size_t, int> nominals, pairs;
+  for (int ip = 0; ip < n_procs_; ++ip) {
+    process_fields_[ip] = store(nominals, process_fields_[ip], 1);
+    for (int iv = 0; iv < n_morphs_; ++iv) {
+      int& code = morphField(ip, iv);
+      if (code == -1) continue;
+      if (isZero(storage_[code]) && isZero(storage_[code + 1])) {
+        code = -1;
+      } else {
+        code = store(pairs, code, 2);
+      }
+    }
+  }
+
+  unsigned removed = storage_.size() - compact.size();
+  storage_.swap(compact);
+  // rebuild the morph blocks, and everything from the new storage_ at the next evaluation
+  if (initialized_) setupMorphBlocks();
+  vertical_prev_vals_.clear();
+  fast_mode_ = 0;
+  sums_valid_ = false;
+  return removed;
+}
+
+CMSHistFunc::FlatTemplates CMSHistSum::flatTemplates() const {
+  if (!external_morph_indices_.empty()) {
+    throw std::runtime_error(std::string("CMSHistSum ") + GetName() + ": external morphs are not supported here");
+  }
+  initialize();
+  CMSHistFunc::FlatTemplates out;
+  unsigned nb = cache_.size();
+  out.nBins = nb;
+  out.morphs.add(morphpars_);
+  out.morphOffset.push_back(0);
+  for (int ip = 0; ip < n_procs_; ++ip) {
+    FastTemplate const& nominal = storage_[process_fields_[ip]];
+    for (unsigned j = 0; j < nb; ++j) {
+      out.nominal.push_back(nominal[j]);
+      out.errors.push_back(binerrors_[ip][j]);
+    }
+    out.logMorph.push_back(vtype_[ip] == CMSHistFunc::VerticalSetting::LogQuadLinear);
+    out.smoothRegion.push_back(vsmooth_par_[ip]);
+    for (int iv = 0; iv < n_morphs_; ++iv) {
+      int code = vmorph_fields_[ip * n_morphs_ + iv];
+      if (code == -1) continue;
+      // storage_ already holds the sum and the diff, see the constructor
+      out.morphIndex.push_back(iv);
+      for (unsigned j = 0; j < nb; ++j) {
+        out.sum.push_back(storage_[code + 0][j]);
+        out.diff.push_back(storage_[code + 1][j]);
+      }
+    }
+    out.morphOffset.push_back(out.morphIndex.size());
+  }
+  for (unsigned j = 0; j < bintypes_.size(); ++j) {
+    for (unsigned i = 0; i < bintypes_[j].size(); ++i) {
+      if (bintypes_[j][i] >= 1 && bintypes_[j][i] < 4) {
+        out.binParBin.push_back(j);
+        out.binParProc.push_back(i);
+        out.binParType.push_back(bintypes_[j][i]);
+      }
+    }
+  }
+  return out;
+}
 
 std::unique_ptr<RooArgSet> CMSHistSum::getSentryArgs() const {
   // We can do this without initialising because we're going to hand over
@@ -758,6 +978,14 @@ void CMSHistSum::EnableFastVertical() {
   enable_fast_vertical_ = true;
 }
 
+void CMSHistSum::SetFullUpdatePeriod(int period) {
+  full_update_period_ = period;
+}
+
+void CMSHistSum::EnableFullBarlowBeeston() {
+  enable_full_bb_ = true;
+}
+
 void CMSHistSum::injectExternalMorph(int idx, CMSExternalMorph& morph) {
   if ( idx >= coeffpars_.getSize() ) {
     throw std::runtime_error("Process index larger than number of processes in CMSHistSum");
@@ -2,8 +2,10 @@
 #include "../interface/utils.h"
 #include "../interface/FnTimer.h"
 #include <stdexcept>
+#include <limits>
 #include <RooCategory.h>
 #include <RooDataSet.h>
+#include <RooDataHist.h>
 #include <RooProduct.h>
 #include <RooStats/RooStatsUtils.h>
 
@@ -23,6 +25,7 @@
 #include "../interface/RooCheapProduct.h"
 #include "../interface/Accumulators.h"
 #include "../interface/CombineLogger.h"
+#include "../interface/ProfiledNLLStore.h"
 #include "vectorized.h"
 
 namespace cacheutils {
@@ -522,6 +525,7 @@ cacheutils::CachingAddNLL::setup_()
         coeffs_.reserve(npdf);
         pdfs_.reserve(npdf);
         integrals_.reserve(npdf);
+        utils::DependencyCache deps(*obs);
         for (int i = 0; i < npdf; ++i) {
             RooAbsReal * coeff = dynamic_cast<RooAbsReal*>(sumpdf->coefList().at(i));
             RooAbsReal * funci = dynamic_cast<RooAbsReal*>(sumpdf->funcList().at(i));
@@ -530,7 +534,7 @@ cacheutils::CachingAddNLL::setup_()
             RooProduct *prodi = 0;
             if (tryfactor && ((prodi = dynamic_cast<RooProduct *>(funci)) != 0)) {
                 RooArgList newcoeffs(*coeff), newfuncs; 
-                utils::factorizeFunc(*obs, *funci, newfuncs, newcoeffs);
+                utils::factorizeFunc(deps, *funci, newfuncs, newcoeffs);
 
                 if (newcoeffs.getSize() > 1) {
                     if (cheapprod) prods_.emplace_back(new RooCheapProduct((funci->GetName()+std::string("_coeff_cachingnll")).c_str(),"",newcoeffs,runtimedef::get("ADDNLL_ROOREALSUM_PRUNECONST")));
@@ -616,12 +620,12 @@ cacheutils::CachingAddNLL::evaluate() const
         if (basicIntegrals_) {
             double integral = binWidths_.size() > 1 ?
                                     vectorized::dot_product(pdfvals.size(), &pdfvals[0], &binWidths_[0]) :
-                                    binWidths_.front() * sumDefault<double>(pdfvals);
+                                    binWidths_.front() * sumPairwise(pdfvals);
             if (basicIntegrals_ == 1) {
                 double refintegral = integrals_[i]->getVal();
                 if (refintegral > 0) {
                     if (std::abs((integral - refintegral)/refintegral) > 1e-5) {
-                        CombineLogger::instance().log("CachingNLL.cc",__LINE__,std::string(Form("integrals don't match: %+10.6f  %+10.6f  %10.7f %s\n", refintegral, integral, refintegral ? std::abs((integral - refintegral)/refintegral) : 0,  pdfs_[i]->pdf()->GetName()  )),__func__);
+                        COMBINE_LOG("CachingNLL.cc",__LINE__,__func__,"integrals don't match: %+10.6f  %+10.6f  %10.7f %s\n", refintegral, integral, refintegral ? std::abs((integral - refintegral)/refintegral) : 0,  pdfs_[i]->pdf()->GetName());
                         allBasicIntegralsOk = false;
                         basicIntegrals_ = 0; // don't waste time on this anymore
                     }
@@ -694,7 +698,7 @@ cacheutils::CachingAddNLL::evaluate() const
     double expectedEvents = (isRooRealSum_ && !expEventsNoNorm ? pdf_->getNorm(data_->get()) : sumCoeff);
     if (expectedEvents <= 0) {
         //std::cout << "WARNING: underflow in total event yield for " << pdf_->GetName() << ", expected yield = " << expectedEvents << " (observed: " << sumWeights_ << ")" << std::endl;
-    	CombineLogger::instance().log("CachingNLL.cc",__LINE__,std::string(Form("underflow (expected events <=0) in total event yield for %s, expected yield = %g (observed: %g)",pdf_->GetName(), expectedEvents, sumWeights_)),__func__);
+    	COMBINE_LOG("CachingNLL.cc",__LINE__,__func__,"underflow (expected events <=0) in total event yield for %s, expected yield = %g (observed: %g)",pdf_->GetName(), expectedEvents, sumWeights_);
         if (!CachingSimNLL::noDeepLEE_) logEvalError("Expected number of events is negative"); else CachingSimNLL::hasError_ = true;
         expectedEvents = 1e-6;
     }
@@ -804,6 +808,25 @@ void cacheutils::CachingAddNLL::propagateData() {
   }
 }
 
+double cacheutils::CachingAddNLL::saturatedNLL() const {
+    // same binning as the RooHistPdf that GoodnessOfFit would otherwise build out of the data
+    RooDataHist hist("", "", *data_->get(), *data_);
+    double ret = runtimedef::get("REMOVE_CONSTANT_ZERO_POINT") ? 0 : constantZeroPoint_;
+    DefaultAccumulator<double> sum = 0;
+    for (int i = 0, n = data_->numEntries(); i < n; ++i) {
+        const RooArgSet *entry = data_->get(i);
+        double w = data_->weight();
+        if (w == 0) continue;
+        hist.get(*entry);
+        double nbin = hist.weight(), vol = hist.binVolume();
+        if (nbin <= 0 || vol <= 0) return std::numeric_limits<double>::quiet_NaN();
+        sum += w * std::log(nbin / (sumWeights_ * vol));
+    }
+    // the extended term vanishes, as the expected events are equal to the observed ones
+    ret -= sum.sum();
+    return ret + zeroPoint_;
+}
+
 void cacheutils::CachingAddNLL::setAnalyticBarlowBeeston(bool flag) {
   for (auto* hist : histErrorPropagators_) {
     hist->setAnalyticBarlowBeeston(flag);
@@ -933,7 +956,7 @@ cacheutils::CachingSimNLL::setup_()
             }
             //std::cout << "Constraint pdf: " << constraints.at(i)->GetName() << std::endl;
             std::unique_ptr<RooArgSet> params(pdfi->getParameters(*dataOriginal_));
-            params_.add(*params, false);
+            constraintParams_.add(*params, /*silent=*/true);
         }
         if (verb) {
 	  for (const auto & p : constraintsByType) {
@@ -959,6 +982,12 @@ cacheutils::CachingSimNLL::setup_()
                 std::cout << "ConstrainPdfGroup with " << cg.size() << " constraints." << std::endl;
             }
         }
+        // the fast gaussian and poisson constraints evaluated together, unless grouped or disabled by the user
+        constraintBlock_.reset();
+        if (constrainPdfGroups_.empty() && !runtimedef::get("SIMNLL_NO_CONSTRAINT_BLOCK") && (!constrainPdfsFast_.empty() || !constrainPdfsFastPoisson_.empty())) {
+            constraintBlock_.reset(new ConstraintBlock(constrainPdfsFast_, constrainPdfsFastPoisson_));
+            if (verb) std::cout << "Fast constraints evaluated together, from " << constraintBlock_->inputs().getSize() << " inputs." << std::endl;
+        }
     } else {
         std::cerr << "PDF didn't factorize!" << std::endl;
         std::cout << "Parameters: " << std::endl;
@@ -973,6 +1002,10 @@ cacheutils::CachingSimNLL::setup_()
 
     std::unique_ptr<RooAbsCategoryLValue> catClone((RooAbsCategoryLValue*) simpdf->indexCat().Clone());
     pdfs_.resize(catClone->numBins(NULL), 0);
+    channelPdfs_.assign(pdfs_.size(), 0);
+    channelLabels_.assign(pdfs_.size(), std::string());
+    channelLive_.assign(pdfs_.size(), false);
+    maskedEvals_.assign(pdfs_.size(), 0);
     //dataSets_.reset(dataOriginal_->split(pdfOriginal_->indexCat(), true));
     datasets_.resize(pdfs_.size(), 0);
     splitWithWeights(*dataOriginal_, simpdf->indexCat(), true);
@@ -986,10 +1019,9 @@ cacheutils::CachingSimNLL::setup_()
             //RooAbsData *data = (RooAbsData *) dataSets_->FindObject(catClone->getLabel());
             //std::cout << "   bin " << ib << " (label " << catClone->getLabel() << ") has pdf " << pdf->GetName() << " of type " << pdf->ClassName() << " and " << (data ? data->numEntries() : -1) << " dataset entries" << std::endl;
             if (data == 0) { throw std::logic_error("Error: no data"); }
-            bool includeZeroWeights = (runtimedef::get("ADDNLL_ROOREALSUM_BASICINT") && runtimedef::get("ADDNLL_ROOREALSUM_KEEPZEROS") && (dynamic_cast<RooRealSumPdf*>(pdf)!=0));
-            pdfs_[ib] = new CachingAddNLL(catClone->getLabel(), "", pdf, data, includeZeroWeights);
-            params_.add(pdfs_[ib]->params(), /*silent=*/true); 
-            catParams_.add(pdfs_[ib]->catParams(), /*silent=*/true); 
+            // the NLL of the channel is built on the first evaluation in which it is not masked (see syncChannels_)
+            channelPdfs_[ib] = pdf;
+            channelLabels_[ib] = catClone->getLabel();
             ++nchannels;
         } else { 
             pdfs_[ib] = 0; 
@@ -997,12 +1029,89 @@ cacheutils::CachingSimNLL::setup_()
         }
     }   
 
+    // all the log-normal factors of the process normalizations computed together, unless disabled by the user
+    normEngine_.reset();
+    if (!runtimedef::get("SIMNLL_NO_NORM_ENGINE")) {
+        normEngine_.reset(new ProcessNormalizationEngine(*pdfOriginal_));
+        if (normEngine_->nProcesses() == 0) normEngine_.reset();
+        else if (verb) std::cout << "Normalizations of " << normEngine_->nProcesses() << " processes computed together, from " << normEngine_->nuisances().getSize() << " nuisances." << std::endl;
+    }
      
     if (verb) {
             CombineLogger::instance().log("CachingNLL.cc",__LINE__,std::string(Form(
 	    "SimNLL created with %d channels, %d generic constraints, %d fast gaussian constraints, %d fast poisson constraints, %d fast group constraints.",
 	    (int)nchannels, (int)constrainPdfs_.size(),(int)constrainPdfsFast_.size(),(int)constrainPdfsFastPoisson_.size(),(int)constrainPdfGroups_.size())),__func__);
     }
+    params_.add(constraintParams_, /*silent=*/true);
+    setValueDirty();
+}
+
+void
+cacheutils::CachingSimNLL::buildChannel_(std::size_t idx)
+{
+    RooAbsPdf *pdf = channelPdfs_[idx];
+    bool includeZeroWeights = (runtimedef::get("ADDNLL_ROOREALSUM_BASICINT") && runtimedef::get("ADDNLL_ROOREALSUM_KEEPZEROS") && (dynamic_cast<RooRealSumPdf*>(pdf)!=0));
+    CachingAddNLL *nll = new CachingAddNLL(channelLabels_[idx].c_str(), "", pdf, datasets_[idx], includeZeroWeights);
+    // bring it to the same state as the channels built before
+    if (constantZeroPointCleared_) nll->clearConstantZeroPoint();
+    if (zeroPointSet_) nll->setZeroPoint();
+    if (analyticBarlowBeeston_) nll->setAnalyticBarlowBeeston(true);
+    if (aliasedPar_ && aliases_[idx] && !nll->params().contains(*aliasedPar_)) aliases_[idx] = 0;
+    pdfs_[idx] = nll;
+}
+
+void
+cacheutils::CachingSimNLL::syncChannels_()
+{
+    static unsigned keepMaskedEvals = runtimedef::get("SIMNLL_KEEP_MASKED");
+    bool changed = false;
+    for (std::size_t idx = 0; idx < pdfs_.size(); ++idx) {
+        if (channelPdfs_[idx] == 0) continue;
+        bool live = !isChannelMasked_(idx);
+        if (live) {
+            maskedEvals_[idx] = 0;
+            // the channels disabled by setMaskNonDiscreteChannels are built when they are enabled again
+            if (pdfs_[idx] == 0 && (internalMasks_.empty() || internalMasks_[idx])) {
+                buildChannel_(idx);
+                changed = true;
+            }
+        } else if (pdfs_[idx] && ++maskedEvals_[idx] > keepMaskedEvals) {
+            releaseChannel_(pdfs_[idx]);
+            pdfs_[idx] = 0;
+            changed = true;
+        }
+        if (live != channelLive_[idx]) {
+            channelLive_[idx] = live;
+            changed = true;
+        }
+    }
+    if (changed) updateParameters_();
+}
+
+void
+cacheutils::CachingSimNLL::updateParameters_()
+{
+    // the parameters of the constraints, and those of the channels not masked by channelMasks_
+    params_.removeAll();
+    catParams_.removeAll();
+    activeParameters_.removeAll();
+    activeCatParameters_.removeAll();
+    params_.add(constraintParams_, /*silent=*/true);
+    for (std::size_t idx = 0; idx < pdfs_.size(); ++idx) {
+        if (pdfs_[idx] == 0 || !channelLive_[idx]) continue;
+        params_.add(pdfs_[idx]->params(), /*silent=*/true);
+        catParams_.add(pdfs_[idx]->catParams(), /*silent=*/true);
+        bool active = !internalMasks_.empty() && internalMasks_[idx];
+        if (active) {
+            activeParameters_.add(pdfs_[idx]->params(), /*silent=*/true);
+            activeCatParameters_.add(pdfs_[idx]->catParams(), /*silent=*/true);
+        }
+        if (aliasedPar_ && aliases_[idx]) {
+            params_.add(*aliases_[idx], /*silent=*/true);
+            if (active) activeParameters_.add(*aliases_[idx], /*silent=*/true);
+        }
+    }
+    resetAliasCache_();
     setValueDirty();
 }
 
@@ -1018,6 +1127,9 @@ cacheutils::CachingSimNLL::evaluate() const
     PerfCounter::add("CachingSimNLL::evaluate called");
 #endif
 
+    const_cast<CachingSimNLL&>(*this).syncChannels_();
+    double aliasedParVal = aliasedPar_ ? aliasedPar_->getVal() : 0;
+
     // The very first thing we do before any evaluation: run the analytical
     // minimization of Barlow-Beeston nuisance parameters.
     for (size_t i = 0; i < pdfs_.size(); ++i) {
@@ -1025,11 +1137,18 @@ cacheutils::CachingSimNLL::evaluate() const
         continue;
       if (!channelMasks_.empty() && channelMasks_[i]->getVal() != 0.)
         continue;
+      if (aliasedPar_ && aliasSentries_[i]) {
+        // with aliases, a channel whose own value of par and other parameters did not change keeps its last NLL
+        if (aliasCacheGood_(i, aliasedParVal)) continue;
+        aliasVals_[i] = std::numeric_limits<double>::quiet_NaN();
+        applyAlias_(i, aliasedParVal);
+      }
       pdfs_[i]->runAnalyticBarlowBeeston();
     }
 
     static bool gentleNegativePenalty_ = runtimedef::get("GENTLE_LEE");
-    DefaultAccumulator<double> ret = 0;
+    // the channels are summed with a fixed reduction tree, the masked ones contributing zero
+    channelVals_.assign(pdfs_.size(), 0.);
     for (std::size_t idx = 0; idx < pdfs_.size(); ++idx) {
         if (pdfs_[idx]) {
             if (!channelMasks_.empty() && channelMasks_[idx]->getVal() != 0.) {
@@ -1041,19 +1160,33 @@ cacheutils::CachingSimNLL::evaluate() const
             if (!internalMasks_.empty() && !internalMasks_[idx]) {
                 continue;
             }
+            bool aliased = aliasedPar_ && aliasSentries_[idx];
+            if (aliased) {
+                if (aliasCacheGood_(idx, aliasedParVal)) {
+                    channelVals_[idx] = aliasNLLs_[idx];
+                    continue;
+                }
+                applyAlias_(idx, aliasedParVal);
+            }
             double nllval = pdfs_[idx]->getVal();
             // what sanity check could I put here?
-            ret += nllval;
+            channelVals_[idx] = nllval;
+            if (aliased) {
+                aliasNLLs_[idx] = nllval;
+                aliasVals_[idx] = aliasedPar_->getVal();
+                aliasSentries_[idx]->reset();
+            }
         }
     }
+    NeumaierAccumulator<double> ret = sumPairwise(channelVals_);
     if (!constrainPdfs_.empty() || !constrainPdfsFast_.empty() || !constrainPdfsFastPoisson_.empty() || !constrainPdfGroups_.empty()) {
-        DefaultAccumulator<double> ret2 = 0;
+        NeumaierAccumulator<double> ret2 = 0;
         /// ============= GENERIC CONSTRAINTS  =========
         for (std::size_t i = 0; i < constrainPdfs_.size(); ++i) {
             double pdfval = constrainPdfs_[i]->getVal(nuis_);
             if (!std::isnormal(pdfval) || pdfval <= 0) {
                 //std::cout << "WARNING: underflow constraint pdf " << constrainPdfs_[i]->GetName() << ", value = " << pdfval << std::endl;
-    		    CombineLogger::instance().log("CachingNLL.cc",__LINE__,std::string(Form("underflow (pdf evaluates to <=0) of constraint pdf %s, value = %g ",constrainPdfs_[i]->GetName(), pdfval)),__func__);
+    		    COMBINE_LOG("CachingNLL.cc",__LINE__,__func__,"underflow (pdf evaluates to <=0) of constraint pdf %s, value = %g ",constrainPdfs_[i]->GetName(), pdfval);
                 if (gentleNegativePenalty_) { ret += 25; continue; }
                 if (!noDeepLEE_) logEvalError((std::string("Constraint pdf ")+constrainPdfs_[i]->GetName()+" evaluated to zero, negative or error").c_str());
                 pdfval = 1e-9;
@@ -1064,6 +1197,9 @@ cacheutils::CachingSimNLL::evaluate() const
             for (const SimpleConstraintGroup & g : constrainPdfGroups_) {
                 ret2 += g.getVal();
             }
+        } else if (constraintBlock_) {
+            /// ============= FAST GAUSSIAN AND POISSON CONSTRAINTS, TOGETHER  =========
+            ret2 += constraintBlock_->logVal();
         } else {
             /// ============= FAST GAUSSIAN CONSTRAINTS  =========
             for (std::size_t i = 0; i < constrainPdfsFast_.size(); ++i) {
@@ -1077,6 +1213,11 @@ cacheutils::CachingSimNLL::evaluate() const
         ret -= ret2.sum();
     }
     ret += (maskingOffset_ - maskingOffsetZero_);
+    if (aliasedPar_ && aliasedPar_->getVal() != aliasedParVal) {
+        // put back the original value; this is not a real change, so we don't want to be dirty because of it
+        aliasedPar_->setVal(aliasedParVal);
+        clearValueDirty();
+    }
 #ifdef TRACE_NLL_EVALS
     static unsigned long _trace_ = 0; _trace_++;
     if (_trace_ % 10 == 0)  { putchar('.'); fflush(stdout); }
@@ -1086,10 +1227,39 @@ cacheutils::CachingSimNLL::evaluate() const
     return ret.sum();
 }
 
+double
+cacheutils::CachingSimNLL::saturatedNLL(std::vector<double> *channelDiffs) const
+{
+    if (!canComputeSaturatedNLL()) return std::numeric_limits<double>::quiet_NaN();
+    if (channelDiffs) channelDiffs->assign(pdfs_.size(), 0.);
+    // start from the NLL of the model, and replace each term by the saturated one
+    // (masking offsets and constant zero points are the same for both, and cancel out)
+    DefaultAccumulator<double> ret = getVal();
+    for (std::size_t idx = 0; idx < pdfs_.size(); ++idx) {
+        if (pdfs_[idx] == 0) continue;
+        if (!channelMasks_.empty() && channelMasks_[idx]->getVal() != 0.) continue;
+        if (!internalMasks_.empty() && !internalMasks_[idx]) continue;
+        double diff = pdfs_[idx]->getVal() - pdfs_[idx]->saturatedNLL();
+        if (!std::isfinite(diff)) return std::numeric_limits<double>::quiet_NaN();
+        if (channelDiffs) (*channelDiffs)[idx] = diff;
+        ret -= diff;
+    }
+    // the constraints are the only terms of the saturated model that depend on the nuisance parameters,
+    // so they're at their maximum: log(gaussian) = 0 in the normalization of getLogValFast, and mean = x for the poissons
+    for (std::size_t i = 0; i < constrainPdfsFast_.size(); ++i) {
+        ret += constrainPdfsFast_[i]->getLogValFast();
+    }
+    for (std::size_t i = 0; i < constrainPdfsFastPoisson_.size(); ++i) {
+        ret -= constrainPdfsFastPoisson_[i]->getLogValMax() - constrainPdfsFastPoisson_[i]->getLogValFast();
+    }
+    return ret.sum();
+}
+
 bool
 cacheutils::CachingSimNLL::setData(RooAbsData &data, bool cloneData)
 {
     dataOriginal_ = &data;
+    dataHashValid_ = false;
     //std::cout << "combined data has " << data.numEntries() << " dataset entries (sumw " << data.sumEntries() << ", weighted " << data.isWeighted() << ")" << std::endl;
     //utils::printRAD(&data);
     //dataSets_.reset(dataOriginal_->split(pdfOriginal_->indexCat(), true));
@@ -1108,9 +1278,19 @@ cacheutils::CachingSimNLL::setData(RooAbsData &data, bool cloneData)
         //             " and " << (data ? data->numEntries() : -1) << " dataset entries (sumw " << data->sumEntries() << ", weighted " << data->isWeighted() << ")" << std::endl;
         canll->setData(*data);
     }
+    resetAliasCache_();
     return true;
 }
 
+std::uint64_t cacheutils::CachingSimNLL::dataHash() const
+{
+    if (!dataHashValid_) {
+        dataHash_ = ProfiledNLLStore::hashData(*dataOriginal_);
+        dataHashValid_ = true;
+    }
+    return dataHash_;
+}
+
 void cacheutils::CachingSimNLL::splitWithWeights(const RooAbsData &data, const RooAbsCategory& splitCat, Bool_t createEmptyDataSets) {
     RooCategory *cat = dynamic_cast<RooCategory *>(data.get()->find(splitCat.GetName()));
     if (cat == 0) throw std::logic_error("Error: no category");
@@ -1157,6 +1337,7 @@ void cacheutils::CachingSimNLL::splitWithWeights(const RooAbsData &data, const R
 }
 
 void cacheutils::CachingSimNLL::setZeroPoint() {
+    zeroPointSet_ = true;
     for (auto& pdf : pdfs_) {
         if (pdf) pdf->setZeroPoint();
     }
@@ -1173,11 +1354,14 @@ void cacheutils::CachingSimNLL::setZeroPoint() {
     for (SimpleConstraintGroup & g : constrainPdfGroups_) {
         g.setZeroPoint();
     }
+    if (constraintBlock_) constraintBlock_->setZeroPoint();
     maskingOffsetZero_ = maskingOffset_;
+    resetAliasCache_();
     setValueDirty();
 }
 
 void cacheutils::CachingSimNLL::clearZeroPoint() {
+    zeroPointSet_ = false;
     for (auto& pdf : pdfs_) {
         if (pdf) pdf->clearZeroPoint();
     }
@@ -1185,14 +1369,18 @@ void cacheutils::CachingSimNLL::clearZeroPoint() {
     std::fill(constrainZeroPointsFast_.begin(), constrainZeroPointsFast_.end(), 0.0);
     std::fill(constrainZeroPointsFastPoisson_.begin(), constrainZeroPointsFastPoisson_.end(), 0.0);
     for (SimpleConstraintGroup & g : constrainPdfGroups_) g.clearZeroPoint();
+    if (constraintBlock_) constraintBlock_->clearZeroPoint();
     maskingOffsetZero_ = 0;
+    resetAliasCache_();
     setValueDirty();
 }
 
 void cacheutils::CachingSimNLL::clearConstantZeroPoint() {
+    constantZeroPointCleared_ = true;
     for (auto const& it : pdfs_) {
         if (it) it->clearConstantZeroPoint();
     }
+    resetAliasCache_();
     setValueDirty();
 }
 
@@ -1208,6 +1396,60 @@ void cacheutils::CachingSimNLL::setChannelMasks(const RooArgList &args) {
         vars.push_back(var);
     }
     channelMasks_ = vars;
+    syncChannels_();
+}
+
+void cacheutils::CachingSimNLL::setParameterAliases(RooRealVar &par, const std::vector<RooRealVar *> &aliases) {
+    clearParameterAliases();
+    if (aliases.size() != pdfs_.size()) throw std::invalid_argument("CachingSimNLL::setParameterAliases: number of aliases does not match the number of channels");
+    aliasedPar_ = &par;
+    aliases_ = aliases;
+    // the aliases of the channels not built yet are checked when they are built
+    for (std::size_t idx = 0; idx < pdfs_.size(); ++idx) {
+        if (pdfs_[idx] == 0 || aliases_[idx] == 0) continue;
+        if (!pdfs_[idx]->params().contains(par)) aliases_[idx] = 0;
+    }
+    updateParameters_();
+}
+
+void cacheutils::CachingSimNLL::clearParameterAliases() {
+    if (aliasedPar_ == 0) return;
+    aliasedPar_ = 0;
+    aliases_.clear();
+    updateParameters_();
+}
+
+bool cacheutils::CachingSimNLL::aliasCacheGood_(std::size_t idx, double parVal) const {
+    return aliasSentries_[idx] && aliasVals_[idx] == aliasValue_(idx, parVal) && aliasSentries_[idx]->good();
+}
+
+void cacheutils::CachingSimNLL::applyAlias_(std::size_t idx, double parVal) const {
+    double val = aliasValue_(idx, parVal);
+    if (aliasedPar_->getVal() != val) aliasedPar_->setVal(val);
+}
+
+void cacheutils::CachingSimNLL::resetAliasCache_() {
+    aliasSentries_.clear();
+    aliasVals_.clear();
+    aliasNLLs_.clear();
+    if (aliasedPar_ == 0) return;
+    aliasSentries_.resize(pdfs_.size());
+    aliasVals_.assign(pdfs_.size(), std::numeric_limits<double>::quiet_NaN());
+    aliasNLLs_.assign(pdfs_.size(), 0.);
+    for (std::size_t idx = 0; idx < pdfs_.size(); ++idx) {
+        if (pdfs_[idx] == 0 || !pdfs_[idx]->params().contains(*aliasedPar_)) continue;
+        // par itself is left out, since it is moved back and forth between the channels at each evaluation
+        RooArgSet others(pdfs_[idx]->params());
+        others.remove(*aliasedPar_, /*silent=*/true, /*matchByNameOnly=*/true);
+        others.add(pdfs_[idx]->catParams(), /*silent=*/true);
+        aliasSentries_[idx].reset(new SimpleCacheSentry(others));
+    }
+}
+
+void cacheutils::CachingSimNLL::releaseChannel_(CachingAddNLL *nll) {
+    // the histogram pdfs can be shared with other NLLs, so leave them with the analytic Barlow-Beeston off
+    nll->setAnalyticBarlowBeeston(false);
+    delete nll;
 }
 
 void cacheutils::CachingSimNLL::setAnalyticBarlowBeeston(bool flag) {
@@ -1218,15 +1460,18 @@ void cacheutils::CachingSimNLL::setAnalyticBarlowBeeston(bool flag) {
         printf(">> Disabling analytic minimisation of bin-wise statistical uncertainty parameters\n");
       }
     */
+    analyticBarlowBeeston_ = flag;
     for (int ib = 0, nb = pdfs_.size(); ib < nb; ++ib) {
+        if (pdfs_[ib] == 0) continue;
         // If channel is masked we must always make sure analytic minimisation is off
-        if (!channelMasks_.empty() && channelMasks_[ib]->getVal() != 0.) {
+        if (isChannelMasked_(ib)) {
             pdfs_[ib]->setAnalyticBarlowBeeston(false);
         } else {
             pdfs_[ib]->setAnalyticBarlowBeeston(flag);
 
         }
     }
+    resetAliasCache_();
 }
 
 // ROOT 6.26 changed the signature of getParameters to avoid heap allocation,
@@ -1236,6 +1481,7 @@ void cacheutils::CachingSimNLL::setAnalyticBarlowBeeston(bool flag) {
 RooArgSet* 
 cacheutils::CachingSimNLL::getParameters(const RooArgSet* depList, Bool_t stripDisconnected) const 
 {
+    const_cast<CachingSimNLL&>(*this).syncChannels_();
     RooArgSet *ret;
     if (internalMasks_.empty()) {
         ret = new RooArgSet(params_); 
@@ -1251,6 +1497,7 @@ bool cacheutils::CachingSimNLL::getParameters(const RooArgSet* depList,
                                               RooArgSet& outputSet,
                                               bool stripDisconnected) const
 {
+    const_cast<CachingSimNLL&>(*this).syncChannels_();
     if (internalMasks_.empty()) {
         outputSet.add(params_);
         outputSet.add(catParams_);
@@ -1265,25 +1512,28 @@ bool cacheutils::CachingSimNLL::getParameters(const RooArgSet* depList,
 void cacheutils::CachingSimNLL::setMaskNonDiscreteChannels(bool mask) {
     double nllBefore = evaluate();
     internalMasks_.clear(); // reset
-    activeParameters_.removeAll(); 
-    activeCatParameters_.removeAll();
+    syncChannels_(); // build the channels that were only disabled by the previous masks
     if (mask) {
         internalMasks_.resize(pdfs_.size(), false);
         for (std::size_t idx = 0; idx < pdfs_.size(); ++idx) {
-            if (!pdfs_[idx]) continue;
-            for (RooAbsArg *P : pdfs_[idx]->catParams()) {
+            if (!channelPdfs_[idx]) continue;
+            // the channels masked by channelMasks_ are not built, so take the categories from their pdf:
+            // they must be built and evaluated if they are unmasked later
+            std::unique_ptr<RooArgSet> unbuiltParams;
+            if (!pdfs_[idx]) unbuiltParams.reset(channelPdfs_[idx]->getParameters(*datasets_[idx]));
+            const RooAbsCollection &params = pdfs_[idx] ? static_cast<const RooAbsCollection &>(pdfs_[idx]->catParams()) : *unbuiltParams;
+            for (RooAbsArg *P : params) {
                 RooCategory *cat = dynamic_cast<RooCategory *>(P);
                 if (!cat) continue;
                 if (cat && !cat->isConstant()) {
                     internalMasks_[idx] = true; 
-                    activeParameters_.add(pdfs_[idx]->params(), /*silent=*/true); 
-                    activeCatParameters_.add(pdfs_[idx]->catParams(), /*silent=*/true); 
-                    CombineLogger::instance().log("CachingNLL.cc",__LINE__,std::string(Form("Enabling channel %s that depends on non-constant category %s",pdfs_[idx]->GetName(), cat->GetName())),__func__);
+                    CombineLogger::instance().log("CachingNLL.cc",__LINE__,std::string(Form("Enabling channel %s that depends on non-constant category %s",channelLabels_[idx].c_str(), cat->GetName())),__func__);
                     break;
                 }
             }
         }
     }
+    updateParameters_();
     double nllAfter = evaluate();
     maskingOffset_ += (nllBefore - nllAfter);
     //printf("CachingSimNLL: setMaskNonDiscreteChannels(%d): nll before %.12g, nll after %.12g (diff %.12g), new maskingOffset %.12g, check = %.12g\n",
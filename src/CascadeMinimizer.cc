@@ -5,16 +5,20 @@
 #include "../interface/utils.h"
 #include "../interface/ProfilingTools.h"
 #include "../interface/CombineLogger.h"
+#include "../interface/ProfiledNLLStore.h"
 
 #include <Math/MinimizerOptions.h>
 #include <Math/IOptions.h>
 #include <RooCategory.h>
+#include <RooRealVar.h>
 #include <RooNumIntConfig.h>
 #include <TStopwatch.h>
 #include <RooStats/RooStatsUtils.h>
 
+#include <cstdint>
 #include <iomanip>
 #include <memory>
+#include <stdexcept>
 
 boost::program_options::options_description CascadeMinimizer::options_("Cascade Minimizer options");
 std::vector<CascadeMinimizer::Algo> CascadeMinimizer::fallbacks_;
@@ -44,6 +48,79 @@ std::map<std::string,std::vector<std::string> > const CascadeMinimizer::minimize
 ,{"GSLMultiMin"  ,{"ConjugateFR", "ConjugatePR", "BFGS", "BFGS2", "SteepestDescent"}}
 };
 
+namespace {
+    /// Result of a minimization of a CachingSimNLL looked up in the ProfiledNLLStore, if one is open, and saved to it afterwards.
+    /// Only the outermost minimization is looked up, not the ones that it does internally.
+    class StoredFit {
+        public:
+            StoredFit(RooAbsReal &nll) ;
+            ~StoredFit() { if (store_) --depth_; }
+            /// the stored result can be used instead of doing the fit
+            bool skip() const { return found_ && store_->mode() == ProfiledNLLStore::SkipFit; }
+            bool outcome() const { return entry_.status == 0; }
+            void save(bool outcome) ;
+        private:
+            static int depth_;
+            RooAbsReal &nll_;
+            ProfiledNLLStore *store_ = nullptr;
+            RooArgList floating_;
+            std::uint64_t key_ = 0;
+            bool found_ = false;
+            ProfiledNLLStore::Entry entry_;
+    };
+
+    int StoredFit::depth_ = 0;
+
+    StoredFit::StoredFit(RooAbsReal &nll) :
+        nll_(nll)
+    {
+        ProfiledNLLStore *store = ProfiledNLLStore::instance();
+        cacheutils::CachingSimNLL *simnll = dynamic_cast<cacheutils::CachingSimNLL *>(&nll);
+        if (store == nullptr || simnll == nullptr || simnll->data() == nullptr || depth_ > 0) return;
+        store_ = store; ++depth_;
+        ProfiledNLLStore::Hasher hasher;
+        hasher.add(store->context()).add(simnll->dataHash());
+        hasher.add(ROOT::Math::MinimizerOptions::DefaultMinimizerType()).add(ROOT::Math::MinimizerOptions::DefaultMinimizerAlgo());
+        hasher.add(ROOT::Math::MinimizerOptions::DefaultTolerance()).add(std::uint64_t(ROOT::Math::MinimizerOptions::DefaultStrategy()));
+        // the floating parameters and their ranges, and the values of the constant ones
+        std::unique_ptr<RooArgSet> params(nll.getParameters((const RooArgSet *)nullptr));
+        for (RooAbsArg *arg : *params) {
+            RooCategory *cat = dynamic_cast<RooCategory *>(arg);
+            RooRealVar *var = dynamic_cast<RooRealVar *>(arg);
+            if (cat == nullptr && var == nullptr) continue;
+            hasher.add(std::string(arg->GetName())).add(std::uint64_t(arg->isConstant()));
+            if (!arg->isConstant()) {
+                floating_.add(*arg);
+                if (var) hasher.add(var->getMin()).add(var->getMax());
+            } else {
+                hasher.add(cat ? double(cat->getCurrentIndex()) : var->getVal());
+            }
+        }
+        key_ = hasher.value();
+        found_ = store->lookup(key_, entry_) && entry_.values.size() == std::size_t(floating_.getSize());
+        if (!found_) return;
+        for (int i = 0, n = floating_.getSize(); i < n; ++i) {
+            if (RooCategory *cat = dynamic_cast<RooCategory *>(floating_.at(i))) cat->setIndex(int(entry_.values[i]));
+            else static_cast<RooRealVar *>(floating_.at(i))->setVal(entry_.values[i]);
+        }
+    }
+
+    void StoredFit::save(bool outcome)
+    {
+        if (store_ == nullptr) return;
+        ProfiledNLLStore::Entry entry;
+        entry.nll = nll_.getVal();
+        entry.status = outcome ? 0 : 1;
+        // don't add a record if the fit didn't improve on the stored one
+        if (found_ && entry_.status <= entry.status && entry.nll > entry_.nll - 1e-4) return;
+        for (RooAbsArg *arg : floating_) {
+            if (RooCategory *cat = dynamic_cast<RooCategory *>(arg)) entry.values.push_back(cat->getCurrentIndex());
+            else entry.values.push_back(static_cast<RooRealVar *>(arg)->getVal());
+        }
+        store_->save(key_, entry);
+    }
+}
+
 CascadeMinimizer::CascadeMinimizer(RooAbsReal &nll, Mode mode, RooRealVar *poi) :
     nll_(nll),
     mode_(mode),
@@ -104,6 +181,8 @@ void CascadeMinimizer::setAutoMax(const RooArgSet *pois)
 
 bool CascadeMinimizer::improve(int verbose, bool cascade, bool forceResetMinimizer) 
 {
+    StoredFit stored(nll_);
+    if (stored.skip()) return stored.outcome();
     cacheutils::CachingSimNLL *simnllbb = dynamic_cast<cacheutils::CachingSimNLL *>(&nll_);
     if (simnllbb && !runtimedef::get(std::string("MINIMIZER_no_analytic"))) {
       simnllbb->setAnalyticBarlowBeeston(true);
@@ -167,6 +246,7 @@ bool CascadeMinimizer::improve(int verbose, bool cascade, bool forceResetMinimiz
     if (simnllbb && !runtimedef::get(std::string("MINIMIZER_no_analytic"))) {
       simnllbb->setAnalyticBarlowBeeston(false);
     }
+    stored.save(outcome);
     return outcome;
 }
 
@@ -412,6 +492,9 @@ bool CascadeMinimizer::minimize(int verbose, bool cascade)
         RooMsgService::instance().setGlobalKillBelow(RooFit::FATAL);
     }
 
+    StoredFit stored(nll_);
+    if (stored.skip()) return stored.outcome();
+
     freezeDiscParams(true); // We should do anyway this since there can also be some indeces which are frozen 
 
     bool doMultipleMini = (CascadeMinimizerGlobalConfigs::O().pdfCategories.getSize()>0);
@@ -511,6 +594,7 @@ bool CascadeMinimizer::minimize(int verbose, bool cascade)
       CombineLogger::instance().log("CascadeMinimizer.cc",__LINE__,"[WARNING] After fit, some parameters are found at the boundary (within ~1sigma)",__func__);
     }
     freezeDiscParams(false);
+    stored.save(ret);
     return ret;
 }
 
@@ -745,6 +829,8 @@ void CascadeMinimizer::initOptions()
 	("cminDefaultMinimizerStrategy",boost::program_options::value<int>(&strategy_)->default_value(strategy_), "Set the default minimizer (initial) strategy")
         ("cminRunAllDiscreteCombinations",  "Run all combinations for discrete nuisances")
         ("cminDiscreteMinTol", boost::program_options::value<double>(&discreteMinTol_)->default_value(discreteMinTol_), "Tolerance on min NLL for discrete combination iterations")
+        ("cminProfileStore", boost::program_options::value<std::string>(), "Store the results of the fits in this file, and reuse the ones already in it for fits of the same workspace and dataset at the same values of the constant parameters (POIs, frozen nuisances, global observables), also from other jobs")
+        ("cminProfileStoreMode", boost::program_options::value<std::string>()->default_value("warm"), "How to use the results found in --cminProfileStore: 'warm' to start the fit from them, 'skip' to use them without fitting (only for methods that use just the NLL and parameter values, not the covariance matrix)")
         ("cminM2StorageLevel", boost::program_options::value<int>(&minuit2StorageLevel_)->default_value(minuit2StorageLevel_), "Storage level for minuit2 (0 = don't store intermediate covariances, 1 = store them)")
         //("cminNuisancePruning", boost::program_options::value<float>(&nuisancePruningThreshold_)->default_value(nuisancePruningThreshold_), "if non-zero, discard constrained nuisances whose effect on the NLL when changing by 0.2*range is less than the absolute value of the threshold; if threshold is negative, repeat afterwards the fit with these floating")
 
@@ -782,6 +868,12 @@ void CascadeMinimizer::applyOptions(const boost::program_options::variables_map
     setZeroPoint_  = vm.count("cminSetZeroPoint");
     runShortCombinations = !(vm.count("cminRunAllDiscreteCombinations"));
 
+    if (vm.count("cminProfileStore") && !ProfiledNLLStore::instance()) {
+        std::string mode = vm["cminProfileStoreMode"].as<std::string>();
+        if (mode != "warm" && mode != "skip") throw std::invalid_argument("CascadeMinimizer: --cminProfileStoreMode must be 'warm' or 'skip'");
+        ProfiledNLLStore::open(vm["cminProfileStore"].as<std::string>(), mode == "skip" ? ProfiledNLLStore::SkipFit : ProfiledNLLStore::WarmStart);
+    }
+
     // check default minimizer type/algo if they are set and make sense
     if (vm.count("cminDefaultMinimizerAlgo")){
       if (! checkAlgoInType(defaultMinimizerType_,defaultMinimizerAlgo_)) {
@@ -68,15 +68,13 @@ bool ChannelCompatibilityCheck::runSpecific(RooWorkspace *w, RooStats::ModelConf
 
   RooAbsCategoryLValue *cat = (RooAbsCategoryLValue *) sim->indexCat().Clone();
   int nbins = cat->numBins((const char *)0);
-  TString satname = TString::Format("%s_freeform", sim->GetName());
-  std::unique_ptr<RooSimultaneous> newsim((typeid(*sim) == typeid(RooSimultaneousOpt)) ? new RooSimultaneousOpt(satname, "", *cat) : new RooSimultaneous(satname, "", *cat)); 
   std::map<std::string,std::string> rs;
+  std::vector<RooRealVar *> aliases(nbins, nullptr);
   RooArgList minosVars, minosOneVar; if (runMinos_) minosOneVar.add(*r);
   for (int ic = 0, nc = nbins; ic < nc; ++ic) {
       cat->setBin(ic);
       RooAbsPdf *pdfi = sim->getPdf(cat->getLabel());
       if (pdfi == 0) continue;
-      RooCustomizer customizer(*pdfi, "freeform");
       std::string label = nameForLabel(cat->getLabel());
       TString riName = TString::Format("_ChannelCompatibilityCheck_%s_%s", r->GetName(), label.c_str());
       rs.insert(std::pair<std::string,std::string>(label, riName.Data()));
@@ -85,8 +83,7 @@ bool ChannelCompatibilityCheck::runSpecific(RooWorkspace *w, RooStats::ModelConf
       if (w->var(riName) == 0) {
         w->factory(TString::Format("%s[%g,%g]", riName.Data(), range.first, range.second));
       }
-      customizer.replaceArg(*r, *w->var(riName));
-      newsim->addPdf((RooAbsPdf&)*customizer.build(), cat->getLabel());
+      aliases[ic] = w->var(riName);
       if (runMinos_ && !minosVars.find(riName)) minosVars.add(*w->var(riName));
   }
 
@@ -97,11 +94,39 @@ bool ChannelCompatibilityCheck::runSpecific(RooWorkspace *w, RooStats::ModelConf
     static_cast<cacheutils::CachingSimNLL*>(nll.get())->clearConstantZeroPoint();
   }
   double nll_nominal   = nll->getVal();
-  std::unique_ptr<RooFitResult> result_freeform(doFit(*newsim, data, minosVars,   constCmdArg, runMinos_));
-  if (dynamic_cast<cacheutils::CachingSimNLL*>(nll.get())) {
-    static_cast<cacheutils::CachingSimNLL*>(nll.get())->clearConstantZeroPoint();
+  std::unique_ptr<RooFitResult> result_freeform;
+  double nll_freeform = 0;
+  // start the alternate fit from the nominal one
+  for (RooRealVar *ri : aliases) {
+      if (ri && !ri->isConstant()) ri->setVal(std::max(ri->getMin(), std::min(ri->getMax(), r->getVal())));
+  }
+  cacheutils::CachingSimNLL *simnll = dynamic_cast<cacheutils::CachingSimNLL*>(nll.get());
+  if (simnll && !forceRecreateNLL_) {
+      // same NLL as for the nominal fit, with the POI of each group of channels redirected to its own parameter
+      bool rWasConstant = r->isConstant();
+      r->setConstant(true);
+      simnll->setParameterAliases(*r, aliases);
+      result_freeform.reset(doFit(*sim, data, minosVars, constCmdArg, runMinos_, /*ndim=*/1, /*reuseNLL=*/true));
+      nll_freeform = nll->getVal();
+      simnll->clearParameterAliases();
+      r->setConstant(rWasConstant);
+  } else {
+      TString satname = TString::Format("%s_freeform", sim->GetName());
+      std::unique_ptr<RooSimultaneous> newsim((typeid(*sim) == typeid(RooSimultaneousOpt)) ? new RooSimultaneousOpt(satname, "", *cat) : new RooSimultaneous(satname, "", *cat)); 
+      for (int ic = 0, nc = nbins; ic < nc; ++ic) {
+          cat->setBin(ic);
+          RooAbsPdf *pdfi = sim->getPdf(cat->getLabel());
+          if (pdfi == 0) continue;
+          RooCustomizer customizer(*pdfi, "freeform");
+          customizer.replaceArg(*r, *aliases[ic]);
+          newsim->addPdf((RooAbsPdf&)*customizer.build(), cat->getLabel());
+      }
+      result_freeform.reset(doFit(*newsim, data, minosVars,   constCmdArg, runMinos_));
+      if (dynamic_cast<cacheutils::CachingSimNLL*>(nll.get())) {
+        static_cast<cacheutils::CachingSimNLL*>(nll.get())->clearConstantZeroPoint();
+      }
+      nll_freeform   = nll->getVal();
   }
-  double nll_freeform   = nll->getVal();
   sentry.clear();
 
   if (result_nominal.get()  == 0) return false;
@@ -62,8 +62,11 @@
 #include "../interface/RooMultiPdfCombine.h"
 #include "../interface/CMSHistFunc.h"
 #include "../interface/CMSHistSum.h"
+#include "../interface/CMSHistErrorPropagator.h"
 
 #include "../interface/CombineLogger.h"
+#include "../interface/LimitTreeWriter.h"
+#include "../interface/ProfiledNLLStore.h"
 
 using namespace RooStats;
 using namespace RooFit;
@@ -86,7 +89,7 @@ bool lowerLimit_ = 0;
 float cl = 0.95;
 bool bypassFrequentistFit_ = false;
 bool g_fillTree_ = true;
-TTree *Combine::tree_ = 0;
+LimitTreeWriter *Combine::tree_ = 0;
 
 std::string setPhysicsModelParameterExpression_ = "";
 std::string setPhysicsModelParameterRangeExpression_ = "";
@@ -328,7 +331,7 @@ bool Combine::mklimit(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::Mo
   return ret;
 }
 
-void Combine::run(TString hlfFile, const std::string &dataset, double &limit, double &limitErr, int &iToy, TTree *tree, int nToys) {
+void Combine::run(TString hlfFile, const std::string &dataset, double &limit, double &limitErr, int &iToy, LimitTreeWriter *tree, int nToys) {
   ToCleanUp garbageCollect; // use this to close and delete temporary files
 
   TString tmpDir = "", tmpFile = "", pwd(gSystem->pwd());
@@ -401,6 +404,7 @@ void Combine::run(TString hlfFile, const std::string &dataset, double &limit, do
         std::cerr << "Could not find workspace '" << workspaceName_ << "' in file " << fileToLoad << std::endl; fIn->ls(); 
         throw std::invalid_argument("Missing Workspace"); 
     }
+    if (ProfiledNLLStore::instance()) ProfiledNLLStore::instance()->setContext(ProfiledNLLStore::hashWorkspace(*w));
 
 
     if (verbose > 3) { std::cout << "Input workspace '" << workspaceName_ << "': \n"; w->Print("V"); }
@@ -894,6 +898,13 @@ void Combine::run(TString hlfFile, const std::string &dataset, double &limit, do
     CMSHistFunc::EnableFastVertical();
     CMSHistSum::EnableFastVertical();
   }
+  if (runtimedef::get("CMSHISTSUM_FULL_UPDATE_PERIOD")) {
+    CMSHistSum::SetFullUpdatePeriod(runtimedef::get("CMSHISTSUM_FULL_UPDATE_PERIOD"));
+  }
+  if (runtimedef::get("MINIMIZER_analytic_full_bb")) {
+    CMSHistSum::EnableFullBarlowBeeston();
+    CMSHistErrorPropagator::EnableFullBarlowBeeston();
+  }
 
   // Warn the user that they might be using funky values of POIs 
   if (nToys!=0 && !expectSignalSet_ && setPhysicsModelParameterExpression_ == "" && !(POI->getSize()==1 && POI->find("r"))) {
@@ -1164,12 +1175,12 @@ void Combine::commitPoint(bool expected, float quantile) {
       it.second = (it.first)->getError();
     }
 
-    if (g_fillTree_) tree_->Fill();
+    if (g_fillTree_) tree_->commit();
     g_quantileExpected_ = saveQuantile;
 }
 
 void Combine::addBranch(const char *name, void *address, const char *leaflist) {
-    tree_->Branch(name,address,leaflist);
+    tree_->addBranch(name,address,leaflist);
 }
 void Combine::addPOI(const RooArgSet *poi){
    // RooArgSet *nuisances = (RooArgSet*) w->set("nuisances");
@@ -5,14 +5,117 @@
 #if ROOT_VERSION_CODE >= ROOT_VERSION(6, 36, 0)
 
 #include "../interface/AsymPow.h"
+#include "../interface/CMSHistErrorPropagator.h"
+#include "../interface/CMSHistFunc.h"
+#include "../interface/CMSHistSum.h"
 #include "../interface/ProcessNormalization.h"
 #include "../interface/VerticalInterpHistPdf.h"
 #include "../interface/VerticalInterpPdf.h"
 #include "../interface/CombineMathFuncs.h"
 #include "../interface/RooParametricHist.h"
+#include "../interface/SimpleGaussianConstraint.h"
+#include "../interface/SimplePoissonConstraint.h"
 
 #include <RooUniformBinning.h>
 
+#include <cmath>
+#include <sstream>
+
+namespace {
+
+  using RooFit::Experimental::CodegenContext;
+
+  std::vector<double> binWidths(FastHisto const& hist) {
+    std::vector<double> widths(hist.size());
+    for (unsigned int i = 0; i < hist.size(); ++i) {
+      widths[i] = hist.GetWidth(i);
+    }
+    return widths;
+  }
+
+  // The index of the bin of x in the templates
+  std::string histBinIdx(FastHisto const& hist, RooAbsReal const& x, CodegenContext& ctx) {
+    if (hist.size() != hist.fullsize()) {
+      throw std::runtime_error("We only support templates without inactive bins");
+    }
+    int numBins = hist.size();
+    std::vector<double> binEdges(numBins + 1);
+    bool uniform = true;
+    for (int i = 0; i <= numBins; ++i) {
+      binEdges[i] = hist.GetEdge(i);
+      if (i < numBins && std::abs(hist.GetWidth(i) - hist.GetWidth(0)) > 1e-9 * hist.GetWidth(0)) {
+        uniform = false;
+      }
+    }
+    if (uniform) {
+      return ctx.buildCall("RooFit::Detail::MathFuncs::uniformBinNumber", binEdges[0], binEdges[numBins], x, numBins, 1.);
+    }
+    return ctx.buildCall("RooFit::Detail::MathFuncs::rawBinNumber", x, binEdges, numBins + 1);
+  }
+
+  // Declare the array of the bin contents of a CMSHistFunc, and return its name
+  std::string buildHistFunc(CMSHistFunc& arg, CodegenContext& ctx) {
+    CMSHistFunc::FlatTemplates t;
+    arg.appendFlatTemplates(t);
+
+    std::string arrName = ctx.getTmpVarName();
+    std::stringstream code;
+    code << "double " << arrName << "[" << t.nBins << "];\n";
+    code << ctx.buildCall("RooFit::Detail::MathFuncs::cmsHistProcess",
+                          t.nBins,
+                          static_cast<int>(t.morphIndex.size()),
+                          t.morphs,
+                          t.morphIndex,
+                          t.nominal,
+                          t.sum,
+                          t.diff,
+                          t.logMorph[0],
+                          t.smoothRegion[0],
+                          arrName) +
+                ";\n";
+    ctx.addToCodeBody(code.str(), true);
+    return arrName;
+  }
+
+  // Declare the array of the bin contents of a sum of templates, with the
+  // bin parameters applied, and return its name
+  std::string buildHistSum(CMSHistFunc::FlatTemplates const& t,
+                           RooArgList const& coefs,
+                           RooArgList const& binPars,
+                           CodegenContext& ctx) {
+    int nProcs = t.logMorph.size();
+    std::string procName = ctx.getTmpVarName();
+    std::string arrName = ctx.getTmpVarName();
+    std::stringstream code;
+    code << "double " << procName << "[" << (nProcs * t.nBins) << "];\n";
+    code << "double " << arrName << "[" << t.nBins << "];\n";
+    code << ctx.buildCall("RooFit::Detail::MathFuncs::cmsHistSum",
+                          t.nBins,
+                          nProcs,
+                          coefs,
+                          t.morphs,
+                          t.nominal,
+                          t.errors,
+                          t.logMorph,
+                          t.smoothRegion,
+                          t.morphOffset,
+                          t.morphIndex,
+                          t.sum,
+                          t.diff,
+                          static_cast<int>(t.binParType.size()),
+                          binPars,
+                          t.binParBin,
+                          t.binParProc,
+                          t.binParType,
+                          procName,
+                          arrName) +
+                ";\n";
+    ctx.addToCodeBody(code.str(), true);
+    return arrName;
+  }
+
+}  // namespace
+
 void RooFit::Experimental::codegenImpl(AsymPow& arg, CodegenContext& ctx) {
   ctx.addResult(&arg,
                 ctx.buildCall("RooFit::Detail::MathFuncs::asymPow", arg.theta(), arg.kappaLow(), arg.kappaHigh()));
@@ -270,6 +373,60 @@ void RooFit::Experimental::codegenImpl(RooParametricHist& arg, CodegenContext& c
   ctx.addResult(&arg, code.str());
 }
 
+void RooFit::Experimental::codegenImpl(CMSHistFunc& arg, CodegenContext& ctx) {
+  std::string arrName = buildHistFunc(arg, ctx);
+  ctx.addResult(&arg, arrName + "[" + histBinIdx(arg.cache(), arg.getXVar(), ctx) + "]");
+}
+
+void RooFit::Experimental::codegenImpl(CMSHistSum& arg, CodegenContext& ctx) {
+  std::string arrName = buildHistSum(arg.flatTemplates(), arg.coefList(), arg.binParList(), ctx);
+  ctx.addResult(&arg, arrName + "[" + histBinIdx(arg.cache(), arg.getXVar(), ctx) + "]");
+}
+
+void RooFit::Experimental::codegenImpl(CMSHistErrorPropagator& arg, CodegenContext& ctx) {
+  auto const& func = static_cast<CMSHistFunc const&>(arg.funcList()[0]);
+  std::string arrName = buildHistSum(arg.flatTemplates(), arg.coefList(), arg.binParList(), ctx);
+  ctx.addResult(&arg, arrName + "[" + histBinIdx(func.cache(), func.getXVar(), ctx) + "]");
+}
+
+void RooFit::Experimental::codegenImpl(SimpleGaussianConstraint& arg, CodegenContext& ctx) {
+  // self-normalized, as in CachingSimNLL
+  ctx.addResult(&arg, ctx.buildCall("RooFit::Detail::MathFuncs::gaussian", arg.getX(), arg.getMean(), arg.getSigma()));
+}
+
+void RooFit::Experimental::codegenImpl(SimplePoissonConstraint& arg, CodegenContext& ctx) {
+  std::string xName = ctx.getResult(arg.getX());
+  if (!arg.getNoRounding()) {
+    xName = "std::floor(" + xName + ")";
+  }
+  ctx.addResult(&arg, ctx.buildCall("RooFit::Detail::MathFuncs::poisson", xName, arg.getMean()));
+}
+
+std::string RooFit::Experimental::codegenIntegralImpl(CMSHistFunc& arg,
+                                                      int code,
+                                                      const char* rangeName,
+                                                      CodegenContext& ctx) {
+  std::string arrName = buildHistFunc(arg, ctx);
+  return ctx.buildCall("RooFit::Detail::MathFuncs::cmsHistIntegral", static_cast<int>(arg.cache().size()), arrName, binWidths(arg.cache()));
+}
+
+std::string RooFit::Experimental::codegenIntegralImpl(CMSHistSum& arg,
+                                                      int code,
+                                                      const char* rangeName,
+                                                      CodegenContext& ctx) {
+  std::string arrName = buildHistSum(arg.flatTemplates(), arg.coefList(), arg.binParList(), ctx);
+  return ctx.buildCall("RooFit::Detail::MathFuncs::cmsHistIntegral", static_cast<int>(arg.cache().size()), arrName, binWidths(arg.cache()));
+}
+
+std::string RooFit::Experimental::codegenIntegralImpl(CMSHistErrorPropagator& arg,
+                                                      int code,
+                                                      const char* rangeName,
+                                                      CodegenContext& ctx) {
+  FastHisto const& hist = static_cast<CMSHistFunc const&>(arg.funcList()[0]).cache();
+  std::string arrName = buildHistSum(arg.flatTemplates(), arg.coefList(), arg.binParList(), ctx);
+  return ctx.buildCall("RooFit::Detail::MathFuncs::cmsHistIntegral", static_cast<int>(hist.size()), arrName, binWidths(hist));
+}
+
 std::string RooFit::Experimental::codegenIntegralImpl(VerticalInterpPdf& arg,
                                                       int code,
                                                       const char* rangeName,
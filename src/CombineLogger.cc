@@ -1,43 +1,213 @@
 #include "../interface/CombineLogger.h"
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <pthread.h>
 using namespace std;
 
 // counter for Logger calls
-int CombineLogger::nLogs=0;
+std::atomic<int> CombineLogger::nLogs{0};
 
 const char*  CombineLogger::fName = "combine_logger.out";
+unsigned int CombineLogger::burst_ = 100;
+unsigned int CombineLogger::perSecond_ = 1;
 
 CombineLogger* CombineLogger::pL = nullptr;
 
 CombineLogger& CombineLogger::instance()
 {
-
-	if (pL == nullptr)
-		pL = new CombineLogger();
-
-	return *pL;
+	// thread-safe initialization; the instance is never deleted, the messages are flushed at exit
+	static CombineLogger *theInstance = (pL = new CombineLogger());
+	return *theInstance;
 }
 
-CombineLogger::CombineLogger()
+CombineLogger::CombineLogger() :
+	ring_(Capacity)
 {
 	outStream.open(fName, ios_base::out);
+	for (std::size_t i = 0; i < ring_.size(); ++i) ring_[i].seq.store(i, std::memory_order_relaxed);
+	writer_ = new std::thread(&CombineLogger::writerLoop_, this);
+	std::atexit(&CombineLogger::atExit_);
+	// a forked process has no writer thread: it will write the messages directly
+	pthread_atfork(&CombineLogger::prepareFork_, &CombineLogger::afterForkParent_, &CombineLogger::afterForkChild_);
+}
+
+std::string CombineLogger::format(const char *fmt, ...)
+{
+	char buff[1024];
+	va_list args;
+	va_start(args, fmt);
+	int n = vsnprintf(buff, sizeof(buff), fmt, args);
+	va_end(args);
+	if (n < 0) return std::string(fmt);
+	if (n < int(sizeof(buff))) return std::string(buff, n);
+	std::string ret(n, '\0');
+	va_start(args, fmt);
+	vsnprintf(&ret[0], n+1, fmt, args);
+	va_end(args);
+	return ret;
 }
 
 void CombineLogger::log(const std::string & _file, const int _lineN, const string& _logmsg, const string& _function)
 {
 	std::cout << _logmsg << std::endl;
-	outStream << _file << "[" << _lineN << "] " << ": (in function: " << _function << ") - "  << _logmsg << endl;
-	nLogs++; 
+	push(_file + "[" + std::to_string(_lineN) + "] : (in function: " + _function + ") - " + _logmsg);
+}
+
+void CombineLogger::log(Site &site, const std::string& _logmsg, const char *_function)
+{
+	if (!site.registered_.exchange(true)) registerSite_(&site);
+	// identical to the previous message from the same place: just count it
+	std::size_t hash = std::hash<std::string>()(_logmsg);
+	if (site.lastHash_.exchange(hash) == hash) {
+		site.repeated_++; site.totalRepeated_++;
+		return;
+	}
+	std::cout << _logmsg << std::endl;
+	std::string line = std::string(site.file_) + "[" + std::to_string(site.line_) + "] : (in function: " + _function + ") - " + _logmsg;
+	unsigned long repeated = site.repeated_.exchange(0), suppressed = site.suppressed_.exchange(0);
+	if (repeated) line += " [previous message repeated " + std::to_string(repeated) + " more times]";
+	if (suppressed) line += " [" + std::to_string(suppressed) + " messages from here suppressed by the rate limit]";
+	push(std::move(line));
+}
+
+void CombineLogger::push(std::string &&line)
+{
+	nLogs++;
+	if (synchronous_.load(std::memory_order_relaxed)) {
+		std::lock_guard<std::mutex> lock(writeMutex_);
+		drain_();
+		outStream << line << endl;
+		return;
+	}
+	std::size_t pos = tail_.load(std::memory_order_relaxed);
+	for (;;) {
+		Slot &slot = ring_[pos % Capacity];
+		std::size_t seq = slot.seq.load(std::memory_order_acquire);
+		long diff = long(seq) - long(pos);
+		if (diff == 0) {
+			if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				slot.text = std::move(line);
+				slot.seq.store(pos + 1, std::memory_order_release);
+				break;
+			}
+		} else if (diff < 0) {
+			// full: never block the caller
+			dropped_++;
+			return;
+		} else {
+			pos = tail_.load(std::memory_order_relaxed);
+		}
+	}
+	if (pos % (Capacity/4) == 0) wakeUp_.notify_one();
+}
+
+void CombineLogger::drain_()
+{
+	std::size_t pos = head_.load(std::memory_order_relaxed);
+	bool any = false;
+	for (;;) {
+		Slot &slot = ring_[pos % Capacity];
+		if (slot.seq.load(std::memory_order_acquire) != pos + 1) break; // empty, or still being written
+		outStream << slot.text << '\n';
+		slot.text.clear();
+		slot.seq.store(pos + Capacity, std::memory_order_release);
+		head_.store(++pos, std::memory_order_relaxed);
+		any = true;
+	}
+	unsigned long dropped = dropped_.exchange(0);
+	if (dropped) outStream << "CombineLogger: " << dropped << " messages lost because the queue was full\n";
+	if (any || dropped) outStream.flush();
+}
+
+void CombineLogger::writerLoop_()
+{
+	std::unique_lock<std::mutex> lock(writeMutex_);
+	while (!stop_.load()) {
+		drain_();
+		wakeUp_.wait_for(lock, std::chrono::milliseconds(50));
+	}
+	drain_();
+}
+
+void CombineLogger::flush()
+{
+	std::lock_guard<std::mutex> lock(writeMutex_);
+	drain_();
+}
+
+void CombineLogger::registerSite_(Site *site)
+{
+	std::lock_guard<std::mutex> lock(sitesMutex_);
+	sites_.push_back(site);
 }
 
 void CombineLogger::printLog()
 {
+	flush();
+	{
+		std::lock_guard<std::mutex> lock(sitesMutex_);
+		std::lock_guard<std::mutex> wlock(writeMutex_);
+		for (Site *site : sites_) {
+			if (site->totalSuppressed_ == 0 && site->totalRepeated_ == 0) continue;
+			outStream << site->file_ << "[" << site->line_ << "] : " << site->calls_.load() << " messages, of which "
+				  << site->totalRepeated_.load() << " repeated and " << site->totalSuppressed_.load() << " suppressed by the rate limit" << endl;
+		}
+	}
 	std::cout << nLogs << " log messages saved to " << fName << std::endl;
 }
 
+void CombineLogger::atExit_()
+{
+	if (pL == nullptr) return;
+	pL->stop_ = true;
+	pL->wakeUp_.notify_one();
+	if (pL->writer_ && pL->writer_->joinable()) pL->writer_->join();
+	std::lock_guard<std::mutex> lock(pL->writeMutex_);
+	pL->drain_();
+	pL->outStream.flush();
+}
+
+void CombineLogger::prepareFork_()
+{
+	// make sure that the writer thread is not in the middle of a write
+	if (pL) pL->writeMutex_.lock();
+}
+
+void CombineLogger::afterForkParent_()
+{
+	if (pL) pL->writeMutex_.unlock();
+}
+
+void CombineLogger::afterForkChild_()
+{
+	if (pL == nullptr) return;
+	pL->writeMutex_.unlock();
+	pL->writer_ = nullptr; // the thread does not exist in this process
+	pL->synchronous_ = true;
+}
+
 CombineLogger::~CombineLogger()
 {
-	// Combine will delete
+	// never called, the instance lives until the end of the job
 	outStream.close();
-	delete CombineLogger::pL;
-	CombineLogger::pL = nullptr;
-}
\ No newline at end of file
+}
+
+CombineLogger::Site::Site(const char *file, int line) :
+	file_(file), line_(line)
+{
+}
+
+bool CombineLogger::Site::accept()
+{
+	unsigned long n = calls_.fetch_add(1, std::memory_order_relaxed) + 1;
+	if (n <= burst_) return true;
+	long long now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	long long start = windowStart_.load(std::memory_order_relaxed);
+	if (now - start >= 1000 && windowStart_.compare_exchange_strong(start, now)) inWindow_.store(0);
+	if (inWindow_.fetch_add(1, std::memory_order_relaxed) < perSecond_) return true;
+	suppressed_++; totalSuppressed_++;
+	return false;
+}
@@ -0,0 +1,121 @@
+#include "../interface/ConstraintBlock.h"
+#include "../interface/SimpleGaussianConstraint.h"
+#include "../interface/SimplePoissonConstraint.h"
+#include "vectorized.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+namespace {
+    /// same as SimplePoissonConstraint::getLogValFast
+    double poissonLogVal(double obs, double mean, double logGamma)
+    {
+        if (std::abs(obs) < 1e-10) return (std::abs(mean) < 1e-10) ? 0 : -mean;
+        if (obs < 1000000) return obs * std::log(mean) - mean - logGamma;
+        double diff = obs - mean;
+        return 0.5 * std::log(mean) - (diff * diff) / (2 * mean);
+    }
+}
+
+ConstraintBlock::ConstraintBlock(const std::vector<SimpleGaussianConstraint *> &gaus, const std::vector<SimplePoissonConstraint *> &pois) :
+    sentry_("ConstraintBlock_sentry", "")
+{
+    std::map<const RooAbsReal *, uint32_t> columns;
+    auto column = [&](const RooAbsReal &input) -> uint32_t {
+        auto found = columns.find(&input);
+        if (found != columns.end()) return found->second;
+        uint32_t col = inputs_.size();
+        columns[&input] = col;
+        inputList_.add(input);
+        inputs_.push_back(&input);
+        return col;
+    };
+    for (const SimpleGaussianConstraint *g : gaus) {
+        gausXCol_.push_back(column(g->getX()));
+        gausMeanCol_.push_back(column(g->getMean()));
+        gausScale_.push_back(g->getScale());
+        gausZero_.push_back(0);
+    }
+    for (const SimplePoissonConstraint *p : pois) {
+        poisObsCol_.push_back(column(p->getObserved()));
+        poisMeanCol_.push_back(column(p->getMean()));
+        poisLogGamma_.push_back(p->getLogGamma());
+        poisZero_.push_back(0);
+    }
+    sentry_.addVars(inputList_);
+    inputVals_.resize(inputs_.size());
+    gausX_.resize(gausScale_.size());
+    gausMean_.resize(gausScale_.size());
+    poisObs_.resize(poisLogGamma_.size());
+    poisMean_.resize(poisLogGamma_.size());
+    workingArea_.resize(poisLogGamma_.size());
+}
+
+void ConstraintBlock::update() const
+{
+    if (sentry_.good()) return;
+    for (std::size_t j = 0, n = inputs_.size(); j < n; ++j) {
+        inputVals_[j] = inputs_[j]->getVal();
+    }
+    for (std::size_t i = 0, n = gausX_.size(); i < n; ++i) {
+        gausX_[i] = inputVals_[gausXCol_[i]];
+        gausMean_[i] = inputVals_[gausMeanCol_[i]];
+    }
+    for (std::size_t i = 0, n = poisObs_.size(); i < n; ++i) {
+        poisObs_[i] = inputVals_[poisObsCol_[i]];
+        poisMean_[i] = inputVals_[poisMeanCol_[i]];
+    }
+    logVal_ = vectorized::gaussian_constraints(gausX_.size(), gausX_.data(), gausMean_.data(), gausScale_.data(), gausZero_.data());
+    logVal_ += vectorized::poisson_constraints(poisObs_.size(), poisObs_.data(), poisMean_.data(), poisLogGamma_.data(), poisZero_.data(), workingArea_.data());
+    sentry_.reset();
+}
+
+double ConstraintBlock::logVal(std::vector<double> &grad, std::vector<double> &hessDiag) const
+{
+    update();
+    grad.assign(inputs_.size(), 0.0);
+    hessDiag.assign(inputs_.size(), 0.0);
+    for (std::size_t i = 0, n = gausX_.size(); i < n; ++i) {
+        double d = -2 * gausScale_[i] * (gausX_[i] - gausMean_[i]);
+        grad[gausXCol_[i]] += d;
+        grad[gausMeanCol_[i]] -= d;
+        hessDiag[gausXCol_[i]] -= 2 * gausScale_[i];
+        hessDiag[gausMeanCol_[i]] -= 2 * gausScale_[i];
+    }
+    for (std::size_t i = 0, n = poisObs_.size(); i < n; ++i) {
+        double obs = poisObs_[i], mean = poisMean_[i];
+        if (std::abs(obs) < 1e-10) {
+            if (std::abs(mean) >= 1e-10) grad[poisMeanCol_[i]] += 1;
+        } else if (obs < 1000000) {
+            grad[poisMeanCol_[i]] += 1 - obs / mean;
+            hessDiag[poisMeanCol_[i]] += obs / (mean * mean);
+        } else {
+            // gaussian approximation, log L = log(mean)/2 - (obs - mean)^2 / (2 mean)
+            double diff = obs - mean, mean2 = mean * mean;
+            grad[poisMeanCol_[i]] -= 0.5 / mean + diff / mean + diff * diff / (2 * mean2);
+            hessDiag[poisMeanCol_[i]] += (0.5 + obs + diff) / mean2 + diff * diff / (mean2 * mean);
+        }
+    }
+    return logVal_;
+}
+
+void ConstraintBlock::setZeroPoint()
+{
+    clearZeroPoint();
+    update();
+    for (std::size_t i = 0, n = gausX_.size(); i < n; ++i) {
+        double arg = gausX_[i] - gausMean_[i];
+        gausZero_[i] = -gausScale_[i] * arg * arg;
+    }
+    for (std::size_t i = 0, n = poisObs_.size(); i < n; ++i) {
+        poisZero_[i] = -poissonLogVal(poisObs_[i], poisMean_[i], poisLogGamma_[i]);
+    }
+    sentry_.setValueDirty();
+}
+
+void ConstraintBlock::clearZeroPoint()
+{
+    std::fill(gausZero_.begin(), gausZero_.end(), 0.0);
+    std::fill(poisZero_.begin(), poisZero_.end(), 0.0);
+    sentry_.setValueDirty();
+}
@@ -13,21 +13,41 @@
 float FeldmanCousins::toysFactor_ = 1;
 float FeldmanCousins::rAbsAccuracy_ = 0.1;
 float FeldmanCousins::rRelAccuracy_ = 0.02;
+bool FeldmanCousins::rooStatsFC_ = false;
+unsigned int FeldmanCousins::nToys_ = 500;
+unsigned int FeldmanCousins::rays_ = 16;
+unsigned int FeldmanCousins::fork_ = 0;
+double FeldmanCousins::pAccuracy_ = 0.005;
 
 FeldmanCousins::FeldmanCousins() :
     LimitAlgo("FeldmanCousins specific options") {
     options_.add_options()
         ("rAbsAcc", boost::program_options::value<float>(&rAbsAccuracy_)->default_value(rAbsAccuracy_), "Absolute accuracy on r to reach to terminate the scan")
         ("rRelAcc", boost::program_options::value<float>(&rRelAccuracy_)->default_value(rRelAccuracy_), "Relative accuracy on r to reach to terminate the scan")
-        ("toysFactor", boost::program_options::value<float>(&toysFactor_)->default_value(toysFactor_),   "Increase the toys per point by this factor w.r.t. the minimum from adaptive sampling")
+        ("toysFactor", boost::program_options::value<float>(&toysFactor_)->default_value(toysFactor_),   "Increase the toys per point by this factor w.r.t. the minimum from adaptive sampling (only with --rooStatsFC)")
+        ("toysH", boost::program_options::value<unsigned int>(&nToys_)->default_value(nToys_), "Number of toys thrown at a time at each point, until its p-value is known well enough to say if it is inside the region")
+        ("clsAcc", boost::program_options::value<double>(&pAccuracy_)->default_value(pAccuracy_), "Absolute accuracy on the p-value of a point, after which no more toys are thrown even if it is still compatible with 1-CL")
+        ("rays", boost::program_options::value<unsigned int>(&rays_)->default_value(rays_), "Number of directions from the best fit along which the boundary is searched, for two parameters of interest")
+        ("fork", boost::program_options::value<unsigned int>(&fork_)->default_value(fork_), "Throw the toys at each point in N parallel processes")
+        ("reuseToys", "Reuse the toys thrown at nearby values of the parameter of interest, weighting them by their likelihood ratio (one parameter of interest only, not together with --fork)")
+        ("rooStatsFC", "Use RooStats::FeldmanCousins, with a scan of 10 points at a time, instead of the bisection of the boundary of the region")
     ;
 }
 
 void FeldmanCousins::applyOptions(const boost::program_options::variables_map &vm) 
 {
+    rooStatsFC_ = vm.count("rooStatsFC");
+    if (!rooStatsFC_) {
+        hybridNew_.setupFeldmanCousins(nToys_, pAccuracy_, rAbsAccuracy_, rRelAccuracy_, rays_, fork_, vm.count("reuseToys"), vm["mass"].as<float>());
+    }
 }
 
 bool FeldmanCousins::run(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint) {
+  if (rooStatsFC_) return runRooStats(w, mc_s, mc_b, data, limit, limitErr, hint);
+  return hybridNew_.runFeldmanCousins(w, mc_s, mc_b, data, limit, limitErr, hint);
+}
+
+bool FeldmanCousins::runRooStats(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint) {
   RooArgSet  poi(*mc_s->GetParametersOfInterest());
   RooRealVar *r = dynamic_cast<RooRealVar *>(poi.first());
 
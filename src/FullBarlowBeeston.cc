@@ -0,0 +1,140 @@
+#include "../interface/FullBarlowBeeston.h"
+#include <cmath>
+#include <limits>
+#include "RooAbsReal.h"
+#include "RooConstVar.h"
+#include "RooGaussian.h"
+#include "RooPoisson.h"
+#include "RooRealVar.h"
+#include "TString.h"
+
+namespace {
+  // Global observable of the gaussian or poisson constraint of par, 0 if not found
+  double globalObservable(RooRealVar const& par) {
+    for (RooAbsArg* arg : par.valueClients()) {
+      if (!dynamic_cast<RooGaussian*>(arg) && !dynamic_cast<RooPoisson*>(arg)) continue;
+      auto gobs = dynamic_cast<RooAbsReal*>(arg->findServer(TString(par.GetName()) + "_In"));
+      if (gobs) return gobs->getVal();
+    }
+    return 0.;
+  }
+}  // namespace
+
+void FullBarlowBeeston::addBin(unsigned j, std::vector<unsigned> const& types, std::vector<RooAbsReal*> const& binpars) {
+  if (row.empty()) row.push_back(0);
+  unsigned nterms = proc.size();
+  for (unsigned i = 0; i < types.size(); ++i) {
+    RooRealVar* par = nullptr;
+    double n = 1.;
+    if (types[i] == Gaussian) {
+      par = dynamic_cast<RooRealVar*>(binpars[i]);
+    } else if (types[i] == Poisson) {
+      // the bin parameter is the product of the poisson parameter and 1/n
+      for (RooAbsArg* arg : binpars[i]->servers()) {
+        if (auto cvar = dynamic_cast<RooConstVar*>(arg)) {
+          n = 1. / cvar->getVal();
+        } else if (auto var = dynamic_cast<RooRealVar*>(arg)) {
+          par = var;
+        }
+      }
+    }
+    if (!par || par->isConstant()) continue;
+    proc.push_back(i);
+    type.push_back(types[i]);
+    gobs.push_back(globalObservable(*par));
+    invn.push_back(1. / n);
+    push_res.push_back(par);
+    par->setConstant(true);
+  }
+  if (proc.size() == nterms) return;
+  use.push_back(j);
+  row.push_back(proc.size());
+}
+
+void FullBarlowBeeston::finalize() {
+  if (row.empty()) row.push_back(0);
+  dat.resize(use.size());
+  valsum.resize(use.size());
+  u.assign(use.size(), 0.);
+  scale.resize(proc.size());
+  init = true;
+}
+
+void FullBarlowBeeston::solve() {
+  for (unsigned r = 0; r < use.size(); ++r) {
+    const unsigned lo_t = row[r], hi_t = row[r + 1];
+    // the derivative of the expected events is nu'(u) = -sum a_i^2 - sum b_i^2 g_i / (1 + b_i u)^2 < 0,
+    // so G(u) = nu(u) (1 - u) - d decreases from +inf at the lowest pole (or at -inf) to -d at u = 1
+    double lo = -std::numeric_limits<double>::infinity(), hi = 1.;
+    bool ok = true;
+    for (unsigned t = lo_t; t < hi_t; ++t) {
+      if (type[t] != Poisson) continue;
+      double b = scale[t] * invn[t];
+      if (b < 0.) ok = false;
+      else if (b > 0. && gobs[t] > 0.) lo = std::max(lo, -1. / b);
+    }
+    if (!ok) continue;  // negative yield, leave the parameters where they are
+    auto G = [&](double x, double& dG) {
+      double nu = valsum[r], dnu = 0.;
+      for (unsigned t = lo_t; t < hi_t; ++t) {
+        if (type[t] == Gaussian) {
+          double a = scale[t];
+          nu += a * (gobs[t] - a * x);
+          dnu -= a * a;
+        } else {
+          double b = scale[t] * invn[t];
+          double den = 1. + b * x;
+          nu += b * gobs[t] / den - scale[t];
+          dnu -= b * b * gobs[t] / (den * den);
+        }
+      }
+      dG = dnu * (1. - x) - nu;
+      return nu * (1. - x) - dat[r];
+    };
+    double x = 1.;
+    if (dat[r] > 0.) {
+      double dG;
+      if (!std::isfinite(lo)) {
+        // no pole: step down until G > 0
+        double step = 1.;
+        for (lo = std::min(u[r], 0.) - step; G(lo, dG) <= 0. && step < 1e30; lo -= step) step *= 2.;
+        if (G(lo, dG) <= 0.) continue;  // no solution with positive expected events
+      }
+      x = (u[r] > lo && u[r] < hi) ? u[r] : 0.5 * (lo + hi);
+      for (unsigned it = 0; it < 100; ++it) {
+        double g = G(x, dG);
+        if (g > 0.) lo = x;
+        else hi = x;
+        if (std::abs(g) <= 1e-12 * dat[r]) break;
+        double next = x - g / dG;
+        if (!(next > lo && next < hi)) next = 0.5 * (lo + hi);
+        if (std::abs(next - x) <= 1e-15 * (1. + std::abs(x))) {
+          x = next;
+          break;
+        }
+        x = next;
+      }
+    }
+    u[r] = x;
+    for (unsigned t = lo_t; t < hi_t; ++t) {
+      double res = (type[t] == Gaussian) ? gobs[t] - scale[t] * x : gobs[t] / (1. + scale[t] * invn[t] * x);
+      if (std::isfinite(res)) push_res[t]->setVal(res);
+    }
+  }
+}
+
+void FullBarlowBeeston::clear() {
+  for (RooRealVar* par : push_res) par->setConstant(false);
+  use.clear();
+  row.clear();
+  proc.clear();
+  type.clear();
+  gobs.clear();
+  invn.clear();
+  push_res.clear();
+  dat.clear();
+  valsum.clear();
+  scale.clear();
+  u.clear();
+  init = false;
+}
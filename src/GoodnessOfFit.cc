@@ -47,6 +47,8 @@ std::vector<std::string>  GoodnessOfFit::binNames_;
 std::vector<float>        GoodnessOfFit::qVals_;
 std::string GoodnessOfFit::setParametersForFit_ = "";
 std::string GoodnessOfFit::setParametersForEval_ = "";
+bool        GoodnessOfFit::saturatedFit_ = false;
+bool        GoodnessOfFit::saturatedPerChannel_ = false;
 
 GoodnessOfFit::GoodnessOfFit() :
     LimitAlgo("GoodnessOfFit specific options")
@@ -59,6 +61,8 @@ GoodnessOfFit::GoodnessOfFit() :
   //      ("minimizerTolerance", boost::program_options::value<float>(&minimizerTolerance_)->default_value(minimizerTolerance_),  "Tolerance for minimizer")
   //      ("minimizerStrategy",  boost::program_options::value<int>(&minimizerStrategy_)->default_value(minimizerStrategy_),      "Stragegy for minimizer")
         ("fixedSignalStrength", boost::program_options::value<float>(&mu_)->default_value(mu_),  "Compute the goodness of fit for a fixed signal strength. If not specified, it is left floating")
+        ("saturatedFit", "For the saturated model, always fit a pdf built out of the data instead of computing its likelihood directly from the observed bin contents (slower; the direct computation is used only when all the constraints are gaussian or poisson)")
+        ("saturatedPerChannel", "For the saturated model, also store the contribution of each channel to the test statistic in the output tree (constraint terms are only included in the total)")
         ("plots",  "Make plots containing information of the computation of the Anderson-Darling or Kolmogorov-Smirnov test statistic")
     ;
 }
@@ -76,6 +80,11 @@ void GoodnessOfFit::applyOptions(const boost::program_options::variables_map &vm
       throw std::invalid_argument("GoodnessOfFit: algorithm "+algo_+" not supported");
     }
     makePlots_ = vm.count("plots");
+    saturatedFit_ = vm.count("saturatedFit");
+    saturatedPerChannel_ = vm.count("saturatedPerChannel");
+    if (saturatedFit_ && saturatedPerChannel_) {
+      throw std::invalid_argument("GoodnessOfFit: option --saturatedPerChannel is not supported together with --saturatedFit");
+    }
 }
 
 bool GoodnessOfFit::run(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint) { 
@@ -85,8 +94,22 @@ bool GoodnessOfFit::run(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::
 
   RooRealVar *r = dynamic_cast<RooRealVar *>(mc_s->GetParametersOfInterest()->first());
   if (fixedMu_) { r->setVal(mu_); r->setConstant(true); }
-  if (algo_ == "saturated") return runSaturatedModel(w, mc_s, mc_b, data, limit, limitErr, hint);
   static bool is_init = false;
+  if (algo_ == "saturated") {
+    if (saturatedPerChannel_ && !is_init) {
+      initKSandAD(mc_s);
+      is_init = true;
+    }
+    if (!saturatedFit_) {
+      bool ok = false;
+      if (runSaturatedModelDirect(w, mc_s, data, limit, ok)) return ok;
+    }
+    // only the direct computation gives the contribution of each channel
+    if (saturatedPerChannel_) {
+      throw std::invalid_argument("GoodnessOfFit: option --saturatedPerChannel needs the direct computation of the saturated model, which is not available for this model (e.g. because of constraints that are not gaussian or poisson)");
+    }
+    return runSaturatedModel(w, mc_s, mc_b, data, limit, limitErr, hint);
+  }
   if (algo_ == "AD" || algo_ == "KS") {
     if (!is_init) {
       initKSandAD(mc_s);
@@ -236,6 +259,48 @@ bool GoodnessOfFit::runSaturatedModel(RooWorkspace *w, RooStats::ModelConfig *mc
   return true;
 }
 
+bool GoodnessOfFit::runSaturatedModelDirect(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooAbsData &data, double &limit, bool &ok) {
+  RooArgSet const *cPars = withSystematics ? mc_s->GetNuisanceParameters() : nullptr;
+  auto nominal_nll = combineCreateNLL(*mc_s->GetPdf(), data, /*constrain=*/cPars, /*offset=*/false);
+  auto *simnll = dynamic_cast<cacheutils::CachingSimNLL*>(nominal_nll.get());
+  if (simnll == nullptr || !simnll->canComputeSaturatedNLL()) {
+    if (verbose > 0) std::cout << "The saturated model likelihood can't be computed directly for this model, will fit a saturated pdf instead." << std::endl;
+    return false;
+  }
+
+  CloseCoutSentry sentry(verbose < 2);
+  if (setParametersForFit_ != "") {
+    utils::setModelParameters(setParametersForFit_, w->allVars());
+  }
+  CascadeMinimizer minimn(*nominal_nll, CascadeMinimizer::Unconstrained);
+  minimn.minimize(verbose-2);
+
+  if (setParametersForEval_ != "") {
+    utils::setModelParameters(setParametersForEval_, w->allVars());
+  }
+  // the saturated model has no free parameters other than the nuisances in the constraints,
+  // so its NLL follows directly from the observed bin contents and the global observables
+  double nll_nominal = nominal_nll->getVal();
+  std::vector<double> channelDiffs;
+  double nll_saturated = simnll->saturatedNLL(&channelDiffs);
+  sentry.clear();
+
+  if (!std::isfinite(nll_saturated)) {
+    if (verbose > 0) std::cout << "The saturated model likelihood can't be computed directly for this dataset, will fit a saturated pdf instead." << std::endl;
+    return false;
+  }
+  if (fabs(nll_nominal) > 1e10) { ok = false; return true; }
+  limit = 2*(nll_nominal-nll_saturated);
+  for (unsigned int i = 0, n = std::min(qVals_.size(), channelDiffs.size()); i < n; ++i) {
+    qVals_[i] = 2*channelDiffs[i];
+  }
+
+  std::cout << "\n --- GoodnessOfFit --- " << std::endl;
+  std::cout << "Best fit test statistic: " << limit << std::endl;
+  ok = true;
+  return true;
+}
+
 // Code for the Anderson-Darling test originates from https://gist.github.com/neggert/4586791
 bool GoodnessOfFit::runKSandAD(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint, bool kolmo) { 
   RooAbsPdf *pdf = mc_s->GetPdf();
@@ -0,0 +1,188 @@
+#include "../interface/HMCProposal.h"
+#include "../interface/Combine.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <RooAbsData.h>
+#include <RooAbsPdf.h>
+#include <RooFitResult.h>
+#include <RooRandom.h>
+#include <RooRealVar.h>
+#include <TDecompChol.h>
+#include <RooStats/RooStatsUtils.h>
+
+namespace {
+    // above this number of parameters, warn that the finite difference gradient dominates the cost
+    const int nParamsWarning = 20;
+    // dual averaging parameters, from Hoffman & Gelman, "The No-U-Turn Sampler" (2014)
+    const double daTarget = 0.8, daGamma = 0.05, daT0 = 10, daKappa = 0.75;
+}
+
+HMCProposal::HMCProposal(RooAbsPdf &pdf, RooAbsData &data, const RooFitResult *fit, int steps, double stepSize, int adaptSteps) :
+    RooStats::ProposalFunction(),
+    steps_(std::max(steps, 1)),
+    adaptSteps_(adaptSteps),
+    stepSize_(stepSize)
+{
+    nll_ = combineCreateNLL(pdf, data, /*constrain=*/nullptr, /*offset=*/false);
+    std::unique_ptr<RooArgSet> par{pdf.getParameters(data)};
+    RooStats::RemoveConstantParameters(par.get());
+    params_.add(*par);
+    if (fit) {
+        fitCov_.ResizeTo(fit->covarianceMatrix());
+        fitCov_ = fit->covarianceMatrix();
+        for (RooAbsArg *a : fit->floatParsFinal()) fitNames_.push_back(a->GetName());
+    }
+    mu_ = std::log(10*stepSize_);
+    logStepSizeBar_ = std::log(stepSize_);
+}
+
+void HMCProposal::init(RooArgSet &x)
+{
+    for (int i = 0, n = x.getSize(); i < n; ++i) {
+        RooRealVar *v = dynamic_cast<RooRealVar *>(params_.find(x[i]->GetName()));
+        if (v == 0) continue;
+        vars_.push_back(v);
+        index_.push_back(i);
+    }
+    int n = vars_.size();
+    if (n == 0) throw std::logic_error("HMCProposal: none of the parameters of the chain is a parameter of the NLL");
+
+    // covariance: from the fit where available, otherwise uncorrelated with a width of 1/10 of the range
+    TMatrixDSym cov(n);
+    std::vector<int> fitIndex(n, -1);
+    for (int i = 0; i < n; ++i) {
+        for (int k = 0, nf = fitNames_.size(); k < nf; ++k) {
+            if (fitNames_[k] == vars_[i]->GetName()) { fitIndex[i] = k; break; }
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            if (fitIndex[i] >= 0 && fitIndex[j] >= 0) cov(i,j) = fitCov_(fitIndex[i], fitIndex[j]);
+            else if (i == j) cov(i,i) = std::pow(0.1*(vars_[i]->getMax() - vars_[i]->getMin()), 2);
+        }
+    }
+    TDecompChol decomp(cov);
+    if (!decomp.Decompose()) {
+        std::cerr << "HMCProposal: covariance matrix from the fit is not positive definite, will use only its diagonal." << std::endl;
+        for (int i = 0; i < n; ++i) for (int j = 0; j < n; ++j) if (i != j) cov(i,j) = 0;
+        decomp.SetMatrix(cov);
+        decomp.Decompose();
+    }
+    chol_.ResizeTo(n, n);
+    chol_.Transpose(decomp.GetU());
+
+    if (n > nParamsWarning) {
+        std::cerr << "HMCProposal: the gradient of the NLL is computed with finite differences, so each of the " << steps_ << " leapfrog steps of a proposal costs "
+                  << (n+1) << " NLL evaluations for " << n << " parameters. Consider the 'fit' proposal, or fewer --hmcSteps." << std::endl;
+    }
+
+    delta_.resize(n);
+    for (int i = 0; i < n; ++i) delta_[i] = 1e-4 * std::sqrt(cov(i,i));
+}
+
+double HMCProposal::nllAndGradient(const std::vector<double> &x, std::vector<double> &grad)
+{
+    int n = vars_.size();
+    for (int i = 0; i < n; ++i) vars_[i]->setVal(x[i]);
+    double nll0 = nll_->getVal();
+    nllEvals_ += n + 1;
+    for (int i = 0; i < n; ++i) {
+        vars_[i]->setVal(x[i] + delta_[i]);
+        grad[i] = (nll_->getVal() - nll0)/delta_[i];
+        vars_[i]->setVal(x[i]);
+    }
+    return nll0;
+}
+
+bool HMCProposal::inRange(const std::vector<double> &x) const
+{
+    for (int i = 0, n = vars_.size(); i < n; ++i) {
+        if (x[i] < vars_[i]->getMin() || x[i] > vars_[i]->getMax()) return false;
+    }
+    return true;
+}
+
+// Populate xPrime with a new proposed point
+void HMCProposal::Propose(RooArgSet& xPrime, RooArgSet& x)
+{
+    if (vars_.empty()) init(x);
+    RooStats::SetParameters(&x, &xPrime);
+    int n = vars_.size();
+
+    std::vector<double> pos(n), start(n), grad(n), gradU(n), mom(n);
+    for (int i = 0; i < n; ++i) start[i] = pos[i] = static_cast<RooRealVar*>(x[index_[i]])->getVal();
+
+    // work with the whitened coordinates u = L^-1 (x - x0), with unit mass: grad_u = L^T grad_x, dx = L du
+    auto whiten = [&](const std::vector<double> &g) { for (int i = 0; i < n; ++i) { gradU[i] = 0; for (int j = i; j < n; ++j) gradU[i] += chol_(j,i)*g[j]; } };
+    kinetic0_ = 0;
+    for (int i = 0; i < n; ++i) { mom[i] = RooRandom::gaussian(); kinetic0_ += 0.5*mom[i]*mom[i]; }
+
+    // jitter the step size a bit, to avoid periodic trajectories
+    double eps = stepSize_ * (0.8 + 0.4*RooRandom::uniform());
+    double nll0 = nllAndGradient(pos, grad), nll1 = nll0;
+    whiten(grad);
+    bool ok = std::isfinite(nll0);
+    for (int s = 0; s < steps_ && ok; ++s) {
+        for (int i = 0; i < n; ++i) mom[i] -= 0.5*eps*gradU[i];
+        for (int i = 0; i < n; ++i) { for (int j = 0; j <= i; ++j) pos[i] += eps*chol_(i,j)*mom[j]; }
+        if (!inRange(pos)) { ok = false; break; }
+        nll1 = nllAndGradient(pos, grad);
+        if (!std::isfinite(nll1)) { ok = false; break; }
+        whiten(grad);
+        for (int i = 0; i < n; ++i) mom[i] -= 0.5*eps*gradU[i];
+    }
+    kinetic1_ = 0;
+    for (int i = 0; i < n; ++i) kinetic1_ += 0.5*mom[i]*mom[i];
+
+    double acceptance = 0;
+    if (ok) {
+        acceptance = std::min(1.0, std::exp(nll0 + kinetic0_ - nll1 - kinetic1_));
+        if (!std::isfinite(acceptance)) acceptance = 0;
+    } else {
+        // trajectory left the allowed range: propose to stay where we are
+        pos = start;
+        kinetic1_ = kinetic0_;
+    }
+
+    if (proposed_ < adaptSteps_) {
+        double m = proposed_ + 1;
+        hBar_ = (1 - 1/(m + daT0))*hBar_ + (daTarget - acceptance)/(m + daT0);
+        double logStepSize = mu_ - std::sqrt(m)/daGamma * hBar_;
+        double w = std::pow(m, -daKappa);
+        logStepSizeBar_ = w*logStepSize + (1 - w)*logStepSizeBar_;
+        stepSize_ = (proposed_ + 1 == adaptSteps_ ? std::exp(logStepSizeBar_) : std::exp(logStepSize));
+    }
+    ++proposed_;
+
+    for (int i = 0; i < n; ++i) {
+        static_cast<RooRealVar*>(xPrime[index_[i]])->setVal(pos[i]);
+        vars_[i]->setVal(start[i]);
+    }
+    lastProposed_ = pos;
+}
+
+bool HMCProposal::isLastProposed(RooArgSet &x) const
+{
+    for (int i = 0, n = vars_.size(); i < n; ++i) {
+        if (static_cast<RooRealVar*>(x[index_[i]])->getVal() != lastProposed_[i]) return false;
+    }
+    return true;
+}
+
+Bool_t HMCProposal::IsSymmetric(RooArgSet& x1, RooArgSet& x2) {
+    return false;
+}
+
+// Return the probability of proposing the point x1 given the starting
+// point x2. For the last trajectory, going forward has the density of the
+// initial momentum, and going backwards that of the final (reversed) one.
+Double_t HMCProposal::GetProposalDensity(RooArgSet& x1,
+                                         RooArgSet& x2)
+{
+    double kmin = std::min(kinetic0_, kinetic1_);
+    return isLastProposed(x1) ? std::exp(-(kinetic0_ - kmin)) : std::exp(-(kinetic1_ - kmin));
+}
+
+ClassImp(HMCProposal)
@@ -24,6 +24,7 @@
 #include "RooRandom.h"
 #include "RooAddPdf.h"
 #include "RooConstVar.h"
+#include "RooDataSet.h"
 #include "RooMsgService.h"
 #include <RooStats/ModelConfig.h>
 #include <RooStats/FrequentistCalculator.h>
@@ -33,6 +34,7 @@
 #include <RooStats/ProfileLikelihoodTestStat.h>
 #include <RooStats/ToyMCSampler.h>
 #include <RooStats/HypoTestPlot.h>
+#include <RooStats/SamplingDistribution.h>
 #include "../interface/Combine.h"
 #include "../interface/CloseCoutSentry.h"
 #include "../interface/RooFitGlobalKillSentry.h"
@@ -46,6 +48,8 @@
 #include "../interface/Significance.h"
 #include "../interface/ProfilingTools.h"
 #include "../interface/CombineLogger.h"
+#include "../interface/CombineUtils.h"
+#include "Math/QuantFuncMathCore.h"
 
 using namespace RooStats;
 using namespace std;
@@ -68,6 +72,7 @@ RooArgSet           HybridNew::rValues_;
 bool HybridNew::CLs_ = false;
 bool HybridNew::saveHybridResult_  = false;
 bool HybridNew::readHybridResults_ = false;
+std::string HybridNew::gridFormat_ = "objects";
 bool  HybridNew::expectedFromGrid_ = false;
 bool  HybridNew::clsQuantiles_ = true;
 float HybridNew::quantileForExpectedFromGrid_ = 0.5;
@@ -79,6 +84,8 @@ std::string HybridNew::gridFile_ = "";
 std::string HybridNew::scaleAndConfidenceSelection_ ="0.68,0.95";
 bool HybridNew::importanceSamplingNull_ = false;
 bool HybridNew::importanceSamplingAlt_  = false;
+bool HybridNew::reuseToys_ = false;
+float HybridNew::reuseToysMinESS_ = 0.5;
 std::string HybridNew::algo_ = "logSecant";
 bool HybridNew::optimizeProductPdf_     = true;
 bool HybridNew::optimizeTestStatistics_ = true;
@@ -89,6 +96,7 @@ std::string HybridNew::plot_;
 //std::string HybridNew::minimizerAlgo_ = "Minuit2";
 //float       HybridNew::minimizerTolerance_ = 1e-2;
 float       HybridNew::adaptiveToys_ = -1;
+unsigned int HybridNew::fcRays_ = 16;
 bool        HybridNew::reportPVal_ = false;
 float HybridNew::confidenceToleranceForToyScaling_ = 0.2;
 float HybridNew::maxProbability_ = 0.999;
@@ -114,6 +122,7 @@ LimitAlgo("HybridNew specific options") {
         ("iterations,i", boost::program_options::value<unsigned int>(&iterations_)->default_value(iterations_), "Number of times to throw 'toysH' toys to compute the p-values (for --singlePoint if clsAcc is set to zero disabling adaptive generation)")
         ("fork",    boost::program_options::value<unsigned int>(&fork_)->default_value(fork_),           "Fork to N processes before running the toys (0 by default == no forking). Only use if you're an expert in combine!")
         ("saveHybridResult",  "Save result in the output file")
+        ("gridFormat", boost::program_options::value<std::string>(&gridFormat_)->default_value(gridFormat_), "Format used by --saveHybridResult: 'objects' (one HypoTestResult per job and point) or 'columns' (entries of a single HypoTestGrid tree, merged with hadd). Both are read by --readHybridResults and --grid")
         ("readHybridResults", "Read and merge results from file (requires option '--grid' or '--toysFile')")
         ("grid",    boost::program_options::value<std::string>(&gridFile_), "Use the specified file containing a grid of SamplingDistributions for the limit (implies readHybridResults).\n For calculating CLs/pmu values with --singlePoint or if calculating the Signfiicance with LHCmode LHC-significance ( or any option with --signif) use '--toysFile=x.root --readHybridResult' !")
         ("expectedFromGrid", boost::program_options::value<float>(&quantileForExpectedFromGrid_)->default_value(0.5), "Use the grid to compute the expected limit for this quantile")
@@ -123,6 +132,8 @@ LimitAlgo("HybridNew specific options") {
         //                           "Enable importance sampling for null hypothesis (background only)")
         //("importanceSamplingAlt",  boost::program_options::value<bool>(&importanceSamplingAlt_)->default_value(importanceSamplingAlt_),
         //                           "Enable importance sampling for alternative hypothesis (signal plus background)")
+        ("reuseToys", "Generate the toys only at a few anchor values of the POI during the limit search, and reuse them at nearby values weighting each S+B toy by its likelihood ratio (requires frequentist toys)")
+        ("reuseToysMinESS", boost::program_options::value<float>(&reuseToysMinESS_)->default_value(reuseToysMinESS_), "Minimum effective sample size, as a fraction of --toysH, of the reweighted S+B toys for --reuseToys; below it new toys are thrown at the point being tested")
         ("optimizeTestStatistics", boost::program_options::value<bool>(&optimizeTestStatistics_)->default_value(optimizeTestStatistics_),
                                    "Use optimized test statistics if the likelihood is not extended (works for LEP and TEV test statistics).")
         ("optimizeProductPdf",     boost::program_options::value<bool>(&optimizeProductPdf_)->default_value(optimizeProductPdf_),
@@ -215,6 +226,7 @@ void HybridNew::applyOptions(const boost::program_options::variables_map &vm) {
     fullBToys_ = vm.count("fullBToys");
     noUpdateGrid_ = vm.count("noUpdateGrid");
     reportPVal_ = vm.count("pvalue");
+    reuseToys_ = vm.count("reuseToys");
     validateOptions();
 }
 
@@ -262,6 +274,13 @@ void HybridNew::validateOptions() {
         fitNuisances_ = false;
     }
     if (reportPVal_ && workingMode_ != MakeSignificance) throw std::invalid_argument("HybridNew: option --pvalue must go together with --significance");
+    if (gridFormat_ != "objects" && gridFormat_ != "columns") throw std::invalid_argument("HybridNew: option --gridFormat must be 'objects' or 'columns'");
+    if (reuseToys_) {
+        if (genNuisances_ && withSystematics) throw std::invalid_argument("HybridNew: option --reuseToys requires frequentist toys (--generateNuisances=0, e.g. with --frequentist or --LHCmode)");
+        if (!newToyMCSampler_) throw std::invalid_argument("HybridNew: option --reuseToys requires --newToyMCSampler=1");
+        if (fork_) throw std::invalid_argument("HybridNew: option --reuseToys can't be used together with --fork");
+        if (reuseToysMinESS_ <= 0 || reuseToysMinESS_ > 1) throw std::invalid_argument("HybridNew: option --reuseToysMinESS must be in (0, 1]");
+    }
 }
 
 void HybridNew::setupPOI(RooStats::ModelConfig *mc_s) {
@@ -281,6 +300,7 @@ bool HybridNew::run(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::Mode
 
     //Significance::MinimizerSentry minimizerConfig(minimizerType_+","+minimizerAlgo_, minimizerTolerance_); // These defaults should already be configured via the CascadeMinimizer
     perf_totalToysRun_ = 0; // reset performance counter
+    clearToyPools(); // generation snapshots depend on the data
     if (rValues_.getSize() == 0) setupPOI(mc_s);
     switch (workingMode_) {
         case MakeLimit:            return runLimit(w, mc_s, mc_b, data, limit, limitErr, hint);
@@ -312,15 +332,7 @@ bool HybridNew::runSignificance(RooWorkspace *w, RooStats::ModelConfig *mc_s, Ro
         std::cerr << "Hypotest failed" << std::endl;
         return false;
     }
-    if (saveHybridResult_) {
-        TString name = TString::Format("HypoTestResult_mh%g",mass_);
-        for (RooAbsArg *rIn : rValues_) {
-            name += Form("_%s%g", rIn->GetName(), static_cast<RooRealVar*>(rIn)->getVal());
-        }
-        name += Form("_%u", RooRandom::integer(std::numeric_limits<UInt_t>::max() - 1));
-        writeToysHere->WriteTObject(new HypoTestResult(*hcResult), name);
-        if (verbose) std::cout << "Hybrid result saved as " << name << " in " << writeToysHere->GetFile()->GetName() << " : " << writeToysHere->GetPath() << std::endl;
-    }
+    if (saveHybridResult_) saveHybridResult(*hcResult, rValues_);
     if (verbose > 1) {
         std::cout << "Observed test statistic in data: " << hcResult->GetTestStatisticData() << std::endl;
         std::cout << "Background-only toys sampled:     " << hcResult->GetNullDistribution()->GetSize() << std::endl;
@@ -679,6 +691,154 @@ bool HybridNew::runTestStatistics(RooWorkspace *w, RooStats::ModelConfig *mc_s,
     return true;
 }
 
+void HybridNew::setupFeldmanCousins(unsigned int nToys, double clsAccuracy, double rAbsAccuracy, double rRelAccuracy, unsigned int rays, unsigned int fork, bool reuseToys, float mass) {
+    // same settings as --LHCmode LHC-feldman-cousins
+    genNuisances_ = 0; genGlobalObs_ = withSystematics; fitNuisances_ = withSystematics;
+    testStat_ = "PL";
+    rule_ = "Pmu";
+    doFC_ = true;
+    workingMode_ = MakeLimit;
+    nToys_ = nToys; clsAccuracy_ = clsAccuracy;
+    rAbsAccuracy_ = rAbsAccuracy; rRelAccuracy_ = rRelAccuracy;
+    fcRays_ = rays; fork_ = fork; reuseToys_ = reuseToys;
+    readHybridResults_ = false; saveHybridResult_ = false;
+    mass_ = mass;
+    validateOptions();
+    EPS = ROOT::Math::MinimizerOptions::DefaultTolerance();
+}
+
+bool HybridNew::runFeldmanCousins(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint) {
+    RooFitGlobalKillSentry silence(verbose <= 1 ? RooFit::FATAL : RooFit::DEBUG);
+    perf_totalToysRun_ = 0;
+    clearToyPools();
+
+    RooArgList pois(*mc_s->GetParametersOfInterest());
+    int npoi = pois.getSize();
+    if (npoi > 2) throw std::invalid_argument("HybridNew: Feldman-Cousins regions can be searched for one or two parameters of interest, use HybridNew with --singlePoint on a grid of points for more");
+    if (npoi > 1 && reuseToys_) throw std::invalid_argument("HybridNew: option --reuseToys works only with one parameter of interest");
+    double clsTarget = 1 - cl;
+
+    // the best fit is always inside the region, and its uncertainties set the scale of the search
+    std::vector<double> best(npoi), sigma(npoi);
+    w->loadSnapshot("clean");
+    utils::setAllConstant(pois, false);
+    {
+        RooArgSet constraints; if (withSystematics) constraints.add(*mc_s->GetNuisanceParameters());
+        std::unique_ptr<RooAbsReal> nll = combineCreateNLL(*mc_s->GetPdf(), data, &constraints, /*offset=*/false);
+        CloseCoutSentry sentry(verbose < 3);
+        CascadeMinimizer minim(*nll, CascadeMinimizer::Unconstrained, npoi == 1 ? static_cast<RooRealVar *>(pois.at(0)) : nullptr);
+        minim.minimize(verbose-2);
+    }
+    for (int i = 0; i < npoi; ++i) {
+        RooRealVar *r = static_cast<RooRealVar *>(pois.at(i));
+        best[i]  = r->getVal();
+        sigma[i] = std::max<double>(r->getError(), 0.02 * (r->getMax() - r->getMin()));
+        if (verbose > 0) CombineLogger::instance().log("HybridNew.cc",__LINE__,std::string(Form("Best fit %s = %g +/- %g",r->GetName(),best[i],sigma[i])),__func__);
+    }
+    utils::setAllConstant(pois, true);
+    // asymptotically, the boundary is at this many standard deviations from the best fit
+    double tStart = sqrt(ROOT::Math::chisquared_quantile(cl, npoi));
+
+    std::cout << "\n -- HybridNew -- \n";
+    if (npoi == 1) {
+        RooRealVar *r = static_cast<RooRealVar *>(pois.at(0));
+        std::pair<double,double> edges[2];
+        bool open[2];
+        for (int side = 0; side < 2; ++side) {
+            std::vector<double> direction(1, side == 0 ? -sigma[0] : sigma[0]);
+            double tMax = (side == 0 ? best[0] - r->getMin() : r->getMax() - best[0]) / sigma[0];
+            bool ok = true;
+            std::pair<double,double> t = findBoundaryFC(w, mc_s, mc_b, data, pois, best, direction, tStart, tMax, clsTarget, ok);
+            if (!ok) return false;
+            open[side] = (t.first >= tMax);
+            edges[side] = std::make_pair(best[0] + t.first * direction[0], t.second * sigma[0]);
+        }
+        if (open[0] && open[1]) {
+            CombineLogger::instance().log("HybridNew.cc",__LINE__,std::string(Form("The whole range [%g, %g] of %s is inside the %g %% confidence region",r->getMin(),r->getMax(),r->GetName(),100*cl)),__func__);
+            return false;
+        }
+        CombineLogger::instance().log("HybridNew.cc",__LINE__,std::string(Form("found %g %% confidence regions",100*cl)),__func__);
+        if (open[0])      CombineLogger::instance().log("HybridNew.cc",__LINE__,std::string(Form(" %s < %g (+/- %g) ",r->GetName(),edges[1].first,edges[1].second)),__func__);
+        else if (open[1]) CombineLogger::instance().log("HybridNew.cc",__LINE__,std::string(Form(" %s > %g (+/- %g) ",r->GetName(),edges[0].first,edges[0].second)),__func__);
+        else CombineLogger::instance().log("HybridNew.cc",__LINE__,std::string(Form("  %g (+/- %g) < %s < %g (+/- %g) ",edges[0].first,edges[0].second,r->GetName(),edges[1].first,edges[1].second)),__func__);
+        // Commit the edges to the limit tree, as for the intervals from a grid
+        for (int side = 0; side < 2; ++side) {
+            if (open[side]) continue;
+            limit = edges[side].first; limitErr = edges[side].second; Combine::commitPoint(false, clsTarget);
+        }
+        int main = (lowerLimit_ || open[1] ? 0 : 1);
+        limit = edges[main].first; limitErr = edges[main].second;
+    } else {
+        if (fcPoiValues_.empty()) {
+            fcPoiValues_.resize(npoi);
+            for (int i = 0; i < npoi; ++i) Combine::addBranch(pois.at(i)->GetName(), &fcPoiValues_[i], (std::string(pois.at(i)->GetName())+"/F").c_str());
+        }
+        CombineLogger::instance().log("HybridNew.cc",__LINE__,std::string(Form("%g %% confidence region, boundary along %u directions from the best fit",100*cl,fcRays_)),__func__);
+        int found = 0;
+        for (unsigned int k = 0; k < fcRays_; ++k) {
+            double phi = 2 * M_PI * k / fcRays_;
+            std::vector<double> direction = { sigma[0] * cos(phi), sigma[1] * sin(phi) };
+            double tMax = std::numeric_limits<double>::infinity();
+            for (int i = 0; i < npoi; ++i) {
+                RooRealVar *r = static_cast<RooRealVar *>(pois.at(i));
+                if (direction[i] > 0) tMax = std::min(tMax, (r->getMax() - best[i]) / direction[i]);
+                else if (direction[i] < 0) tMax = std::min(tMax, (r->getMin() - best[i]) / direction[i]);
+            }
+            bool ok = true;
+            std::pair<double,double> t = findBoundaryFC(w, mc_s, mc_b, data, pois, best, direction, tStart, tMax, clsTarget, ok);
+            if (!ok) continue;
+            for (int i = 0; i < npoi; ++i) fcPoiValues_[i] = best[i] + t.first * direction[i];
+            CombineLogger::instance().log("HybridNew.cc",__LINE__,std::string(Form("  %s = %g, %s = %g (+/- %g along the direction)%s",pois.at(0)->GetName(),fcPoiValues_[0],pois.at(1)->GetName(),fcPoiValues_[1],
+                                                                                    t.second,(t.first >= tMax ? " at the boundary of the range" : ""))),__func__);
+            // limit is the distance from the best fit, in units of the uncertainties
+            limit = t.first; limitErr = t.second; Combine::commitPoint(false, clsTarget);
+            ++found;
+        }
+        if (found == 0) return false;
+    }
+    Combine::toggleGlobalFillTree(false); // all the points have been committed already
+    if (verbose > 1) std::cout << "Total toys: " << perf_totalToysRun_ << std::endl;
+    return true;
+}
+
+std::pair<double,double> HybridNew::findBoundaryFC(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, const RooArgList &pois, const std::vector<double> &origin, const std::vector<double> &direction, double tStart, double tMax, double clsTarget, bool &ok) {
+    RooArgSet point;
+    pois.snapshot(point);
+    double step = 0;
+    for (double d : direction) step = std::max(step, fabs(d));
+    // the toys are thrown adaptively, only until the point is known to be inside or outside
+    auto inside = [&](double t) -> bool {
+        for (int i = 0, n = origin.size(); i < n; ++i) {
+            RooRealVar *r = static_cast<RooRealVar *>(point.find(pois.at(i)->GetName()));
+            r->setVal(origin[i] + t * direction[i]);
+        }
+        std::pair<double,double> pmu = eval(w, mc_s, mc_b, data, point, true, clsTarget);
+        if (pmu.second < 0) ok = false;
+        if (verbose > 0) CombineLogger::instance().log("HybridNew.cc",__LINE__,std::string(Form("  t = %g: %s = %6.4f +/- %6.4f",t,rule_.c_str(),pmu.first,pmu.second)),__func__);
+        return pmu.first > clsTarget;
+    };
+
+    // bracket the boundary, moving away from the origin (which is inside)
+    double tIn = 0, tOut = -1, t = std::min(tStart, tMax);
+    while (ok) {
+        if (!inside(t)) { tOut = t; break; }
+        tIn = t;
+        if (t >= tMax) break;
+        t = std::min(1.5 * t, tMax);
+    }
+    if (!ok) return std::make_pair(0., 0.);
+    if (tOut < 0) return std::make_pair(tMax, 0.);
+
+    // bisect it, down to the requested accuracy on the parameters
+    while (ok) {
+        double tMid = 0.5 * (tIn + tOut), scale = 0;
+        for (int i = 0, n = origin.size(); i < n; ++i) scale = std::max(scale, fabs(origin[i] + tMid * direction[i]));
+        if (0.5 * (tOut - tIn) * step < std::max(rAbsAccuracy_, rRelAccuracy_ * scale)) break;
+        if (inside(tMid)) tIn = tMid; else tOut = tMid;
+    }
+    return std::make_pair(0.5 * (tIn + tOut), 0.5 * (tOut - tIn));
+}
+
 std::pair<double, double> HybridNew::eval(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double rVal, bool adaptive, double clsTarget) {
     RooArgSet rValues;
     mc_s->GetParametersOfInterest()->snapshot(rValues);
@@ -1153,15 +1313,7 @@ HybridNew::eval(RooStats::HybridCalculator &hc, const RooAbsCollection & rVals,
         c1->Print(plot_.c_str());
         delete c1;
     }
-    if (saveHybridResult_) {
-        TString name = TString::Format("HypoTestResult_mh%g",mass_);
-        for (RooAbsArg * rIn : rVals) {
-            name += Form("_%s%g", rIn->GetName(), static_cast<RooRealVar*>(rIn)->getVal());
-        }
-        name += Form("_%u", RooRandom::integer(std::numeric_limits<UInt_t>::max() - 1));
-        writeToysHere->WriteTObject(new HypoTestResult(*hcResult), name);
-        if (verbose) std::cout << "Hybrid result saved as " << name << " in " << writeToysHere->GetFile()->GetName() << " : " << writeToysHere->GetPath() << std::endl;
-    }
+    if (saveHybridResult_) saveHybridResult(*hcResult, rVals);
 
     return cls;
 }
@@ -1327,6 +1479,7 @@ void HybridNew::applySignalQuantile(RooStats::HypoTestResult &hcres) {
 
 RooStats::HypoTestResult * HybridNew::evalGeneric(RooStats::HybridCalculator &hc, bool noFork) {
     if (fork_ && !noFork) return evalWithFork(hc);
+    else if (reuseToys_ && workingMode_ == MakeLimit) return evalWithToyPool(hc);
     else {
         TStopwatch timer; timer.Start();
         RooStats::HypoTestResult * ret = hc.GetHypoTest();
@@ -1360,9 +1513,9 @@ RooStats::HypoTestResult * HybridNew::evalWithFork(RooStats::HybridCalculator &h
         for (ich = 0; ich < fork_; ++ich) {
             TFile *f = TFile::Open(TString::Format("%s.%d.root", tmpfile, ich));
             if (f == 0) throw std::runtime_error(TString::Format("Child didn't leave output file %s.%d.root", tmpfile, ich).Data());
-            RooStats::HypoTestResult *res = dynamic_cast<RooStats::HypoTestResult *>(f->Get("result"));
-            if (res == 0)  throw std::runtime_error(TString::Format("Child output file %s.%d.root is corrupted", tmpfile, ich).Data());
-            if (result.get()) result->Append(res); else result.reset(dynamic_cast<RooStats::HypoTestResult *>(res->Clone()));
+            std::unique_ptr<RooStats::HypoTestResult> res(HypoTestResultGrid::read(f, RooArgSet(), mass_));
+            if (res.get() == 0)  throw std::runtime_error(TString::Format("Child output file %s.%d.root is corrupted", tmpfile, ich).Data());
+            if (result.get()) result->Append(res.get()); else result = std::move(res);
             f->Close();
             unlink(TString::Format("%s.%d.root",    tmpfile, ich).Data());
             unlink(TString::Format("%s.%d.out.txt", tmpfile, ich).Data());
@@ -1381,7 +1534,9 @@ RooStats::HypoTestResult * HybridNew::evalWithFork(RooStats::HybridCalculator &h
         CombineLogger::instance().log("HybridNew.cc",__LINE__,std::string(Form("  I am child %d, seed %d",ich, newSeeds[ich])),__func__);
         RooStats::HypoTestResult *hcResult = evalGeneric(hc, /*noFork=*/true);
         TFile *f = TFile::Open(TString::Format("%s.%d.root", tmpfile, ich), "RECREATE");
-        f->WriteTObject(hcResult, "result");
+        HypoTestResultGrid childGrid{RooArgSet()};
+        childGrid.fill(*hcResult, RooArgSet(), mass_);
+        childGrid.write(f);
         f->ls();
         f->Close();
         fflush(stdout); fflush(stderr);
@@ -1394,6 +1549,212 @@ RooStats::HypoTestResult * HybridNew::evalWithFork(RooStats::HybridCalculator &h
     return result.release();
 }
 
+RooStats::HypoTestResult * HybridNew::evalWithToyPool(RooStats::HybridCalculator &hc) {
+    TStopwatch timer; timer.Start();
+    const RooStats::ModelConfig &mcSB = *hc.GetAlternateModel(), &mcB = *hc.GetNullModel();
+    RooStats::ToyMCSampler *sampler = dynamic_cast<RooStats::ToyMCSampler *>(hc.GetTestStatSampler());
+    if (sampler == 0) throw std::logic_error("HybridNew: --reuseToys needs a ToyMCSampler");
+    RooStats::TestStatistic &qvar = *sampler->GetTestStatistic();
+    RooAbsData &data = const_cast<RooAbsData &>(*hc.GetData());
+    bool isProfile = (testStat_ == "LHC" || testStat_ == "LHCFC"  || testStat_ == "Profile");
+
+    const char *poiName = mcSB.GetParametersOfInterest()->first()->GetName();
+    double rVal = mcSB.GetSnapshot()->getRealValue(poiName);
+    RooArgSet nullPOI(*mcB.GetSnapshot());
+    if (isProfile) nullPOI.setRealValue(poiName, rVal);
+
+    // same number of toys as requested from the HybridCalculator in create() and eval()
+    bool more = (rVal == lastPoolTarget_);
+    int nSB = nToys_, nB;
+    if (more) nB = CLs_ ? int(0.25*nToys_ + 1) : 1;
+    else nB = fullBToys_ ? nToys_ : (CLs_ ? int(0.25*nToys_) : int(0.01*nToys_)+1);
+    if (expectedFromGrid_ && (fabs(0.5-quantileForExpectedFromGrid_)>=0.4) ) nB = nToys_;
+    lastPoolTarget_ = rVal;
+
+    // save the state of the parameters and global observables, to restore it at the end
+    std::unique_ptr<RooArgSet> allParams(mcSB.GetPdf()->getParameters(data));
+    RooArgSet saveAll; allParams->snapshot(saveAll);
+    const RooArgSet *gobs = (mcSB.GetGlobalObservables() && mcSB.GetGlobalObservables()->getSize()) ? mcSB.GetGlobalObservables() : 0;
+
+    double qData = qvar.Evaluate(data, nullPOI);
+    allParams->assignValueOnly(saveAll);
+
+    // pick the S+B toys: for a new point, reweight the pool with the closest anchor if it has a large enough
+    // effective sample size, otherwise (or when more toys are requested at this point) throw new ones here
+    std::vector<double> weightsSB;
+    ToyPool *poolSB = 0, freshSB, freshB;
+    if (!more && !sbToyPools_.empty()) {
+        std::map<double, ToyPool>::iterator closest = sbToyPools_.lower_bound(rVal);
+        if (closest == sbToyPools_.end() || (closest != sbToyPools_.begin() && rVal - std::prev(closest)->first < closest->first - rVal)) --closest;
+        double ess = 0;
+        weightsSB = toyPoolWeights(closest->second, *mcSB.GetSnapshot(), *mcSB.GetPdf(), gobs, ess);
+        if (verbose > 1) CombineLogger::instance().log("HybridNew.cc",__LINE__,std::string(Form("Reweighting %d toys from %s = %g to %s = %g: effective sample size %.1f",int(weightsSB.size()),poiName,closest->first,poiName,rVal,ess)),__func__);
+        if (ess >= reuseToysMinESS_ * nSB) poolSB = &closest->second;
+    }
+    if (poolSB == 0) {
+        if (more) {
+            poolSB = &freshSB;
+        } else {
+            poolSB = &sbToyPools_[rVal];
+            poolSB->clear();
+        }
+        fillToyPool(*poolSB, *sampler, mcSB, nSB);
+        if (more) {
+            ToyPool &anchor = sbToyPools_[rVal];
+            if (anchor.toys.empty()) mcSB.GetSnapshot()->snapshot(anchor.genSnapshot);
+        }
+        weightsSB.assign(poolSB->toys.size(), 1.0);
+    }
+
+    // B-only toys are thrown from a snapshot that does not depend on the POI, so they are reused as they are
+    ToyPool *poolB = &bToyPool_;
+    if (more) {
+        poolB = &freshB;
+        fillToyPool(freshB, *sampler, mcB, nB);
+    } else if (int(bToyPool_.toys.size()) < nB) {
+        fillToyPool(bToyPool_, *sampler, mcB, nB - bToyPool_.toys.size());
+    }
+
+    // evaluate the test statistic for this point on all toys. Each toy still needs a conditional fit at this
+    // point, but with the LHC test statistic its unconditional fit is done only once, and the conditional fit
+    // starts from the one at the previous point
+    ProfiledLikelihoodTestStatOpt *plts = dynamic_cast<ProfiledLikelihoodTestStatOpt *>(&qvar);
+    unsigned long fitsBefore = plts ? plts->nFits() : 0;
+    RooArgSet gobsVars; if (gobs) gobsVars.add(*gobs);
+    std::vector<double> qSB, wSB, qB, wB;
+    for (unsigned int i = 0, n = poolSB->toys.size(); i < n; ++i) {
+        // the weights average to one: toys below 1e-3 carry at most 0.1% of the total weight, and are not worth a fit
+        if (weightsSB[i] < 1e-3) continue;
+        if (gobs) gobsVars.assignValueOnly(*poolSB->globalObs[i]);
+        if (plts) plts->setFitCache(poolSB->fits[i].get());
+        double q = qvar.Evaluate(*poolSB->toys[i], nullPOI);
+        allParams->assignValueOnly(saveAll);
+        if (q != q) continue;
+        qSB.push_back(q); wSB.push_back(weightsSB[i]);
+    }
+    for (unsigned int i = 0, n = std::min<int>(nB, poolB->toys.size()); i < n; ++i) {
+        if (gobs) gobsVars.assignValueOnly(*poolB->globalObs[i]);
+        if (plts) plts->setFitCache(poolB->fits[i].get());
+        double q = qvar.Evaluate(*poolB->toys[i], nullPOI);
+        allParams->assignValueOnly(saveAll);
+        if (q != q) continue;
+        qB.push_back(q); wB.push_back(1.0);
+    }
+    if (plts) plts->setFitCache(nullptr);
+    if (gobs) gobsVars.assignValueOnly(saveAll);
+    if (verbose > 0 || runtimedef::get("HybridNew_Timing")) {
+        double sumw = 0, sumw2 = 0;
+        for (double w : wSB) { sumw += w; sumw2 += w*w; }
+        CombineLogger::instance().log("HybridNew.cc",__LINE__,std::string(Form("%s = %g: %d s+b toys (effective %.1f) and %d b-only toys, with %s fits, in %.1f s",
+                poiName, rVal, int(qSB.size()), sumw2 > 0 ? sumw*sumw/sumw2 : 0., int(qB.size()),
+                plts ? std::to_string(plts->nFits() - fitsBefore).c_str() : "unknown number of", timer.RealTime())),__func__);
+    }
+
+    if (more) {
+        // keep the new toys, so that they can be reused at the next points
+        ToyPool &anchor = sbToyPools_[rVal];
+        for (unsigned int i = 0, n = freshSB.toys.size(); i < n; ++i) {
+            anchor.toys.push_back(std::move(freshSB.toys[i]));
+            anchor.globalObs.push_back(std::move(freshSB.globalObs[i]));
+            anchor.fits.push_back(std::move(freshSB.fits[i]));
+        }
+        for (unsigned int i = 0, n = freshB.toys.size(); i < n; ++i) {
+            bToyPool_.toys.push_back(std::move(freshB.toys[i]));
+            bToyPool_.globalObs.push_back(std::move(freshB.globalObs[i]));
+            bToyPool_.fits.push_back(std::move(freshB.fits[i]));
+        }
+    }
+
+    RooStats::HypoTestResult *ret = new RooStats::HypoTestResult("HybridNew_pooledToys");
+    ret->SetPValueIsRightTail(qvar.PValueIsRightTail());
+    ret->SetTestStatisticData(qData);
+    ret->SetNullDistribution(new RooStats::SamplingDistribution("null", "null", qB, wB));
+    ret->SetAltDistribution(new RooStats::SamplingDistribution("alt", "alt", qSB, wSB));
+    return ret;
+}
+
+void HybridNew::fillToyPool(ToyPool &pool, RooStats::ToyMCSampler &sampler, const RooStats::ModelConfig &model, int nToys) {
+    std::unique_ptr<RooArgSet> modelVars(model.GetPdf()->getVariables());
+    if (pool.toys.empty()) {
+        pool.genSnapshot.removeAll();
+        model.GetSnapshot()->snapshot(pool.genSnapshot);
+    }
+    const RooArgSet *gobs = model.GetGlobalObservables();
+    sampler.SetObservables(*model.GetObservables());
+    sampler.SetPdf(*model.GetPdf()); // also resets the global observables generated for the previous model
+    RooArgSet paramPoint(*model.GetParametersOfInterest());
+    modelVars->assignValueOnly(pool.genSnapshot);
+    for (int i = 0; i < nToys; ++i) {
+        double weight = 1.0;
+        std::unique_ptr<RooAbsData> toy(sampler.GenerateToyData(paramPoint, weight));
+        // the optimized sampler recycles the memory of its toys, so they must be copied
+        RooArgSet vars(*toy->get()), varsPlusWeight(vars);
+        RooRealVar weightVar("_weight_", "", 1.0);
+        varsPlusWeight.add(weightVar);
+        RooDataSet *copy = new RooDataSet(TString::Format("%s_pool%d", toy->GetName(), int(pool.toys.size())), "", varsPlusWeight, RooFit::WeightVar("_weight_"));
+        for (int j = 0, n = toy->numEntries(); j < n; ++j) {
+            vars = *toy->get(j);
+            copy->add(vars, toy->weight());
+        }
+        pool.toys.emplace_back(copy);
+        pool.globalObs.emplace_back(new RooArgSet());
+        if (gobs) gobs->snapshot(*pool.globalObs.back());
+        pool.fits.emplace_back(new ProfiledLikelihoodTestStatOpt::FitCache());
+    }
+}
+
+std::vector<double> HybridNew::toyPoolWeights(ToyPool &pool, const RooAbsCollection &target, RooAbsPdf &pdf, const RooArgSet *globalObs, double &ess) {
+    std::vector<double> logw(pool.toys.size(), 0.0), ret(pool.toys.size(), 0.0);
+    if (pool.toys.empty()) { ess = 0; return ret; }
+    if (poolNLL_.get() == 0 || poolNLLPdf_ != &pdf) {
+        poolNLL_ = combineCreateNLL(pdf, *pool.toys.front(), /*constrain=*/nullptr, /*offset=*/false);
+        poolNLLPdf_ = &pdf;
+        for (auto &p : sbToyPools_) p.second.anchorNLL.clear();
+        bToyPool_.anchorNLL.clear();
+    }
+    std::unique_ptr<RooArgSet> params(pdf.getParameters(*pool.toys.front()));
+    RooArgSet saveParams; params->snapshot(saveParams);
+    RooArgSet gobsVars; if (globalObs) gobsVars.add(*globalObs);
+    // both likelihoods of a toy are computed here with the same NLL object, so that the
+    // zero points and constant terms in it cancel in the ratio
+    double maxlogw = -std::numeric_limits<double>::infinity();
+    for (unsigned int i = 0, n = pool.toys.size(); i < n; ++i) {
+        if (globalObs) gobsVars.assignValueOnly(*pool.globalObs[i]);
+        poolNLL_->setData(*pool.toys[i], false);
+        // the NLL at the anchor does not depend on the target, so it is computed once per toy
+        if (i >= pool.anchorNLL.size()) {
+            params->assignValueOnly(pool.genSnapshot);
+            pool.anchorNLL.push_back(poolNLL_->getVal());
+        }
+        double nllAnchor = pool.anchorNLL[i];
+        params->assignValueOnly(target);
+        double nllTarget = poolNLL_->getVal();
+        logw[i] = nllAnchor - nllTarget;
+        if (logw[i] != logw[i]) logw[i] = -std::numeric_limits<double>::infinity();
+        maxlogw = std::max(maxlogw, logw[i]);
+    }
+    params->assignValueOnly(saveParams);
+    if (globalObs) gobsVars.assignValueOnly(saveParams);
+    // normalize the weights to an average of one, as for freshly generated toys
+    double sumw = 0, sumw2 = 0;
+    for (unsigned int i = 0, n = ret.size(); i < n; ++i) {
+        ret[i] = std::isfinite(maxlogw) ? std::exp(logw[i] - maxlogw) : 0.0;
+        sumw += ret[i]; sumw2 += ret[i]*ret[i];
+    }
+    ess = (sumw2 > 0 ? sumw*sumw/sumw2 : 0);
+    if (sumw > 0) {
+        for (double &w : ret) w *= ret.size()/sumw;
+    }
+    return ret;
+}
+
+void HybridNew::clearToyPools() {
+    sbToyPools_.clear();
+    bToyPool_.clear(); bToyPool_.genSnapshot.removeAll();
+    poolNLL_.reset(); poolNLLPdf_ = nullptr;
+    lastPoolTarget_ = std::numeric_limits<double>::quiet_NaN();
+}
+
 #if 0
 /// Another implementation of frequentist toy tossing without RooStats.
 /// Can use as a cross-check if needed
@@ -1474,6 +1835,7 @@ RooStats::HypoTestResult * HybridNew::readToysFromFile(const RooAbsCollection &
     }
     if (verbose) std::cout << std::endl;
     std::unique_ptr<RooStats::HypoTestResult> ret;
+    if (HypoTestResultGrid::exists(toyDir)) ret.reset(HypoTestResultGrid::read(toyDir, rVals, mass_, verbose));
     TIter next(toyDir->GetListOfKeys()); TKey *k;
     while ((k = (TKey *) next()) != 0) {
         if (TString(k->GetName()).Index(prefix1) != 0 && TString(k->GetName()).Index(prefix2) != 0) continue;
@@ -1513,11 +1875,30 @@ RooStats::HypoTestResult * HybridNew::readToysFromFile(const RooAbsCollection &
     return ret.release();
 }
 
+void HybridNew::saveHybridResult(const RooStats::HypoTestResult &result, const RooAbsCollection & rVals) {
+    if (gridFormat_ == "columns") {
+        if (gridWriter_.get() == 0) gridWriter_.reset(new HypoTestResultGrid(rVals));
+        gridWriter_->fill(result, rVals, mass_);
+        gridWriter_->write(writeToysHere);
+        if (verbose) std::cout << "Hybrid result saved in " << HypoTestResultGrid::treeName() << " in " << writeToysHere->GetFile()->GetName() << " : " << writeToysHere->GetPath() << std::endl;
+        return;
+    }
+    TString name = TString::Format("HypoTestResult_mh%g",mass_);
+    for (RooAbsArg * rIn : rVals) {
+        name += Form("_%s%g", rIn->GetName(), static_cast<RooRealVar*>(rIn)->getVal());
+    }
+    name += Form("_%u", RooRandom::integer(std::numeric_limits<UInt_t>::max() - 1));
+    writeToysHere->WriteTObject(new RooStats::HypoTestResult(result), name);
+    if (verbose) std::cout << "Hybrid result saved as " << name << " in " << writeToysHere->GetFile()->GetName() << " : " << writeToysHere->GetPath() << std::endl;
+}
+
 void HybridNew::readGrid(TDirectory *toyDir, double rMin, double rMax) {
     if (rValues_.getSize() != 1) throw std::runtime_error("Running limits with grid only works in one dimension for the moment");
     clearGrid();
 
-    TIter next(toyDir->GetListOfKeys()); TKey *k; const char *poiName = rValues_.first()->GetName();
+    const char *poiName = rValues_.first()->GetName();
+    if (HypoTestResultGrid::exists(toyDir)) HypoTestResultGrid::readAll(toyDir, poiName, mass_, rMin, rMax, grid_, verbose);
+    TIter next(toyDir->GetListOfKeys()); TKey *k;
     while ((k = (TKey *) next()) != 0) {
         TString name(k->GetName());
         if (name.Index("HypoTestResult_mh") == 0) {
@@ -1538,8 +1919,8 @@ void HybridNew::readGrid(TDirectory *toyDir, double rMin, double rMax) {
         RooStats::HypoTestResult *&merge = grid_[rVal];
         if (merge == 0) merge = new RooStats::HypoTestResult(*toy);
         else merge->Append(toy);
-        merge->ResetBit(1);
     }
+    for (auto &point : grid_) point.second->ResetBit(1);
     if (verbose > 1) {
         std::cout << "GRID, as is." << std::endl;
         typedef std::map<double, RooStats::HypoTestResult *>::iterator point;
@@ -1552,7 +1933,25 @@ void HybridNew::readGrid(TDirectory *toyDir, double rMin, double rMax) {
 }
 void HybridNew::updateGridData(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, bool smart, double clsTarget_) {
     typedef std::map<double, RooStats::HypoTestResult *>::iterator point;
-    if (!smart) {
+    if (!smart && testStat_ == "LHC" && optimizeTestStatistics_ && !expectedFromGrid_) {
+        // all the points in one go, sharing the unconstrained fit and following the path of the profiled nuisances
+        std::vector<Double_t> rToUpdate; std::vector<point> pointToUpdate;
+        for (point it = grid_.begin(), ed = grid_.end(); it != ed; ++it) {
+            it->second->ResetBit(1);
+            if (it->first == 0 && CLs_) continue; // as in updateGridPoint
+            rToUpdate.push_back(it->first);
+            pointToUpdate.push_back(it);
+        }
+        if (rToUpdate.empty()) return;
+        Setup setup;
+        std::unique_ptr<RooStats::HybridCalculator> hc = create(w, mc_s, mc_b, data, rToUpdate.back(), setup);
+        RooArgSet nullPOI(*setup.modelConfig_bonly.GetSnapshot());
+        std::vector<Double_t> qVals = ((ProfiledLikelihoodTestStatOpt&)(*setup.qvar)).Evaluate(data, nullPOI, rToUpdate);
+        for (int i = 0, n = rToUpdate.size(); i < n; ++i) {
+            pointToUpdate[i]->second->SetTestStatisticData(qVals[i] - EPS);
+        }
+        if (verbose > 0) std::cout << "Updated the test statistic for data at " << rToUpdate.size() << " points." << std::endl;
+    } else if (!smart) {
         for (point it = grid_.begin(), ed = grid_.end(); it != ed; ++it) {
             it->second->ResetBit(1);
             updateGridPoint(w, mc_s, mc_b, data, it);
@@ -0,0 +1,202 @@
+#include "../interface/HypoTestResultGrid.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <TDirectory.h>
+#include <TString.h>
+#include <TTree.h>
+#include <RooAbsCollection.h>
+#include <RooAbsReal.h>
+#include <RooStats/HypoTestResult.h>
+#include <RooStats/SamplingDistribution.h>
+
+HypoTestResultGrid::HypoTestResultGrid(const RooAbsCollection &pois) :
+    tree_(new TTree(treeName(), "HybridNew test statistic distributions"))
+{
+    tree_->SetDirectory(nullptr);
+    for (RooAbsArg *a : pois) poiNames_.push_back(a->GetName());
+    poiValues_.resize(poiNames_.size());
+    row_.nullValues = &nullValues_; row_.nullWeights = &nullWeights_;
+    row_.altValues  = &altValues_;  row_.altWeights  = &altWeights_;
+    tree_->Branch("mh", &row_.mass, "mh/F");
+    for (unsigned int i = 0, n = poiNames_.size(); i < n; ++i) {
+        tree_->Branch(("poi_"+poiNames_[i]).c_str(), &poiValues_[i], ("poi_"+poiNames_[i]+"/D").c_str());
+    }
+    tree_->Branch("testStat", &row_.testStatData, "testStat/D");
+    tree_->Branch("pValueIsRightTail", &row_.pValueIsRightTail, "pValueIsRightTail/O");
+    tree_->Branch("backgroundIsAlt", &row_.backgroundIsAlt, "backgroundIsAlt/O");
+    tree_->Branch("nullValues",  &row_.nullValues);
+    tree_->Branch("nullWeights", &row_.nullWeights);
+    tree_->Branch("altValues",   &row_.altValues);
+    tree_->Branch("altWeights",  &row_.altWeights);
+}
+
+HypoTestResultGrid::~HypoTestResultGrid() {
+    if (ownTree_) delete tree_;
+}
+
+void HypoTestResultGrid::fill(const RooStats::HypoTestResult &result, const RooAbsCollection &point, float mass) {
+    row_.mass = mass;
+    for (unsigned int i = 0, n = poiNames_.size(); i < n; ++i) {
+        RooAbsReal *poi = dynamic_cast<RooAbsReal *>(point.find(poiNames_[i].c_str()));
+        if (poi == 0) throw std::invalid_argument("HypoTestResultGrid: parameter "+poiNames_[i]+" missing from the point to fill");
+        poiValues_[i] = poi->getVal();
+    }
+    row_.testStatData = result.GetTestStatisticData();
+    row_.pValueIsRightTail = result.GetPValueIsRightTail();
+    row_.backgroundIsAlt = result.GetBackGroundIsAlt();
+    nullValues_.clear(); nullWeights_.clear(); altValues_.clear(); altWeights_.clear();
+    if (result.GetNullDistribution()) {
+        nullValues_  = result.GetNullDistribution()->GetSamplingDistribution();
+        nullWeights_ = result.GetNullDistribution()->GetSampleWeights();
+    }
+    if (result.GetAltDistribution()) {
+        altValues_  = result.GetAltDistribution()->GetSamplingDistribution();
+        altWeights_ = result.GetAltDistribution()->GetSampleWeights();
+    }
+    tree_->Fill();
+}
+
+void HypoTestResultGrid::write(TDirectory *dir) {
+    if (ownTree_) {
+        tree_->SetDirectory(dir);
+        ownTree_ = false;
+    } else if (tree_->GetDirectory() != dir) {
+        throw std::logic_error("HypoTestResultGrid: the grid is already saved in another directory");
+    }
+    // writes the baskets not yet on disk, and replaces the header of the tree
+    tree_->AutoSave("SaveSelf");
+}
+
+bool HypoTestResultGrid::exists(TDirectory *dir) {
+    return dir != 0 && dir->GetKey(treeName()) != 0;
+}
+
+bool HypoTestResultGrid::sameValue(double a, double b) {
+    // same matching as for the names of the HypoTestResult objects
+    return TString::Format("%g", a) == TString::Format("%g", b);
+}
+
+bool HypoTestResultGrid::bind(TTree *tree, Row &row, const std::vector<std::string> &poiNames, std::vector<double> &poiValues) {
+    poiValues.resize(poiNames.size());
+    for (unsigned int i = 0, n = poiNames.size(); i < n; ++i) {
+        if (tree->GetBranch(("poi_"+poiNames[i]).c_str()) == 0) return false;
+        tree->SetBranchAddress(("poi_"+poiNames[i]).c_str(), &poiValues[i]);
+    }
+    tree->SetBranchAddress("mh", &row.mass);
+    tree->SetBranchAddress("testStat", &row.testStatData);
+    tree->SetBranchAddress("pValueIsRightTail", &row.pValueIsRightTail);
+    tree->SetBranchAddress("backgroundIsAlt", &row.backgroundIsAlt);
+    tree->SetBranchAddress("nullValues",  &row.nullValues);
+    tree->SetBranchAddress("nullWeights", &row.nullWeights);
+    tree->SetBranchAddress("altValues",   &row.altValues);
+    tree->SetBranchAddress("altWeights",  &row.altWeights);
+    return true;
+}
+
+void HypoTestResultGrid::Merger::add(const Row &row) {
+    if (entries++ == 0) {
+        testStatData = row.testStatData;
+        pValueIsRightTail = row.pValueIsRightTail;
+        backgroundIsAlt = row.backgroundIsAlt;
+    }
+    nullValues.insert(nullValues.end(), row.nullValues->begin(), row.nullValues->end());
+    nullWeights.insert(nullWeights.end(), row.nullWeights->begin(), row.nullWeights->end());
+    nullWeights.resize(nullValues.size(), 1.0);
+    altValues.insert(altValues.end(), row.altValues->begin(), row.altValues->end());
+    altWeights.insert(altWeights.end(), row.altWeights->begin(), row.altWeights->end());
+    altWeights.resize(altValues.size(), 1.0);
+}
+
+RooStats::HypoTestResult * HypoTestResultGrid::Merger::release() {
+    RooStats::HypoTestResult *ret = new RooStats::HypoTestResult("HypoTestResult");
+    ret->SetPValueIsRightTail(pValueIsRightTail);
+    ret->SetBackgroundAsAlt(backgroundIsAlt);
+    ret->SetTestStatisticData(testStatData);
+    ret->SetNullDistribution(new RooStats::SamplingDistribution("null", "null", nullValues, nullWeights));
+    ret->SetAltDistribution(new RooStats::SamplingDistribution("alt", "alt", altValues, altWeights));
+    return ret;
+}
+
+RooStats::HypoTestResult * HypoTestResultGrid::read(TDirectory *dir, const RooAbsCollection &point, float mass, int verbose) {
+    TTree *tree = dir ? dynamic_cast<TTree *>(dir->Get(treeName())) : 0;
+    if (tree == 0) return 0;
+    std::vector<std::string> poiNames; std::vector<double> target;
+    for (RooAbsArg *a : point) {
+        if (tree->GetBranch((std::string("poi_")+a->GetName()).c_str()) == 0) continue;
+        poiNames.push_back(a->GetName());
+        target.push_back(static_cast<RooAbsReal *>(a)->getVal());
+    }
+    Row row; std::vector<double> poiValues;
+    bind(tree, row, poiNames, poiValues);
+
+    // first pass: read only the index columns, to find the entries at this point
+    std::vector<Long64_t> selected;
+    tree->SetBranchStatus("*", 0);
+    tree->SetBranchStatus("mh", 1);
+    for (const std::string &name : poiNames) tree->SetBranchStatus(("poi_"+name).c_str(), 1);
+    for (Long64_t i = 0, n = tree->GetEntries(); i < n; ++i) {
+        tree->GetEntry(i);
+        if (!sameValue(row.mass, mass)) continue;
+        bool match = true;
+        for (unsigned int j = 0, m = target.size(); j < m && match; ++j) match = sameValue(poiValues[j], target[j]);
+        if (match) selected.push_back(i);
+    }
+
+    // second pass: read and merge the distributions of the selected entries
+    tree->SetBranchStatus("*", 1);
+    Merger merger;
+    for (Long64_t i : selected) {
+        tree->GetEntry(i);
+        merger.add(row);
+    }
+    if (verbose > 1) std::cout << "Read " << selected.size() << " entries out of " << tree->GetEntries() << " from " << treeName() << std::endl;
+    RooStats::HypoTestResult *ret = merger.entries ? merger.release() : 0;
+    tree->ResetBranchAddresses();
+    delete row.nullValues; delete row.nullWeights; delete row.altValues; delete row.altWeights;
+    delete tree;
+    return ret;
+}
+
+void HypoTestResultGrid::readAll(TDirectory *dir, const char *poiName, float mass, double min, double max, std::map<double, RooStats::HypoTestResult *> &grid, int verbose) {
+    TTree *tree = dir ? dynamic_cast<TTree *>(dir->Get(treeName())) : 0;
+    if (tree == 0) return;
+    std::vector<std::string> poiNames(1, poiName);
+    Row row; std::vector<double> poiValues;
+    if (!bind(tree, row, poiNames, poiValues)) {
+        std::cerr << "WARNING: " << treeName() << " has no column for parameter " << poiName << ", it will be skipped" << std::endl;
+        delete tree;
+        return;
+    }
+
+    std::map<double, std::vector<Long64_t>> selected;
+    tree->SetBranchStatus("*", 0);
+    tree->SetBranchStatus("mh", 1);
+    tree->SetBranchStatus(("poi_"+poiNames[0]).c_str(), 1);
+    for (Long64_t i = 0, n = tree->GetEntries(); i < n; ++i) {
+        tree->GetEntry(i);
+        if (!sameValue(row.mass, mass)) continue;
+        // round as in the names of the HypoTestResult objects, so that the two can be merged
+        double val = atof(TString::Format("%g", poiValues[0]).Data());
+        if (val < min || val > max) continue;
+        selected[val].push_back(i);
+    }
+
+    tree->SetBranchStatus("*", 1);
+    for (auto &point : selected) {
+        Merger merger;
+        for (Long64_t i : point.second) {
+            tree->GetEntry(i);
+            merger.add(row);
+        }
+        std::unique_ptr<RooStats::HypoTestResult> res(merger.release());
+        RooStats::HypoTestResult *&merge = grid[point.first];
+        if (merge == 0) merge = res.release();
+        else merge->Append(res.get());
+        if (verbose > 2) std::cout << "  Read " << point.second.size() << " entries for " << poiName << " = " << point.first << std::endl;
+    }
+    tree->ResetBranchAddresses();
+    delete row.nullValues; delete row.nullWeights; delete row.altValues; delete row.altWeights;
+    delete tree;
+}
@@ -0,0 +1,153 @@
+#include "../interface/LimitTreeWriter.h"
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <TDirectory.h>
+#include <TTree.h>
+#include <ROOT/RConfig.hxx> // for ROOT_VERSION
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,36,0)
+#include <ROOT/RNTupleModel.hxx>
+#include <ROOT/RNTupleWriter.hxx>
+struct LimitTreeWriter::RNTupleOutput {
+    std::unique_ptr<ROOT::RNTupleWriter> writer;
+};
+
+namespace {
+    // model is either the RNTupleModel, or the updater of the model once the RNTuple is being written
+    template<typename Model>
+    std::shared_ptr<void> makeField(Model &model, char type, const std::string &name) {
+        switch (type) {
+            case 'D': return model.template MakeField<double>(name);
+            case 'F': return model.template MakeField<float>(name);
+            case 'I': return model.template MakeField<std::int32_t>(name);
+            case 'O': return model.template MakeField<bool>(name);
+            case 'S': return model.template MakeField<std::string>(name);
+        }
+        return std::shared_ptr<void>();
+    }
+}
+#else
+struct LimitTreeWriter::RNTupleOutput {
+};
+#endif
+
+LimitTreeWriter::LimitTreeWriter(TDirectory *dir, const char *name, const char *title, Format format) :
+    dir_(dir),
+    name_(name),
+    format_(format)
+{
+    if (format_ == TTreeFormat) {
+        TDirectory::TContext ctx(dir_);
+        tree_ = new TTree(name, title);
+    } else {
+#if ROOT_VERSION_CODE < ROOT_VERSION(6,36,0)
+        throw std::invalid_argument("LimitTreeWriter: the RNTuple output format requires ROOT 6.36 or later");
+#endif
+        rntuple_.reset(new RNTupleOutput());
+    }
+}
+
+LimitTreeWriter::~LimitTreeWriter()
+{
+}
+
+LimitTreeWriter::Format LimitTreeWriter::parseFormat(const std::string &name)
+{
+    if (name == "ttree" || name == "TTree") return TTreeFormat;
+    if (name == "rntuple" || name == "RNTuple") return RNTupleFormat;
+    throw std::invalid_argument("LimitTreeWriter: unknown output format '"+name+"', supported are 'ttree' and 'rntuple'");
+}
+
+LimitTreeWriter::Column & LimitTreeWriter::addColumn_(const char *name, void *address, char type)
+{
+    if (closed_) throw std::logic_error(std::string("LimitTreeWriter: can't add column ")+name+" after write");
+    columns_.push_back(Column());
+    Column &col = columns_.back();
+    col.name = name;
+    col.type = type;
+    col.address = address;
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,36,0)
+    if (rntuple_ && rntuple_->writer) {
+        // late column: extend the model of the RNTuple being written, the earlier entries get the default value
+        auto updater = rntuple_->writer->CreateModelUpdater();
+        updater->BeginUpdate();
+        col.field = makeField(*updater, type, col.name);
+        updater->CommitUpdate();
+    }
+#endif
+    return col;
+}
+
+void LimitTreeWriter::addBranch(const char *name, void *address, const char *leaflist)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const char *slash = strrchr(leaflist, '/');
+    char type = slash ? slash[1] : 'F'; // TTree::Branch defaults to float
+    if (type != 'D' && type != 'F' && type != 'I' && type != 'O') {
+        throw std::invalid_argument(std::string("LimitTreeWriter: unsupported type in leaflist ")+leaflist);
+    }
+    addColumn_(name, address, type);
+    if (tree_) tree_->Branch(name, address, leaflist);
+}
+
+void LimitTreeWriter::addBranch(const char *name, std::string *address)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    addColumn_(name, address, 'S');
+    if (tree_) tree_->Branch(name, address);
+}
+
+void LimitTreeWriter::commit()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_) throw std::logic_error("LimitTreeWriter: commit after write");
+    if (tree_) tree_->Fill();
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,36,0)
+    if (rntuple_) {
+        openRNTuple_();
+        for (auto &col : columns_) {
+            switch (col.type) {
+                case 'D': *static_cast<double *>(col.field.get())       = *static_cast<const double *>(col.address); break;
+                case 'F': *static_cast<float *>(col.field.get())        = *static_cast<const float *>(col.address); break;
+                case 'I': *static_cast<std::int32_t *>(col.field.get()) = *static_cast<const Int_t *>(col.address); break;
+                case 'O': *static_cast<bool *>(col.field.get())         = *static_cast<const Bool_t *>(col.address); break;
+                case 'S': *static_cast<std::string *>(col.field.get())  = *static_cast<const std::string *>(col.address); break;
+            }
+        }
+        rntuple_->writer->Fill();
+    }
+#endif
+    ++entries_;
+}
+
+void LimitTreeWriter::openRNTuple_()
+{
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,36,0)
+    if (rntuple_ && !rntuple_->writer) {
+        auto model = ROOT::RNTupleModel::Create();
+        for (auto &col : columns_) col.field = makeField(*model, col.type, col.name);
+        rntuple_->writer = ROOT::RNTupleWriter::Append(std::move(model), name_, *dir_);
+    }
+#endif
+}
+
+void LimitTreeWriter::write()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_) return;
+    openRNTuple_(); // in case there are no entries at all
+    if (tree_) {
+        dir_->WriteTObject(tree_);
+    }
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,36,0)
+    if (rntuple_) rntuple_->writer.reset(); // this commits the dataset to the file
+#endif
+    closed_ = true;
+}
+
+Long64_t LimitTreeWriter::entries() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_;
+}
@@ -1,6 +1,13 @@
 #include "../interface/MarkovChainMC.h"
 #include <stdexcept> 
 #include <cmath> 
+#include <cstdio>
+#include <algorithm>
+#include <limits>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
 #include "TKey.h"
 #include "RooRealVar.h"
 #include "RooArgSet.h"
@@ -8,6 +15,7 @@
 #include "RooWorkspace.h"
 #include "RooFitResult.h"
 #include "RooRandom.h"
+#include "RooDataSet.h"
 #ifndef ROOT_THnSparse
 class THnSparse;
 #define ROOT_THnSparse
@@ -21,6 +29,7 @@ class THnSparse;
 #include "../interface/Combine.h"
 #include "../interface/TestProposal.h"
 #include "../interface/DebugProposal.h"
+#include "../interface/HMCProposal.h"
 #include "../interface/CloseCoutSentry.h"
 #include "../interface/RooFitGlobalKillSentry.h"
 #include "../interface/JacknifeQuantile.h"
@@ -49,11 +58,17 @@ bool MarkovChainMC::saveChain_ = false;
 bool MarkovChainMC::noSlimChain_ = false;
 bool MarkovChainMC::mergeChains_ = false;
 bool MarkovChainMC::readChains_ = false;
+unsigned int MarkovChainMC::parallelChains_ = 0;
+float MarkovChainMC::maxRHat_ = 0;
+float MarkovChainMC::minESS_ = 0;
 float MarkovChainMC::proposalHelperWidthRangeDivisor_ = 5.;
 float MarkovChainMC::proposalHelperUniformFraction_ = 0.0;
 bool  MarkovChainMC::alwaysStepPoi_ = true;
 float MarkovChainMC::cropNSigmas_ = 0;
 int   MarkovChainMC::debugProposal_ = false;
+unsigned int MarkovChainMC::hmcSteps_ = 10;
+unsigned int MarkovChainMC::hmcAdaptSteps_ = 200;
+float MarkovChainMC::hmcStepSize_ = 0.2;
 std::vector<std::string> MarkovChainMC::discreteModelPoints_;
 
 MarkovChainMC::MarkovChainMC() : 
@@ -66,7 +81,7 @@ MarkovChainMC::MarkovChainMC() :
         ("burnInFraction", boost::program_options::value<float>(&burnInFraction_)->default_value(burnInFraction_), "Burn in steps (fraction of total accepted steps)")
         ("adaptiveBurnIn", boost::program_options::value<bool>(&adaptiveBurnIn_)->default_value(adaptiveBurnIn_), "Adaptively determine burn in steps (experimental!).")
         ("proposal", boost::program_options::value<std::string>(&proposalTypeName_)->default_value(proposalTypeName_), 
-                              "Proposal function to use: 'fit', 'uniform', 'gaus', 'ortho' (also known as 'test')")
+                              "Proposal function to use: 'fit', 'uniform', 'gaus', 'ortho' (also known as 'test'), 'hmc'")
         ("runMinos",          "Run MINOS when fitting the data")
         ("noReset",           "Don't reset variable state after fit")
         ("updateHint",        "Update hint with the results")
@@ -81,6 +96,9 @@ MarkovChainMC::MarkovChainMC() :
         ("propHelperUniformFraction", 
                 boost::program_options::value<float>(&proposalHelperUniformFraction_)->default_value(proposalHelperUniformFraction_), 
                 "Add a fraction of uniform proposals to the algorithm")
+        ("hmcSteps", boost::program_options::value<unsigned int>(&hmcSteps_)->default_value(hmcSteps_), "Number of leapfrog steps in each proposal of the 'hmc' proposal")
+        ("hmcStepSize", boost::program_options::value<float>(&hmcStepSize_)->default_value(hmcStepSize_), "Initial leapfrog step size of the 'hmc' proposal, in units of the uncertainties from the fit")
+        ("hmcAdaptSteps", boost::program_options::value<unsigned int>(&hmcAdaptSteps_)->default_value(hmcAdaptSteps_), "Number of initial proposals used to tune the step size of the 'hmc' proposal (should not exceed the burn-in)")
         ("debugProposal", boost::program_options::value<int>(&debugProposal_)->default_value(debugProposal_), "Printout the first N proposals")
         ("cropNSigmas", 
                 boost::program_options::value<float>(&cropNSigmas_)->default_value(cropNSigmas_),
@@ -97,6 +115,12 @@ MarkovChainMC::MarkovChainMC() :
         ("noSlimChain", "Include also nuisance parameters in the chain that is saved to file")
         ("mergeChains", "Merge MarkovChains instead of averaging limits")
         ("readChains", "Just read MarkovChains from toysFile instead of running MCMC directly")
+        ("parallelChains", boost::program_options::value<unsigned int>(&parallelChains_)->default_value(parallelChains_),
+                "Run up to this number of chains at the same time, each in a forked process with its own random seed (0 or 1 = run them one after the other)")
+        ("maxRHat", boost::program_options::value<float>(&maxRHat_)->default_value(maxRHat_),
+                "Stop before running all the tries once the Gelman-Rubin R-hat of the POI across the chains is below this value (e.g. 1.01; 0 = disabled)")
+        ("minESS", boost::program_options::value<float>(&minESS_)->default_value(minESS_),
+                "With --maxRHat, also require the effective sample size of the POI summed over all chains to be above this value")
         ("discreteModelPoints",
                 boost::program_options::value<std::vector<std::string> >(&discreteModelPoints_)->multitoken(),
                 "Define multiple points in a subset of the POI space among which to step discretely (works only with ortho and test proposals)");
@@ -109,6 +133,7 @@ void MarkovChainMC::applyOptions(const boost::program_options::variables_map &vm
     else if (proposalTypeName_ == "gaus")    proposalType_ = MultiGaussianP;
     else if (proposalTypeName_ == "ortho")   proposalType_ = TestP;
     else if (proposalTypeName_ == "test")    proposalType_ = TestP;
+    else if (proposalTypeName_ == "hmc")     proposalType_ = HMCP;
     else {
         std::cerr << "MarkovChainMC: proposal type " << proposalTypeName_ << " not known." << "\n" << options_ << std::endl;
         throw std::invalid_argument("MarkovChainMC: unsupported proposal");
@@ -124,7 +149,8 @@ void MarkovChainMC::applyOptions(const boost::program_options::variables_map &vm
     mergeChains_ = vm.count("mergeChains");
     readChains_  = vm.count("readChains");
 
-    if (mergeChains_ && !saveChain_ && !readChains_) chains_.SetOwner(true);
+    if (parallelChains_ > 1 && saveChain_) throw std::invalid_argument("MarkovChainMC: option --saveChain can't be used together with --parallelChains");
+    if (maxRHat_ != 0 && maxRHat_ <= 1) throw std::invalid_argument("MarkovChainMC: option --maxRHat must be larger than 1");
 }
 
 bool MarkovChainMC::run(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint) {
@@ -148,9 +174,16 @@ bool MarkovChainMC::run(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::
   if (readChains_)  {
       readChains(*mc_s->GetParametersOfInterest(), limits);
   } else {
-      for (unsigned int i = 0; i < tries_; ++i) {
-          if (int nacc = runOnce(w,mc_s,mc_b,data,limit,limitErr,thehint)) {
-              suma += nacc;
+      compactChains_.clear();
+      for (unsigned int i = 0; i < tries_; ) {
+          unsigned int batch = std::min(std::max(parallelChains_, 1u), tries_ - i);
+          unsigned int first = compactChains_.size();
+          if (batch > 1) runParallel(w,mc_s,mc_b,data,thehint,batch);
+          else runOnce(w,mc_s,mc_b,data,limit,limitErr,thehint);
+          i += batch;
+          for (unsigned int j = first, n = compactChains_.size(); j < n; ++j) {
+              limit = compactChains_[j].limit;
+              suma += compactChains_[j].size;
               if (verbose > 1) std::cout << "Limit from this run: " << limit << std::endl;
               limits.push_back(limit);
               if (updateHint_ && tries_ > 1 && limit > savhint) { 
@@ -158,6 +191,10 @@ bool MarkovChainMC::run(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::
                 savhint = limit; thehint = &savhint; 
               }
           }
+          if (maxRHat_ > 0 && i < tries_ && converged()) {
+              if (verbose > 0) std::cout << "Chains converged after " << compactChains_.size() << " tries." << std::endl;
+              break;
+          }
       }
   } 
   num = limits.size();
@@ -167,10 +204,14 @@ bool MarkovChainMC::run(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::
   limitAndError(limit, limitErr, limits);
   if (mergeChains_) {
     std::cout << "Limit from averaging:    " << limit << " +/- " << limitErr << std::endl;
-    // copy constructors don't work, so we just have to leak memory :-(
-    RooStats::MarkovChain *merged = mergeChains(*mc_s->GetParametersOfInterest(), limits);
-    // set burn-in to zero, since steps have already been discarded when merging
-    limitFromChain(limit, limitErr, *mc_s->GetParametersOfInterest(), *merged, 0);
+    if (readChains_) {
+        // copy constructors don't work, so we just have to leak memory :-(
+        RooStats::MarkovChain *merged = mergeChains(*mc_s->GetParametersOfInterest(), limits);
+        // set burn-in to zero, since steps have already been discarded when merging
+        limitFromChain(limit, limitErr, *mc_s->GetParametersOfInterest(), *merged, 0);
+    } else {
+        limit = limitFromCompactChains(limits);
+    }
     std::cout << "Limit from merged chain: " << limit << " +/- " << limitErr << std::endl;
   }
   coutSentry.clear();
@@ -181,9 +222,19 @@ bool MarkovChainMC::run(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::
       if (num > 1) {
           std::cout << "Limit: " << r->GetName() <<" < " << limit << " +/- " << limitErr << " @ " << cl * 100 << "% credibility (" << num << " tries)" << std::endl;
           if (verbose > 0 && !readChains_) std::cout << "Average chain acceptance: " << suma << std::endl;
+          if (verbose > 0 && !readChains_) {
+              double ess = 0;
+              for (const CompactChain &c : compactChains_) ess += effectiveSampleSize(c);
+              std::cout << "Gelman-Rubin R-hat: " << gelmanRubin(compactChains_) << ", effective sample size: " << ess << std::endl;
+          }
       } else {
           std::cout << "Limit: " << r->GetName() <<" < " << limit << " @ " << cl * 100 << "% credibility" << std::endl;
       }
+      if (verbose > 0 && !readChains_ && proposalType_ == HMCP) {
+          double ess = 0; long nllEvals = 0;
+          for (const CompactChain &c : compactChains_) { ess += effectiveSampleSize(c); nllEvals += c.nllEvals; }
+          std::cout << "NLL evaluations of the hmc proposal: " << nllEvals << ", per effective sample: " << (ess > 0 ? nllEvals/ess : 0.) << std::endl;
+      }
   }
   return true;
 }
@@ -201,7 +252,7 @@ int MarkovChainMC::runOnce(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStat
   
   w->loadSnapshot("clean");
   std::unique_ptr<RooFitResult> fit(nullptr);
-  if (proposalType_ == FitP || (cropNSigmas_ > 0)) {
+  if (proposalType_ == FitP || proposalType_ == HMCP || (cropNSigmas_ > 0)) {
       CloseCoutSentry coutSentry(verbose <= 1); // close standard output and error, so that we don't flood them with minuit messages
       fit.reset(mc_s->GetPdf()->fitTo(data, RooFit::Save(), RooFit::Minos(runMinos_)));
       coutSentry.clear();
@@ -271,8 +322,13 @@ int MarkovChainMC::runOnce(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStat
         }
         pdfProp = ownedPdfProp.get();
         break;
+    case HMCP:
+        if (verbose) std::cout << "Using Hamiltonian Monte Carlo proposal" << std::endl;
+        ownedPdfProp.reset(new HMCProposal(*mc_s->GetPdf(), data, fit.get(), hmcSteps_, hmcStepSize_, hmcAdaptSteps_));
+        pdfProp = ownedPdfProp.get();
+        break;
   }
-  if (proposalType_ != UniformP) {
+  if (proposalType_ != UniformP && proposalType_ != HMCP) {
       ph.SetUpdateProposalParameters(updateProposalParams_);
       if (proposalHelperUniformFraction_ > 0) ph.SetUniformFraction(proposalHelperUniformFraction_);
   }
@@ -333,16 +389,160 @@ int MarkovChainMC::runOnce(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStat
 
   limit = mcInt->UpperLimit(*r);
 
-  if (saveChain_ || mergeChains_) {
+  if (saveChain_) {
       // Copy-constructors don't work properly, so we just have to leak memory.
       //RooStats::MarkovChain *chain = new RooStats::MarkovChain(*mcInt->GetChain());
       RooStats::MarkovChain *chain = slimChain(*mc_s->GetParametersOfInterest(), *mcInt->GetChain());
-      if (mergeChains_) chains_.Add(chain);
-      if (saveChain_)  writeToysHere->WriteTObject(chain,  TString::Format("MarkovChain_mh%g_%u",mass_, RooRandom::integer(std::numeric_limits<UInt_t>::max() - 1)));
-      return chain->Size();
-  } else {
-      return mcInt->GetChain()->Size();
+      writeToysHere->WriteTObject(chain,  TString::Format("MarkovChain_mh%g_%u",mass_, RooRandom::integer(std::numeric_limits<UInt_t>::max() - 1)));
+  }
+  compactChains_.push_back(compactChain(*mcInt->GetChain(), r->GetName(), limit));
+  if (proposalType_ == HMCP) compactChains_.back().nllEvals = static_cast<HMCProposal &>(*ownedPdfProp).nllEvaluations();
+  return mcInt->GetChain()->Size();
+}
+
+int MarkovChainMC::runParallel(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, const double *hint, unsigned int nchains) const {
+  char tmpfile[999]; snprintf(tmpfile, 998, "%s/mcmc-XXXXXX", P_tmpdir);
+  int fd = mkstemp(tmpfile); close(fd); unlink(tmpfile);
+
+  std::vector<UInt_t> newSeeds(nchains);
+  for (unsigned int ich = 0; ich < nchains; ++ich) newSeeds[ich] = RooRandom::integer(std::numeric_limits<UInt_t>::max()-1);
+  fflush(stdout); fflush(stderr);
+  for (unsigned int ich = 0; ich < nchains; ++ich) {
+      pid_t pid = fork();
+      if (pid == -1) throw std::runtime_error("MarkovChainMC: fork failed");
+      if (pid == 0) { // child: run one chain, and pass it back to the parent through a file
+          RooRandom::randomGenerator()->SetSeed(newSeeds[ich]);
+          bool ok = false;
+          try {
+              double limit, limitErr;
+              ok = runOnce(w,mc_s,mc_b,data,limit,limitErr,hint) && writeCompactChain(TString::Format("%s.%d", tmpfile, ich), compactChains_.back());
+          } catch (std::exception &ex) {
+              std::cerr << "MarkovChainMC: chain " << ich << " failed: " << ex.what() << std::endl;
+          }
+          fflush(stdout); fflush(stderr);
+          _exit(ok ? 0 : 1); // don't run the destructors of the objects owned by the parent (e.g. the output file)
+      }
+  }
+  int cstatus, ret;
+  do {
+      do { ret = waitpid(-1, &cstatus, 0); } while (ret == -1 && errno == EINTR);
+  } while (ret != -1);
+  if (ret == -1 && errno != ECHILD) throw std::runtime_error("Didn't wait for child");
+
+  int nok = 0;
+  for (unsigned int ich = 0; ich < nchains; ++ich) {
+      TString fname = TString::Format("%s.%d", tmpfile, ich);
+      CompactChain chain;
+      if (readCompactChain(fname, chain)) { compactChains_.push_back(chain); ++nok; }
+      else if (verbose > 0) std::cerr << "MarkovChainMC: chain " << ich << " of this batch failed." << std::endl;
+      unlink(fname.Data());
+  }
+  return nok;
+}
+
+MarkovChainMC::CompactChain MarkovChainMC::compactChain(const RooStats::MarkovChain &chain, const char *poiName, double limit) const {
+  CompactChain ret;
+  ret.limit = limit;
+  ret.size  = chain.Size();
+  int burninSteps = adaptiveBurnIn_ ? guessBurnInSteps(chain) : max<int>(burnInSteps_, chain.Size() * burnInFraction_);
+  const RooDataSet *dataset = chain.GetAsConstDataSet();
+  const RooRealVar *r = dynamic_cast<const RooRealVar *>(dataset->get()->find(poiName));
+  if (r == 0) throw std::logic_error(std::string("MarkovChainMC: POI ") + poiName + " not found in the chain");
+  for (int i = std::max(burninSteps, 0), n = dataset->numEntries(); i < n; ++i) {
+      dataset->get(i);
+      ret.poi.push_back(r->getVal());
+      ret.weight.push_back(dataset->weight());
+  }
+  return ret;
+}
+
+bool MarkovChainMC::writeCompactChain(const char *fileName, const CompactChain &chain) {
+  FILE *f = fopen(fileName, "wb");
+  if (f == 0) return false;
+  unsigned long n = chain.poi.size();
+  bool ok = fwrite(&chain.limit, sizeof(double), 1, f) == 1 && fwrite(&chain.size, sizeof(int), 1, f) == 1 && fwrite(&chain.nllEvals, sizeof(long), 1, f) == 1 && fwrite(&n, sizeof(n), 1, f) == 1 &&
+            fwrite(chain.poi.data(), sizeof(double), n, f) == n && fwrite(chain.weight.data(), sizeof(double), n, f) == n;
+  return (fclose(f) == 0) && ok;
+}
+
+bool MarkovChainMC::readCompactChain(const char *fileName, CompactChain &chain) {
+  FILE *f = fopen(fileName, "rb");
+  if (f == 0) return false;
+  unsigned long n = 0;
+  bool ok = fread(&chain.limit, sizeof(double), 1, f) == 1 && fread(&chain.size, sizeof(int), 1, f) == 1 && fread(&chain.nllEvals, sizeof(long), 1, f) == 1 && fread(&n, sizeof(n), 1, f) == 1;
+  if (ok) {
+      chain.poi.resize(n); chain.weight.resize(n);
+      ok = fread(chain.poi.data(), sizeof(double), n, f) == n && fread(chain.weight.data(), sizeof(double), n, f) == n;
+  }
+  fclose(f);
+  return ok;
+}
+
+double MarkovChainMC::gelmanRubin(const std::vector<CompactChain> &chains) {
+  // weighted version of the potential scale reduction factor, where the weights are the multiplicities of the points of the chain
+  int m = 0; double nsum = 0, meanOfMeans = 0, W = 0;
+  std::vector<double> means;
+  for (const CompactChain &c : chains) {
+      double sw = 0, swx = 0, swx2 = 0;
+      for (unsigned int i = 0, n = c.poi.size(); i < n; ++i) { sw += c.weight[i]; swx += c.weight[i]*c.poi[i]; }
+      if (sw <= 1) continue;
+      double mean = swx/sw;
+      for (unsigned int i = 0, n = c.poi.size(); i < n; ++i) swx2 += c.weight[i]*(c.poi[i]-mean)*(c.poi[i]-mean);
+      means.push_back(mean); meanOfMeans += mean;
+      W += swx2/(sw-1); nsum += sw; ++m;
+  }
+  if (m < 2) return std::numeric_limits<double>::infinity();
+  double n = nsum/m;
+  meanOfMeans /= m; W /= m;
+  double B = 0; // this is B/n in the usual notation
+  for (double mean : means) B += (mean - meanOfMeans)*(mean - meanOfMeans);
+  B /= (m - 1);
+  if (W <= 0) return (B > 0 ? std::numeric_limits<double>::infinity() : 1.0);
+  return std::sqrt(((n-1)/n * W + B)/W);
+}
+
+double MarkovChainMC::effectiveSampleSize(const CompactChain &chain) {
+  // chains are not modified once added to compactChains_, so the value is computed only once per chain
+  if (chain.ess >= 0) return chain.ess;
+  // each point stands for a run of repeated steps (the rejected proposals), so work on the runs directly
+  long n = 0; double mean = 0;
+  for (unsigned int i = 0, np = chain.poi.size(); i < np; ++i) {
+      long k = std::max<long>(1, std::lround(chain.weight[i]));
+      n += k; mean += k * chain.poi[i];
+  }
+  if (n < 4) return (chain.ess = n);
+  mean /= n;
+  double var = 0;
+  for (unsigned int i = 0, np = chain.poi.size(); i < np; ++i) {
+      double d = chain.poi[i] - mean;
+      var += std::max<long>(1, std::lround(chain.weight[i])) * d * d;
   }
+  var /= n;
+  if (var <= 0) return (chain.ess = n);
+  // batch means: split the steps in batches of sqrt(n), whose means are nearly independent;
+  // then var(mean) = var(batch means)/nbatch and ESS = n * var / (b * var(batch means)). Cost is O(n points).
+  long b = std::max<long>(1, std::lround(std::sqrt(double(n)))), nb = n / b;
+  if (nb < 2) return (chain.ess = n);
+  double varB = 0, acc = 0; long filled = 0, done = 0;
+  for (unsigned int i = 0, np = chain.poi.size(); i < np && done < nb; ++i) {
+      long k = std::max<long>(1, std::lround(chain.weight[i]));
+      while (k > 0 && done < nb) {
+          long take = std::min(k, b - filled);
+          acc += take * chain.poi[i]; filled += take; k -= take;
+          if (filled == b) { double d = acc/b - mean; varB += d*d; acc = 0; filled = 0; ++done; }
+      }
+  }
+  varB /= (nb - 1);
+  chain.ess = (varB > 0 ? std::min<double>(n, n * var / (b * varB)) : n);
+  return chain.ess;
+}
+
+bool MarkovChainMC::converged() const {
+  if (compactChains_.size() < 2) return false;
+  double rhat = gelmanRubin(compactChains_), ess = 0;
+  for (const CompactChain &c : compactChains_) ess += effectiveSampleSize(c);
+  if (verbose > 1) std::cout << "After " << compactChains_.size() << " chains: R-hat = " << rhat << ", effective sample size = " << ess << std::endl;
+  return rhat < maxRHat_ && ess >= minESS_;
 }
 
 void MarkovChainMC::limitAndError(double &limit, double &limitErr, const std::vector<double> &limitsIn) const {
@@ -400,14 +600,8 @@ void MarkovChainMC::limitAndError(double &limit, double &limitErr, const std::ve
 
 RooStats::MarkovChain *MarkovChainMC::mergeChains(const RooArgSet &poi, const std::vector<double> &limits) const
 {
-    std::vector<double> limitsSorted(limits); std::sort(limitsSorted.begin(), limitsSorted.end());
-    double lmin = limitsSorted.front(), lmax = limitsSorted.back();
-    if (limitsSorted.size() > 5) {
-        int n = limitsSorted.size();
-        double lmedian = limitsSorted[n/2];
-        lmin = lmedian - 2*(+lmedian - limitsSorted[1*n/4]);
-        lmax = lmedian + 2*(-lmedian + limitsSorted[3*n/4]);
-    }
+    double lmin, lmax;
+    mergeRange(limits, lmin, lmax);
     if (chains_.GetSize() == 0) throw std::runtime_error("No chains to merge");
     if (verbose > 1) std::cout << "Will merge " << chains_.GetSize() << " chains." << std::endl;
     RooArgSet pars(poi);
@@ -431,6 +625,44 @@ RooStats::MarkovChain *MarkovChainMC::mergeChains(const RooArgSet &poi, const st
     return merged;
 }
 
+void MarkovChainMC::mergeRange(const std::vector<double> &limits, double &lmin, double &lmax) const
+{
+    std::vector<double> limitsSorted(limits); std::sort(limitsSorted.begin(), limitsSorted.end());
+    lmin = limitsSorted.front(); lmax = limitsSorted.back();
+    if (limitsSorted.size() > 5) {
+        int n = limitsSorted.size();
+        double lmedian = limitsSorted[n/2];
+        lmin = lmedian - 2*(+lmedian - limitsSorted[1*n/4]);
+        lmax = lmedian + 2*(-lmedian + limitsSorted[3*n/4]);
+    }
+}
+
+double MarkovChainMC::limitFromCompactChains(const std::vector<double> &limits) const
+{
+    if (compactChains_.empty()) throw std::runtime_error("No chains to merge");
+    double lmin, lmax;
+    mergeRange(limits, lmin, lmax);
+    // the merged chain is just the list of (value, weight) of all chains in range; the limit is its weighted quantile
+    std::vector<std::pair<double,double> > points; double sumw = 0;
+    for (unsigned int index = 0, n = compactChains_.size(); index < n; ++index) {
+        const CompactChain &c = compactChains_[index];
+        if (limits[index] < lmin || limits[index] > lmax) continue;
+        if (verbose > 1) std::cout << "Adding chain of " << c.poi.size() << " entries after burn-in; individual limit " << limits[index] << std::endl;
+        for (unsigned int i = 0, m = c.poi.size(); i < m; ++i) {
+            points.emplace_back(c.poi[i], c.weight[i]);
+            sumw += c.weight[i];
+        }
+    }
+    if (points.empty()) throw std::runtime_error("No chains to merge");
+    std::sort(points.begin(), points.end());
+    double target = cl * sumw, cumw = 0;
+    for (const std::pair<double,double> &p : points) {
+        cumw += p.second;
+        if (cumw >= target) return p.first;
+    }
+    return points.back().first;
+}
+
 void MarkovChainMC::readChains(const RooArgSet &poi, std::vector<double> &limits)
 {
     double mylim, myerr;
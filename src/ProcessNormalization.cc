@@ -1,6 +1,7 @@
 #include "../interface/ProcessNormalization.h"
 
 #include "../interface/CombineMathFuncs.h"
+#include "../interface/ProcessNormalizationEngine.h"
 
 #include <cmath>
 #include <cassert>
@@ -66,6 +67,13 @@ void ProcessNormalization::fillAsymmKappaVecs() const
 
 Double_t ProcessNormalization::evaluate() const
 {
+    if (engine_) {
+        double norm = nominalValue_ * engine_->logNormalFactor(engineIndex_);
+        for (std::size_t i = 0; i < otherFactorList_.size(); ++i) {
+            norm *= static_cast<RooAbsReal const&>(otherFactorList_[i]).getVal();
+        }
+        return norm;
+    }
     thetaListVec_.resize(thetaList_.size());
     asymmThetaListVec_.resize(asymmThetaList_.size());
     otherFactorListVec_.resize(otherFactorList_.size());
@@ -0,0 +1,137 @@
+#include "../interface/ProcessNormalizationEngine.h"
+#include "../interface/ProcessNormalization.h"
+#include "../interface/CombineMathFuncs.h"
+#include "vectorized.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <RooAbsReal.h>
+#include <RooArgSet.h>
+
+namespace {
+    /// d/dx of x * logKappaForX(x, logKappaLow, logKappaHigh)
+    double asymmLogNormalDerivative(double x, double logKappaLow, double logKappaHigh)
+    {
+        double logKappa = RooFit::Detail::MathFuncs::logKappaForX(x, logKappaLow, logKappaHigh);
+        if (std::abs(x) >= 0.5) return logKappa;
+        // logKappa(x) = avg + halfdiff * h(2x), with h'(t) = 15 (t^2 - 1)^2 / 8
+        double halfdiff = 0.5 * (logKappaHigh + logKappaLow);
+        double twox2 = 4 * x * x;
+        return logKappa + x * halfdiff * 2 * 1.875 * (twox2 - 1) * (twox2 - 1);
+    }
+}
+
+std::vector<ProcessNormalizationEngine *> ProcessNormalizationEngine::engines_;
+
+ProcessNormalizationEngine::ProcessNormalizationEngine(const RooAbsArg &model) :
+    sentry_("ProcessNormalizationEngine_sentry", "")
+{
+    std::unique_ptr<RooArgSet> components(model.getComponents());
+    for (RooAbsArg *arg : *components) {
+        if (auto *proc = dynamic_cast<ProcessNormalization *>(arg)) procs_.push_back(proc);
+    }
+
+    std::map<const RooAbsArg *, uint32_t> columns;
+    auto column = [&](const RooAbsArg &theta) -> uint32_t {
+        auto found = columns.find(&theta);
+        if (found != columns.end()) return found->second;
+        uint32_t col = thetas_.size();
+        columns[&theta] = col;
+        thetaList_.add(theta);
+        thetas_.push_back(static_cast<RooAbsReal *>(const_cast<RooAbsArg *>(&theta)));
+        return col;
+    };
+
+    symRow_.push_back(0); asymRow_.push_back(0); jacRow_.push_back(0);
+    for (uint32_t i = 0, n = procs_.size(); i < n; ++i) {
+        const ProcessNormalization &proc = *procs_[i];
+        std::map<uint32_t, uint32_t> jacEntries; // nuisance -> entry of the jacobian, for this process
+        auto jacEntry = [&](uint32_t col) -> uint32_t {
+            auto found = jacEntries.find(col);
+            if (found != jacEntries.end()) return found->second;
+            uint32_t entry = jacCol_.size();
+            jacEntries[col] = entry;
+            jacCol_.push_back(col);
+            return entry;
+        };
+        for (std::size_t k = 0, nk = proc.thetaList().size(); k < nk; ++k) {
+            uint32_t col = column(proc.thetaList()[k]);
+            symCol_.push_back(col);
+            symLogKappa_.push_back(proc.logKappa()[k]);
+            symJac_.push_back(jacEntry(col));
+        }
+        for (std::size_t k = 0, nk = proc.asymmThetaList().size(); k < nk; ++k) {
+            uint32_t col = column(proc.asymmThetaList()[k]);
+            asymCol_.push_back(col);
+            asymLogKappaLo_.push_back(proc.logAsymmKappa()[k].first);
+            asymLogKappaHi_.push_back(proc.logAsymmKappa()[k].second);
+            asymJac_.push_back(jacEntry(col));
+        }
+        symRow_.push_back(symCol_.size());
+        asymRow_.push_back(asymCol_.size());
+        jacRow_.push_back(jacCol_.size());
+    }
+
+    sentry_.addVars(thetaList_);
+    thetaVals_.resize(thetas_.size());
+    logVal_.resize(procs_.size());
+    expLogVal_.resize(procs_.size());
+
+    for (uint32_t i = 0, n = procs_.size(); i < n; ++i) {
+        procIndex_[procs_[i]] = i;
+        procs_[i]->setEngine(this, i);
+    }
+    engines_.push_back(this);
+}
+
+ProcessNormalizationEngine::~ProcessNormalizationEngine()
+{
+    engines_.erase(std::find(engines_.begin(), engines_.end(), this));
+    for (ProcessNormalization *proc : procs_) {
+        if (proc->engine() != this) continue;
+        // hand it over to the most recent other engine of the same model, if any, so that it stays on the fast path
+        proc->setEngine(nullptr, 0);
+        for (auto it = engines_.rbegin(); it != engines_.rend(); ++it) {
+            auto found = (*it)->procIndex_.find(proc);
+            if (found != (*it)->procIndex_.end()) { proc->setEngine(*it, found->second); break; }
+        }
+    }
+}
+
+void ProcessNormalizationEngine::update() const
+{
+    if (sentry_.good()) return;
+    for (std::size_t j = 0, n = thetas_.size(); j < n; ++j) {
+        thetaVals_[j] = thetas_[j]->getVal();
+    }
+    for (std::size_t i = 0, n = procs_.size(); i < n; ++i) {
+        double logVal = 0.0;
+        for (uint32_t k = symRow_[i], end = symRow_[i+1]; k < end; ++k) {
+            logVal += symLogKappa_[k] * thetaVals_[symCol_[k]];
+        }
+        for (uint32_t k = asymRow_[i], end = asymRow_[i+1]; k < end; ++k) {
+            double x = thetaVals_[asymCol_[k]];
+            logVal += x * RooFit::Detail::MathFuncs::logKappaForX(x, asymLogKappaLo_[k], asymLogKappaHi_[k]);
+        }
+        logVal_[i] = logVal;
+    }
+    vectorized::exps(procs_.size(), logVal_.data(), expLogVal_.data());
+    sentry_.reset();
+}
+
+void ProcessNormalizationEngine::jacobian(std::vector<double> &out) const
+{
+    out.assign(jacCol_.size(), 0.0);
+    update();
+    for (std::size_t i = 0, n = procs_.size(); i < n; ++i) {
+        if (symRow_[i] == symRow_[i+1] && asymRow_[i] == asymRow_[i+1]) continue;
+        double norm = procs_[i]->getVal();
+        for (uint32_t k = symRow_[i], end = symRow_[i+1]; k < end; ++k) {
+            out[symJac_[k]] += norm * symLogKappa_[k];
+        }
+        for (uint32_t k = asymRow_[i], end = asymRow_[i+1]; k < end; ++k) {
+            out[asymJac_[k]] += norm * asymmLogNormalDerivative(thetaVals_[asymCol_[k]], asymLogKappaLo_[k], asymLogKappaHi_[k]);
+        }
+    }
+}
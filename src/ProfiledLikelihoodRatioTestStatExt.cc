@@ -4,6 +4,8 @@
 #include "../interface/CloseCoutSentry.h"
 #include "../interface/CachingNLL.h"
 #include "../interface/utils.h"
+#include <algorithm>
+#include <numeric>
 #include <stdexcept>
 #include <RooRealVar.h>
 #include <RooMinimizer.h>
@@ -193,13 +195,18 @@ Double_t ProfiledLikelihoodTestStatOpt::Evaluate(RooAbsData& data, RooArgSet& /*
     RooRealVar *r   = (RooRealVar *) params_->find(rIn->GetName());
     bool canKeepNLL = createNLLWrapper(*pdf_, data);
     double initialR = rIn->getVal();
+    // the fits of this dataset can only be reused if they were done with the same NLL
+    FitCache *cache = (fitCache_ && canKeepNLL && poi_.getSize() == 1) ? fitCache_ : nullptr;
+    bool cached = cache && cache->nllGeneration == nllGeneration_;
 
     // Perform unconstrained minimization (denominator)
     if (poi_.getSize() == 1) {
         double oldMax = r->getMax();
         if (oneSided_ == oneSidedDef) r->setMin(0); 
         if (oneSided_ != twoSidedDef) {
-            if (initialR == 0 || (oneSided_ != oneSidedDef)) r->removeMax(); else r->setMax(1.1*initialR); 
+            // a fit kept for other values of r must not be limited to r < 1.1*initialR: if the best fit is above
+            // initialR, the test statistic is zero anyway
+            if (initialR == 0 || (oneSided_ != oneSidedDef) || cache) r->removeMax(); else r->setMax(1.1*initialR); 
         }
         r->setVal(initialR == 0 ? (std::isnormal(oldMax) && fabs(oldMax) < 1e28 ? 0.1*oldMax : 0.5) : 0.5*initialR); //best guess
         r->setConstant(false);
@@ -210,8 +217,24 @@ Double_t ProfiledLikelihoodTestStatOpt::Evaluate(RooAbsData& data, RooArgSet& /*
     DBG(DBG_PLTestStat_pars, std::cout << "r before the fit: ") DBG(DBG_PLTestStat_pars, r->Print("")) DBG(DBG_PLTestStat_pars, std::cout << std::endl)
 
     //std::cout << "PERFORMING UNCONSTRAINED FIT " << r->GetName() << " [ " << r->getMin() << " - " << r->getMax() << " ] "<< std::endl;
-    double nullNLL = minNLL(/*constrained=*/false, r);
-    double bestFitR = r->getVal();
+    double nullNLL, bestFitR;
+    if (cached) {
+        *params_ = cache->bestFitState;
+        nullNLL = cache->nullNLL;
+        bestFitR = cache->bestFitR;
+    } else {
+        nullNLL = minNLL(/*constrained=*/false, r);
+        bestFitR = r->getVal();
+    }
+    auto saveUnconditional = [&]() {
+        if (!cache) return;
+        cache->nllGeneration = nllGeneration_;
+        cache->nullNLL = nullNLL;
+        cache->bestFitR = bestFitR;
+        cache->bestFitState.removeAll();
+        params_->snapshot(cache->bestFitState);
+    };
+    if (!cached) saveUnconditional();
 
     DBG(DBG_PLTestStat_pars, (std::cout << "r after the fit: ")) DBG(DBG_PLTestStat_pars, (r->Print(""))) DBG(DBG_PLTestStat_pars, std::cout << std::endl)
     DBG(DBG_PLTestStat_pars, std::cout << "Was evaluated on " << data.GetName() << ": params before snapshot are " << std::endl)
@@ -219,6 +242,8 @@ Double_t ProfiledLikelihoodTestStatOpt::Evaluate(RooAbsData& data, RooArgSet& /*
 
     // Prepare for constrained minimization (numerator)
     if (poi_.getSize() == 1) {
+        // start from the conditional fit at the previous value of r, if there is one
+        if (cached && cache->hasConditional) *params_ = cache->conditionalState;
         r->setVal(initialR); 
         r->setConstant(true);
     } else {
@@ -234,11 +259,18 @@ Double_t ProfiledLikelihoodTestStatOpt::Evaluate(RooAbsData& data, RooArgSet& /*
         //std::cout << "PERFORMING CONSTRAINED FIT " << r->GetName() << " == " << r->getVal() << std::endl;
         if (do_debug) std::cout << "NLL shift from unconstrained fit before re-profiling: " << nll_->getVal() - nullNLL << std::endl;    
         thisNLL = (nfloatingpars > 0 ? minNLL(/*constrained=*/true, r) : nll_->getVal());
+        if (cache && nfloatingpars > 0) {
+            cache->conditionalState.removeAll();
+            params_->snapshot(cache->conditionalState);
+            cache->hasConditional = true;
+        }
         if (thisNLL - nullNLL < -0.02) { 
             DBG(DBG_PLTestStat_main, (printf("  --> constrained fit is better... will repeat unconstrained fit\n")))
             utils::setAllConstant(poiParams_,false);
+            if (cache) r->removeMax();
             nullNLL = minNLL(/*constrained=*/false, r);
             bestFitR = r->getVal();
+            saveUnconditional();
             if (bestFitR > initialR && oneSided_ == oneSidedDef) {
                 DBG(DBG_PLTestStat_main, (printf("   after re-fit, signal %7.4f > %7.4f, test statistic will be zero.\n", bestFitR, initialR)))
                 thisNLL = nullNLL;
@@ -331,11 +363,52 @@ std::vector<Double_t> ProfiledLikelihoodTestStatOpt::Evaluate(RooAbsData& data,
     DBG(DBG_PLTestStat_pars, std::cout << "Was evaluated on " << data.GetName() << ": params before snapshot are " << std::endl)
     DBG(DBG_PLTestStat_pars, params_->Print("V"))
 
+    // Follow the path of the profiled nuisances: the points on each side of the best fit are visited in order of distance from it,
+    // and each conditional fit starts from the previous solutions, extrapolated linearly to the new value of r
+    static bool coldStart = runtimedef::get("PLTSO_COLD_START");
+    std::vector<RooRealVar *> floating;
+    for (RooAbsArg *a : *params_) {
+        RooRealVar *rrv = dynamic_cast<RooRealVar *>(a);
+        if (rrv != 0 && rrv != r && !rrv->isConstant()) floating.push_back(rrv);
+    }
+    struct PathPoint { double r; std::vector<double> values; };
+    auto pathPoint = [&](double rVal) {
+        PathPoint p; p.r = rVal; p.values.reserve(floating.size());
+        for (RooRealVar *v : floating) p.values.push_back(v->getVal());
+        return p;
+    };
+    PathPoint bestFitPoint = pathPoint(bestFitR);
+    std::vector<PathPoint> path;
+    std::vector<int> order(rVals.size());
+    auto sortPoints = [&]() {
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](int i, int j) {
+            bool belowI = rVals[i] < bestFitR, belowJ = rVals[j] < bestFitR;
+            if (belowI != belowJ) return belowJ;
+            return fabs(rVals[i] - bestFitR) < fabs(rVals[j] - bestFitR);
+        });
+        path.clear();
+    };
+    sortPoints();
+    std::vector<bool> done(rVals.size(), false);
+
     double EPS = 0.25*ROOT::Math::MinimizerOptions::DefaultTolerance();
-    for (int iR = 0, nR = rVals.size(); iR < nR; ++iR) {
-        if (fabs(ret[iR]) > 10*EPS) continue; // don't bother re-update points which were too far from zero anyway.
+    for (int k = 0, nR = rVals.size(); k < nR; ++k) {
+        int iR = order[k];
+        if (done[iR] && fabs(ret[iR]) > 10*EPS) continue; // don't bother re-update points which were too far from zero anyway.
         *params_ = bestFitState;
         initialR = rVals[iR];
+        if (!coldStart) {
+            if (path.empty() || (path.back().r < bestFitR) != (initialR < bestFitR)) { path.clear(); path.push_back(bestFitPoint); }
+            const PathPoint &p1 = path.back();
+            double slope = 0;
+            if (path.size() > 1 && path[path.size()-2].r != p1.r) slope = (initialR - p1.r) / (p1.r - path[path.size()-2].r);
+            for (int i = 0, n = floating.size(); i < n; ++i) {
+                double x = p1.values[i];
+                if (slope != 0) x += slope * (p1.values[i] - path[path.size()-2].values[i]);
+                floating[i]->setVal(std::max(floating[i]->getMin(), std::min(floating[i]->getMax(), x)));
+            }
+        }
         // Prepare for constrained minimization (numerator)
         r->setVal(initialR); 
         r->setConstant(true);
@@ -356,11 +429,14 @@ std::vector<Double_t> ProfiledLikelihoodTestStatOpt::Evaluate(RooAbsData& data,
                 nullNLL = minNLL(/*constrained=*/false, r);
                 bestFitR = r->getVal();
                 bestFitState.removeAll(); params_->snapshot(bestFitState);
-                for (int iR2 = 0; iR2 < iR; ++iR2) {
-                    ret[iR2] -= (nullNLL - oldNullNLL); // fixup already computed test statistics
+                bestFitPoint = pathPoint(bestFitR);
+                for (int iR2 = 0; iR2 < nR; ++iR2) {
+                    if (done[iR2]) ret[iR2] -= (nullNLL - oldNullNLL); // fixup already computed test statistics
                 }
-                iR = -1; continue; // restart over again, refitting those close to zero :-(
+                sortPoints();
+                k = -1; continue; // restart over again, refitting those close to zero :-(
             }
+            if (nfloatingpars > 0) path.push_back(pathPoint(initialR));
             if (bestFitR > initialR && oneSided_ == signFlipDef) {
                 DBG(DBG_PLTestStat_main, (printf("   fitted signal %7.4f > %7.4f, test statistics will be negative.\n", bestFitR, initialR)))
                 sign = -1.0;
@@ -370,6 +446,7 @@ std::vector<Double_t> ProfiledLikelihoodTestStatOpt::Evaluate(RooAbsData& data,
         }
 
         ret[iR] = sign * (thisNLL-nullNLL);
+        done[iR] = true;
         DBG(DBG_PLTestStat_main, (printf("\nNLLs for %7.4f:  num % 10.4f, den % 10.4f (signal %7.4f), test stat % 10.4f\n", initialR, thisNLL, nullNLL, bestFitR, ret[iR])))
         if (do_debug) { 
             printf("   Q(%.4f) = %.4f (best fit signal %.4f), from num %.4f, den %.4f\n", rVals[iR], ret[iR], bestFitR, thisNLL, nullNLL); fflush(stdout);
@@ -386,17 +463,19 @@ std::vector<Double_t> ProfiledLikelihoodTestStatOpt::Evaluate(RooAbsData& data,
 bool ProfiledLikelihoodTestStatOpt::createNLLWrapper(RooAbsPdf &pdf, RooAbsData &data) 
 {
     if (typeid(pdf) == typeid(RooSimultaneousOpt)) {
-        if (nll_.get() == 0) nll_ = combineCreateNLL(pdf, data, &nuisances_, /*offset=*/false);
+        if (nll_.get() == 0) { nll_ = combineCreateNLL(pdf, data, &nuisances_, /*offset=*/false); ++nllGeneration_; }
         else ((cacheutils::CachingSimNLL&)(*nll_)).setData(data);
         return true;
     } else {
         nll_ = combineCreateNLL(pdf, data, &nuisances_, /*offset=*/false);
+        ++nllGeneration_;
         return false;
     }
 }
 
 double ProfiledLikelihoodTestStatOpt::minNLL(bool constrained, RooRealVar *r) 
 {
+    ++nFits_;
     CascadeMinimizer::Mode mode(constrained ? CascadeMinimizer::Constrained : CascadeMinimizer::Unconstrained);
     CascadeMinimizer minim(*nll_, mode, r);
     minim.setNuisanceParameters(&nuisances_);
@@ -0,0 +1,215 @@
+#include "../interface/ProfiledNLLStore.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <RooAbsCategory.h>
+#include <RooAbsData.h>
+#include <RooAbsReal.h>
+#include <RooArgSet.h>
+#include <RooConstVar.h>
+#include <RooDataHist.h>
+#include <RooHistFunc.h>
+#include <RooHistPdf.h>
+#include <RooRealVar.h>
+#include <RooWorkspace.h>
+#include "../interface/CMSHistFunc.h"
+#include "../interface/CMSHistSum.h"
+
+ProfiledNLLStore *ProfiledNLLStore::instance_ = nullptr;
+
+namespace {
+    const char magic[8] = { 'C', 'M', 'B', 'P', 'N', 'L', 'L', '1' };
+    // each record is: key (uint64), number of values (uint32), status (int32), nll (double), values (double)
+    const std::size_t recordHeaderSize = 2*sizeof(std::uint64_t) + sizeof(double);
+
+    /// lock (or unlock) the whole file. fcntl record locks belong to the process, so unlike flock locks they
+    /// also exclude each other between the forked children that inherited the same descriptor
+    bool lockFile(int fd, bool lock)
+    {
+        struct flock fl;
+        memset(&fl, 0, sizeof(fl));
+        fl.l_type = lock ? F_WRLCK : F_UNLCK;
+        fl.l_whence = SEEK_SET;
+        while (fcntl(fd, F_SETLKW, &fl) == -1) {
+            if (errno != EINTR) return false;
+        }
+        return true;
+    }
+}
+
+namespace {
+    void hashTemplate(ProfiledNLLStore::Hasher &hasher, const FastTemplate &t)
+    {
+        hasher.add(std::uint64_t(t.size()));
+        for (unsigned int i = 0; i < t.size(); ++i) hasher.add(double(t[i]));
+    }
+}
+
+ProfiledNLLStore::Hasher & ProfiledNLLStore::Hasher::add(const void *data, std::size_t size)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (std::size_t i = 0; i < size; ++i) {
+        value_ ^= bytes[i];
+        value_ *= 1099511628211ULL;
+    }
+    return *this;
+}
+
+void ProfiledNLLStore::open(const std::string &fileName, Mode mode)
+{
+    if (instance_) throw std::logic_error("ProfiledNLLStore: a store is already open ("+instance_->fileName_+")");
+    instance_ = new ProfiledNLLStore(fileName, mode);
+}
+
+ProfiledNLLStore::ProfiledNLLStore(const std::string &fileName, Mode mode) :
+    fileName_(fileName),
+    mode_(mode)
+{
+    // O_APPEND so that each record is written at the end in one go, also by forked children sharing the descriptor
+    fd_ = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd_ == -1) throw std::runtime_error("ProfiledNLLStore: can't open "+fileName+": "+strerror(errno));
+    lockFile(fd_, true);
+    struct stat st;
+    fstat(fd_, &st);
+    mapSize_ = st.st_size;
+    if (mapSize_ == 0) {
+        if (::write(fd_, magic, sizeof(magic)) != sizeof(magic)) {
+            lockFile(fd_, false);
+            throw std::runtime_error("ProfiledNLLStore: can't write to "+fileName+": "+strerror(errno));
+        }
+    } else {
+        map_ = static_cast<const char *>(mmap(nullptr, mapSize_, PROT_READ, MAP_SHARED, fd_, 0));
+        if (map_ == MAP_FAILED) {
+            map_ = nullptr;
+            lockFile(fd_, false);
+            throw std::runtime_error("ProfiledNLLStore: can't map "+fileName+": "+strerror(errno));
+        }
+    }
+    lockFile(fd_, false);
+    if (map_ == nullptr) return;
+    if (mapSize_ < sizeof(magic) || memcmp(map_, magic, sizeof(magic)) != 0) {
+        throw std::runtime_error("ProfiledNLLStore: "+fileName+" is not a store of profiled NLL values");
+    }
+    std::size_t offset = sizeof(magic);
+    while (offset + recordHeaderSize <= mapSize_) {
+        std::uint64_t key; std::uint32_t n;
+        memcpy(&key, map_ + offset, sizeof(key));
+        memcpy(&n, map_ + offset + sizeof(key), sizeof(n));
+        std::size_t size = recordHeaderSize + n * sizeof(double);
+        if (offset + size > mapSize_) break; // truncated, e.g. if a job was killed while writing it
+        index_[key] = offset; // the last record wins
+        offset += size;
+    }
+}
+
+ProfiledNLLStore::~ProfiledNLLStore()
+{
+    if (map_) munmap(const_cast<char *>(map_), mapSize_);
+    if (fd_ != -1) ::close(fd_);
+}
+
+bool ProfiledNLLStore::lookup(std::uint64_t key, Entry &entry) const
+{
+    auto saved = saved_.find(key);
+    if (saved != saved_.end()) {
+        entry = saved->second;
+        return true;
+    }
+    auto found = index_.find(key);
+    if (found == index_.end()) return false;
+    const char *ptr = map_ + found->second + sizeof(std::uint64_t);
+    std::uint32_t n; std::int32_t status;
+    memcpy(&n, ptr, sizeof(n)); ptr += sizeof(n);
+    memcpy(&status, ptr, sizeof(status)); ptr += sizeof(status);
+    memcpy(&entry.nll, ptr, sizeof(double)); ptr += sizeof(double);
+    entry.status = status;
+    entry.values.resize(n);
+    if (n) memcpy(&entry.values[0], ptr, n * sizeof(double));
+    return true;
+}
+
+void ProfiledNLLStore::save(std::uint64_t key, const Entry &entry)
+{
+    saved_[key] = entry;
+    std::uint32_t n = entry.values.size();
+    std::int32_t status = entry.status;
+    std::vector<char> buffer(recordHeaderSize + n * sizeof(double));
+    char *ptr = &buffer[0];
+    memcpy(ptr, &key, sizeof(key)); ptr += sizeof(key);
+    memcpy(ptr, &n, sizeof(n)); ptr += sizeof(n);
+    memcpy(ptr, &status, sizeof(status)); ptr += sizeof(status);
+    memcpy(ptr, &entry.nll, sizeof(double)); ptr += sizeof(double);
+    if (n) memcpy(ptr, &entry.values[0], n * sizeof(double));
+    lockFile(fd_, true);
+    ssize_t written = ::write(fd_, &buffer[0], buffer.size());
+    lockFile(fd_, false);
+    if (written != ssize_t(buffer.size())) {
+        std::cerr << "WARNING: ProfiledNLLStore: failed to write to " << fileName_ << ", the result of this fit will not be stored" << std::endl;
+    }
+}
+
+std::uint64_t ProfiledNLLStore::hashWorkspace(const RooWorkspace &w)
+{
+    // sorted by name, so that the hash does not depend on the order in which the components were imported
+    RooArgSet components(w.components());
+    std::vector<const RooAbsArg *> args(components.begin(), components.end());
+    std::sort(args.begin(), args.end(), [](const RooAbsArg *a, const RooAbsArg *b) { return strcmp(a->GetName(), b->GetName()) < 0; });
+    Hasher hasher;
+    for (const RooAbsArg *arg : args) {
+        hasher.add(std::string(arg->GetName())).add(std::string(arg->ClassName()));
+        if (auto *var = dynamic_cast<const RooRealVar *>(arg)) {
+            hasher.add(var->getMin()).add(var->getMax()).add(var->getVal()).add(std::uint64_t(var->isConstant()));
+        } else if (auto *cat = dynamic_cast<const RooAbsCategory *>(arg)) {
+            for (const auto &state : *cat) hasher.add(state.first).add(std::uint64_t(state.second));
+        } else if (auto *cv = dynamic_cast<const RooConstVar *>(arg)) {
+            hasher.add(cv->getVal());
+        }
+        // the payload of the template-based functions, so that new histograms under the same names give a new hash
+        if (auto *hf = dynamic_cast<const CMSHistFunc *>(arg)) {
+            const FastHisto &cache = hf->cache();
+            if (cache.size()) {
+                for (unsigned int i = 0; i <= cache.size(); ++i) hasher.add(double(cache.GetEdge(i)));
+            }
+            for (const FastTemplate &t : hf->storage()) hashTemplate(hasher, t);
+            hashTemplate(hasher, hf->errors());
+        } else if (auto *hs = dynamic_cast<const CMSHistSum *>(arg)) {
+            for (const FastTemplate &t : hs->storage()) hashTemplate(hasher, t);
+            for (const FastTemplate &t : hs->binErrors()) hashTemplate(hasher, t);
+        } else if (auto *rhf = dynamic_cast<const RooHistFunc *>(arg)) {
+            hasher.add(hashData(rhf->dataHist()));
+        } else if (auto *rhp = dynamic_cast<const RooHistPdf *>(arg)) {
+            hasher.add(hashData(rhp->dataHist()));
+        }
+        // the structure of the model: the names of the servers of each function
+        std::vector<std::string> servers;
+        for (const RooAbsArg *server : arg->servers()) servers.push_back(server->GetName());
+        std::sort(servers.begin(), servers.end());
+        for (const std::string &server : servers) hasher.add(server);
+    }
+    for (const RooAbsData *data : w.allData()) {
+        hasher.add(std::string(data->GetName()));
+        hasher.add(hashData(*data));
+    }
+    return hasher.value();
+}
+
+std::uint64_t ProfiledNLLStore::hashData(const RooAbsData &data)
+{
+    Hasher hasher;
+    hasher.add(std::uint64_t(data.numEntries()));
+    for (int i = 0, n = data.numEntries(); i < n; ++i) {
+        const RooArgSet *entry = data.get(i);
+        for (RooAbsArg *arg : *entry) {
+            if (auto *cat = dynamic_cast<RooAbsCategory *>(arg)) hasher.add(std::uint64_t(cat->getCurrentIndex()));
+            else if (auto *real = dynamic_cast<RooAbsReal *>(arg)) hasher.add(real->getVal());
+        }
+        hasher.add(data.weight());
+    }
+    return hasher.value();
+}
@@ -6,11 +6,18 @@
 #include <cassert>
 #include <cmath>
 #include <math.h>
+#include <limits>
+#include <memory>
 
 #include "../interface/RooParametricShapeBinPdf.h"
 #include "RooRealVar.h"
 #include "RooRealVarSharedProperties.h"
 #include "RooArgList.h"
+#include "RooAbsFunc.h"
+#include "RooAbsCategory.h"
+#include "RooExponential.h"
+#include "Math/GaussLegendreIntegrator.h"
+#include "../interface/ProfilingTools.h"
 
 using namespace std;
 using namespace RooFit;
@@ -31,6 +38,13 @@ namespace {
 }
 #endif
 
+namespace {
+  // relative accuracy required from the Gauss-Legendre bin integrals, otherwise the per-bin RooFit integrals are used
+  const double glTolerance = 1e-6;
+  // the accuracy is checked the first time, and then every glCheckEvery computations since the shape changes with its parameters
+  const int glCheckEvery = 64;
+}
+
 ClassImp(RooParametricShapeBinPdf)
 //---------------------------------------------------------------------------
 
@@ -123,6 +137,14 @@ Double_t RooParametricShapeBinPdf::evaluate() const
   Double_t xLow = xArray[iBin];
   Double_t xHigh = xArray[iBin+1];
 
+  if (!perBinIntegrals()) {
+    updateBinIntegrals();
+    if (!glFallback_) {
+      integral = binIntegrals_[iBin] / (xHigh-xLow);
+      return integral > 0.0 ? integral : 0.0;
+    }
+  }
+
   // check again if x variable has the right range already defined 
   // needed when combining multiple workspaces, and taking variable x from only one of them!
   std::string rangeName  = Form("%s_%s_range_bin%d", GetName(), x.GetName(), iBin);
@@ -147,6 +169,133 @@ Double_t RooParametricShapeBinPdf::evaluate() const
 
 }
 
+//---------------------------------------------------------------------------
+bool RooParametricShapeBinPdf::perBinIntegrals() const
+{
+  static bool perBin = runtimedef::get("PARAMSHAPE_PERBIN_INTEGRALS");
+  return perBin || glFallback_;
+}
+
+//---------------------------------------------------------------------------
+void RooParametricShapeBinPdf::initCache() const
+{
+  RooAbsPdf *pdf = getPdf();
+  std::unique_ptr<RooArgSet> shapePars{pdf->getParameters(RooArgSet(x.arg()))};
+  shapePars_.removeAll();
+  shapePars_.add(*shapePars);
+  shapeParVals_.assign(shapePars_.getSize(), std::numeric_limits<double>::quiet_NaN());
+  binIntegrals_.assign(xBins, 0.0);
+
+  // x must be positive for a power law
+  family_ = GenericShape;
+  if (dynamic_cast<RooExponential *>(pdf)) family_ = ExponentialShape;
+  else if ((TString(pdf->ClassName()) == "RooPower" || TString(pdf->ClassName()) == "RooPowerSum") && pdf->servers().size() == 3 && xMin > 0) family_ = PowerLawShape;
+
+  int nNodes = runtimedef::get("PARAMSHAPE_GL_NODES");
+  if (nNodes <= 0) nNodes = 8;
+  glX_.resize(nNodes); glW_.resize(nNodes);
+  ROOT::Math::GaussLegendreIntegrator gl(nNodes);
+  gl.GetWeightVectors(&glX_[0], &glW_[0]);
+  const std::vector<double> &gx = glX_, &gw = glW_;
+  nodeX_.resize(xBins*nNodes); nodeW_.resize(xBins*nNodes);
+  for (Int_t iBin = 0; iBin < xBins; ++iBin) {
+    double centre = 0.5*(xArray[iBin+1]+xArray[iBin]), halfWidth = 0.5*(xArray[iBin+1]-xArray[iBin]);
+    for (int k = 0; k < nNodes; ++k) {
+      nodeX_[iBin*nNodes+k] = centre + halfWidth*gx[k];
+      nodeW_[iBin*nNodes+k] = halfWidth*gw[k];
+    }
+  }
+  cacheInit_ = true;
+}
+
+//---------------------------------------------------------------------------
+void RooParametricShapeBinPdf::updateBinIntegrals() const
+{
+  if (!cacheInit_) initCache();
+  bool changed = false;
+  for (int i = 0, n = shapePars_.getSize(); i < n; ++i) {
+    RooAbsReal *par = dynamic_cast<RooAbsReal *>(&shapePars_[i]);
+    double val = par ? par->getVal() : static_cast<RooAbsCategory &>(shapePars_[i]).getCurrentIndex();
+    if (val != shapeParVals_[i]) { shapeParVals_[i] = val; changed = true; }
+  }
+  if (!changed) return;
+  if (family_ == GenericShape || !closedFormIntegrals()) {
+    gaussLegendreIntegrals();
+    if (glUpdates_++ % glCheckEvery == 0 && !gaussLegendreAccurate()) {
+      glFallback_ = true;
+      cout << "WARNING IN RooParametricShapeBinPdf " << GetName() << ": the Gauss-Legendre integrals over the bins are not accurate to " << glTolerance
+           << ", will use the per-bin integrals of the pdf (increase the number of nodes with --X-rtd PARAMSHAPE_GL_NODES=N)" << endl;
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+bool RooParametricShapeBinPdf::closedFormIntegrals() const
+{
+  // the shape is A*exp(c*x) or A*x^p: get the parameters from its values at the edges of the range
+  std::unique_ptr<RooAbsFunc> func{getPdf()->bindVars(RooArgSet(x.arg()))};
+  func->saveXVec();
+  double fMin = (*func)(&xMin), fMax = (*func)(&xMax);
+  func->restoreXVec();
+  if (!(fMin > 0 && fMax > 0) || !std::isfinite(fMin) || !std::isfinite(fMax)) return false;
+  if (family_ == ExponentialShape) {
+    double c = std::log(fMax/fMin)/(xMax-xMin);
+    for (Int_t iBin = 0; iBin < xBins; ++iBin) {
+      double lo = xArray[iBin]-xMin, hi = xArray[iBin+1]-xMin;
+      binIntegrals_[iBin] = (std::abs(c*(xMax-xMin)) < 1e-9) ? fMin*(hi-lo) : fMin*(std::exp(c*hi)-std::exp(c*lo))/c;
+    }
+  } else {
+    double p = std::log(fMax/fMin)/std::log(xMax/xMin);
+    for (Int_t iBin = 0; iBin < xBins; ++iBin) {
+      double lo = xArray[iBin]/xMin, hi = xArray[iBin+1]/xMin;
+      binIntegrals_[iBin] = (std::abs(p+1) < 1e-9) ? fMin*xMin*std::log(hi/lo) : fMin*xMin*(std::pow(hi,p+1)-std::pow(lo,p+1))/(p+1);
+    }
+  }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+void RooParametricShapeBinPdf::gaussLegendreIntegrals() const
+{
+  std::unique_ptr<RooAbsFunc> func{getPdf()->bindVars(RooArgSet(x.arg()))};
+  func->saveXVec();
+  int nNodes = nodeX_.size()/xBins;
+  std::vector<double> values(nodeX_.size());
+  for (int i = 0, n = nodeX_.size(); i < n; ++i) values[i] = (*func)(&nodeX_[i]);
+  func->restoreXVec();
+  for (Int_t iBin = 0; iBin < xBins; ++iBin) {
+    const double *v = &values[iBin*nNodes], *w = &nodeW_[iBin*nNodes];
+    double sum = 0;
+    for (int k = 0; k < nNodes; ++k) sum += w[k]*v[k];
+    binIntegrals_[iBin] = sum;
+  }
+}
+
+//---------------------------------------------------------------------------
+bool RooParametricShapeBinPdf::gaussLegendreAccurate() const
+{
+  std::unique_ptr<RooAbsFunc> func{getPdf()->bindVars(RooArgSet(x.arg()))};
+  func->saveXVec();
+  int nNodes = glX_.size();
+  double total = 0;
+  for (double v : binIntegrals_) total += std::abs(v);
+  bool ok = true;
+  for (Int_t iBin = 0; iBin < xBins && ok; ++iBin) {
+    double quarter = 0.25*(xArray[iBin+1]-xArray[iBin]), sum = 0;
+    for (int half = 0; half < 2; ++half) {
+      double centre = xArray[iBin] + (2*half+1)*quarter;
+      for (int k = 0; k < nNodes; ++k) {
+        double xk = centre + quarter*glX_[k];
+        sum += quarter*glW_[k]*(*func)(&xk);
+      }
+    }
+    // bins with a negligible fraction of the total only need to be accurate in absolute terms
+    ok = std::abs(sum - binIntegrals_[iBin]) <= glTolerance*(std::abs(sum) + 1e-3*total/xBins);
+  }
+  func->restoreXVec();
+  return ok;
+}
+
 // //---------------------------------------------------------------------------
 Int_t RooParametricShapeBinPdf::getAnalyticalIntegral(RooArgSet& allVars, RooArgSet& analVars, const char* rangeName) const{
   if (matchArgs(allVars, analVars, x)) return 1;
@@ -161,6 +310,15 @@ Double_t RooParametricShapeBinPdf::analyticalIntegral(Int_t code, const char* ra
   Double_t integral = 0.0;
   
   if (code==1 && xRangeMin<=xMin && xRangeMax>=xMax){
+    double eps = 1e-9*(xMax-xMin);
+    if (!perBinIntegrals() && x.min() >= xMin-eps && x.max() <= xMax+eps) {
+      // the full range of x is covered by the bins
+      updateBinIntegrals();
+      if (!glFallback_) {
+        for (Int_t iBin = 0; iBin < xBins; ++iBin) integral += binIntegrals_[iBin];
+        return integral;
+      }
+    }
     integral = getIntegral(xBins)->getVal();
     return integral;
   }
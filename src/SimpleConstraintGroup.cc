@@ -56,7 +56,7 @@ void SimpleConstraintGroup::clearZeroPoint() {
 }
 
 Double_t SimpleConstraintGroup::evaluate() const {
-    DefaultAccumulator<double> ret2 = 0;
+    NeumaierAccumulator<double> ret2 = 0;
     auto ig0 = _gaus0.begin();
     for (auto ig = _gaus.begin(), eg = _gaus.end(); ig != eg; ++ig, ++ig0) {
         ret2 += ((*ig)->getLogValFast() + *ig0);
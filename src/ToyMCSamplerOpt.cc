@@ -324,11 +324,12 @@ toymcoptutils::SimPdfGenInfo::SimPdfGenInfo(RooAbsPdf &pdf, const RooArgSet& obs
         int nbins = cat_->numBins((const char *)0);
         pdfs_.resize(nbins, 0);
         RooArgList dummy;
+        utils::DependencyCache deps(observables);
         for (int ic = 0; ic < nbins; ++ic) {
             cat_->setBin(ic);
             RooAbsPdf *pdfi = simPdf->getPdf(cat_->getLabel());
             if (pdfi == 0) throw std::logic_error(std::string("Unmapped category state: ") + cat_->getLabel());
-            RooAbsPdf *newpdf = utils::factorizePdf(observables, *pdfi, dummy);
+            RooAbsPdf *newpdf = utils::factorizePdf(deps, *pdfi, dummy);
             pdfs_[ic] = new SinglePdfGenInfo(*newpdf, observables, preferBinned, NULL, 0, canUseSpec);
             if (newpdf != 0 && newpdf != pdfi) {
                 ownedCrap_.addOwned(*newpdf); 
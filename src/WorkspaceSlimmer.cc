@@ -0,0 +1,144 @@
+#include "../interface/WorkspaceSlimmer.h"
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include <RooAbsData.h>
+#include <RooAbsPdf.h>
+#include <RooArgSet.h>
+#include <RooGlobalFunc.h>
+#include <RooLinkedList.h>
+#include <RooWorkspace.h>
+#include <RooStats/ModelConfig.h>
+#include <RVersion.h>
+#include <TBufferFile.h>
+#include <TStopwatch.h>
+#include "../interface/CMSHistFuncWrapper.h"
+#include "../interface/CMSHistSum.h"
+
+namespace {
+    void importArg(RooWorkspace &out, RooAbsArg &arg)
+    {
+        if (out.arg(arg.GetName())) return;
+        if (out.import(arg, RooFit::RecycleConflictNodes(), RooFit::Silence())) {
+            throw std::runtime_error(std::string("WorkspaceSlimmer: failed to import ")+arg.GetName());
+        }
+    }
+}
+
+RooWorkspace *WorkspaceSlimmer::slim(RooWorkspace &in, bool timeRead)
+{
+    report_ = Report();
+    TStopwatch timer;
+    std::unique_ptr<RooWorkspace> out(new RooWorkspace(in.GetName(), in.GetTitle()));
+
+    // the pdfs of the ModelConfigs and everything they depend on
+    std::vector<RooStats::ModelConfig *> mcs;
+    for (TObject *obj : in.allGenericObjects()) {
+        if (auto mc = dynamic_cast<RooStats::ModelConfig *>(obj)) mcs.push_back(mc);
+    }
+    if (mcs.empty()) throw std::invalid_argument(std::string("WorkspaceSlimmer: no ModelConfig in workspace ")+in.GetName());
+    for (RooStats::ModelConfig *mc : mcs) {
+        if (mc->GetPdf()) importArg(*out, *mc->GetPdf());
+        if (mc->GetPriorPdf()) importArg(*out, *mc->GetPriorPdf());
+    }
+
+    // the named sets, with the objects in them that are not part of the model (e.g. MH)
+    for (auto const &named : in.sets()) {
+        RooArgSet set;
+        for (RooAbsArg *arg : named.second) {
+            importArg(*out, *arg);
+            set.add(*out->arg(arg->GetName()));
+        }
+        out->defineSet(named.first.c_str(), set);
+    }
+
+    // the wrappers of the CMSHistFuncs that are still in the model
+    for (RooAbsArg *arg : in.components()) {
+        if (!dynamic_cast<CMSHistFuncWrapper *>(arg)) continue;
+        bool keep = true;
+        for (RooAbsArg *server : arg->servers()) {
+            if (!out->arg(server->GetName())) { keep = false; break; }
+        }
+        if (keep) importArg(*out, *arg);
+    }
+
+    for (RooAbsData *data : in.allData()) {
+        if (out->import(*data, RooFit::Silence())) {
+            throw std::runtime_error(std::string("WorkspaceSlimmer: failed to import dataset ")+data->GetName());
+        }
+    }
+
+    // ModelConfigs (they are attached to the new workspace when imported) and sets of arguments, the rest is dropped
+    for (TObject *obj : in.allGenericObjects()) {
+        if (dynamic_cast<RooStats::ModelConfig *>(obj)) {
+            out->import(*obj);
+        } else if (auto set = dynamic_cast<RooArgSet *>(obj)) {
+            RooArgSet copy(set->GetName());
+            for (RooAbsArg *arg : *set) {
+                if (RooAbsArg *outArg = out->arg(arg->GetName())) copy.add(*outArg);
+            }
+            out->import(static_cast<TObject &>(copy));
+        } else if (verbose_) {
+            std::cout << "WorkspaceSlimmer: dropping " << obj->ClassName() << " " << obj->GetName() << std::endl;
+        }
+    }
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,26,0)
+    for (TObject *obj : in.getSnapshots()) {
+        auto snap = static_cast<RooArgSet *>(obj);
+        out->saveSnapshot(snap->GetName(), *snap, true);
+    }
+#else
+    std::cout << "WorkspaceSlimmer: the snapshots are not copied with this version of ROOT" << std::endl;
+#endif
+
+    for (RooAbsArg *arg : out->components()) {
+        if (auto sum = dynamic_cast<CMSHistSum *>(arg)) {
+            report_.templatesIn += sum->storageSize();
+            sum->compactStorage();
+            report_.templatesOut += sum->storageSize();
+        }
+    }
+
+    report_.slimTime = timer.RealTime();
+    report_.nodesIn = in.components().size();
+    report_.nodesOut = out->components().size();
+    report_.dataIn = in.allData().size();
+    report_.dataOut = out->allData().size();
+    report_.genericIn = in.allGenericObjects().size();
+    report_.genericOut = out->allGenericObjects().size();
+    if (timeRead) {
+        report_.bytesIn = WorkspaceSlimmer::measure(in, report_.readTimeIn);
+        report_.bytesOut = WorkspaceSlimmer::measure(*out, report_.readTimeOut);
+    }
+    if (verbose_) report_.print();
+    return out.release();
+}
+
+std::size_t WorkspaceSlimmer::measure(RooWorkspace &w, double &readTime)
+{
+    TBufferFile buffer(TBuffer::kWrite);
+    buffer.WriteObject(&w);
+    std::size_t size = buffer.Length();
+    buffer.SetReadMode();
+    buffer.SetBufferOffset(0);
+    TStopwatch timer;
+    std::unique_ptr<TObject> copy(buffer.ReadObject(RooWorkspace::Class()));
+    readTime = timer.RealTime();
+    return size;
+}
+
+void WorkspaceSlimmer::Report::print() const
+{
+    printf("Workspace slimming (%.2f s):\n", slimTime);
+    printf("    nodes:           %8u -> %8u\n", nodesIn, nodesOut);
+    printf("    datasets:        %8u -> %8u\n", dataIn, dataOut);
+    printf("    generic objects: %8u -> %8u\n", genericIn, genericOut);
+    printf("    CMSHistSum templates: %8u -> %8u\n", templatesIn, templatesOut);
+    if (bytesIn) {
+        printf("    streamed size:   %8.2f MB -> %8.2f MB\n", bytesIn / 1048576., bytesOut / 1048576.);
+        printf("    read time:       %8.2f s  -> %8.2f s\n", readTimeIn, readTimeOut);
+    }
+}
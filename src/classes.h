@@ -1,9 +1,11 @@
 #include "HiggsAnalysis/CombinedLimit/interface/TestProposal.h"
 #include "HiggsAnalysis/CombinedLimit/interface/DebugProposal.h"
+#include "HiggsAnalysis/CombinedLimit/interface/HMCProposal.h"
 #include "HiggsAnalysis/CombinedLimit/interface/VerticalInterpPdf.h"
 #include "HiggsAnalysis/CombinedLimit/interface/VerticalInterpHistPdf.h"
 #include "HiggsAnalysis/CombinedLimit/interface/AsymPow.h"
 #include "HiggsAnalysis/CombinedLimit/interface/CombDataSetFactory.h"
+#include "HiggsAnalysis/CombinedLimit/interface/WorkspaceSlimmer.h"
 #include "HiggsAnalysis/CombinedLimit/interface/TH1Keys.h"
 #include "HiggsAnalysis/CombinedLimit/interface/RooSimultaneousOpt.h"
 #include "HiggsAnalysis/CombinedLimit/interface/SimpleCacheSentry.h"
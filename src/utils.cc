@@ -8,6 +8,7 @@
 #include <cmath>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <string>
 #include <memory>
 #include <typeinfo>
@@ -119,7 +120,58 @@ void utils::printPdf(RooWorkspace *w, const char *pdfName) {
   params->Print("V");
 }
 
+utils::DependencyCache::DependencyCache(const RooAbsCollection &observables) {
+    for (RooAbsArg *a : observables) names_.insert(a->namePtr());
+}
+
+bool utils::DependencyCache::dependsOn(const RooAbsArg &arg) {
+    auto found = memo_.find(&arg);
+    if (found != memo_.end()) return found->second;
+    // same as RooAbsArg::dependsOn: the observables are matched by name, and all the servers are followed
+    bool ret = names_.count(arg.namePtr()) != 0;
+    memo_[&arg] = ret;
+    if (!ret) {
+        for (RooAbsArg *server : arg.servers()) {
+            if (dependsOn(*server)) { ret = true; break; }
+        }
+        memo_[&arg] = ret;
+    }
+    return ret;
+}
+
 RooAbsPdf *utils::factorizePdf(const RooArgSet &observables, RooAbsPdf &pdf, RooArgList &constraints) {
+    DependencyCache deps(observables);
+    return factorizePdf(deps, pdf, constraints);
+}
+
+namespace {
+    /// A list of terms, together with the set of its members, so that checking whether a term
+    /// is already in the list does not need a linear scan of the list.
+    class TermList {
+        public:
+            explicit TermList(RooArgList &list) : list_(list) {
+                for (RooAbsArg *a : list) members_.insert(a);
+            }
+            void add(RooAbsArg &arg, bool keepDuplicate = false) {
+                if (members_.insert(&arg).second || keepDuplicate) list_.add(arg);
+            }
+        private:
+            RooArgList &list_;
+            std::unordered_set<const RooAbsArg *> members_;
+    };
+
+    RooAbsPdf *factorizePdf(utils::DependencyCache &deps, RooAbsPdf &pdf, TermList &constraints) ;
+    void factorizePdf(utils::DependencyCache &deps, RooAbsPdf &pdf, TermList &obsTerms, TermList &constraints) ;
+    void factorizeFunc(utils::DependencyCache &deps, RooAbsReal &func, TermList &obsTerms, TermList &constraints, bool keepDuplicate) ;
+}
+
+RooAbsPdf *utils::factorizePdf(DependencyCache &deps, RooAbsPdf &pdf, RooArgList &constraints) {
+    TermList constraintTerms(constraints);
+    return ::factorizePdf(deps, pdf, constraintTerms);
+}
+
+namespace {
+RooAbsPdf *factorizePdf(utils::DependencyCache &deps, RooAbsPdf &pdf, TermList &constraints) {
     //assert(&pdf);
     const std::type_info & id = typeid(pdf);
     if (id == typeid(RooProdPdf)) {
@@ -130,7 +182,7 @@ RooAbsPdf *utils::factorizePdf(const RooArgSet &observables, RooAbsPdf &pdf, Roo
         bool needNew = false;
         for (int i = 0, n = list.getSize(); i < n; ++i) {
             RooAbsPdf *pdfi = (RooAbsPdf *) list.at(i);
-            RooAbsPdf *newpdf = factorizePdf(observables, *pdfi, constraints);
+            RooAbsPdf *newpdf = factorizePdf(deps, *pdfi, constraints);
             //std::cout << "    for " << pdfi->GetName() << "   newpdf  " << (newpdf == 0 ? "null" : (newpdf == pdfi ? "old" : "new"))  << std::endl;
             if (newpdf == 0) { needNew = true; continue; }
             if (newpdf != pdfi) { needNew = true; newOwned.add(*newpdf); }
@@ -156,7 +208,7 @@ RooAbsPdf *utils::factorizePdf(const RooArgSet &observables, RooAbsPdf &pdf, Roo
         for (int ic = 0, nc = nbins; ic < nc; ++ic) {
             cat->setBin(ic);
             RooAbsPdf *pdfi = sim->getPdf(cat->getLabel());
-            RooAbsPdf *newpdf = factorizePdf(observables, *pdfi, constraints);
+            RooAbsPdf *newpdf = factorizePdf(deps, *pdfi, constraints);
             factorizedPdfs[ic] = newpdf;
             if (newpdf == 0) { throw std::runtime_error(std::string("ERROR: channel ") + cat->getLabel() + " factorized to zero."); }
             if (newpdf != pdfi) { needNew = true; newOwned.add(*newpdf); }
@@ -165,7 +217,7 @@ RooAbsPdf *utils::factorizePdf(const RooArgSet &observables, RooAbsPdf &pdf, Roo
             RooSimultaneousOpt &o = dynamic_cast<RooSimultaneousOpt &>(pdf);
             if (o.extraConstraints().getSize() > 0) needNew = true;
             for (RooAbsArg *a : o.extraConstraints()) {
-                if (!constraints.contains(*a) && (!a->getAttribute("ignoreConstraint")) ) constraints.add(*a);
+                if (!a->getAttribute("ignoreConstraint")) constraints.add(*a);
             }
         }
         RooSimultaneous *ret = sim;
@@ -185,19 +237,30 @@ RooAbsPdf *utils::factorizePdf(const RooArgSet &observables, RooAbsPdf &pdf, Roo
         delete cat;
         copyAttributes(pdf, *ret);
         return ret;
-    } else if (pdf.dependsOn(observables)) {
+    } else if (deps.dependsOn(pdf)) {
         return &pdf;
     } else {
-        if (!constraints.contains(pdf) && (!pdf.getAttribute("ignoreConstraint"))) constraints.add(pdf);
+        if (!pdf.getAttribute("ignoreConstraint")) constraints.add(pdf);
         return 0;
     }
 
 }
+}  // namespace
 
 void utils::factorizePdf(RooStats::ModelConfig &model, RooAbsPdf &pdf, RooArgList &obsTerms, RooArgList &constraints, bool debug) {
     return factorizePdf(*model.GetObservables(), pdf, obsTerms, constraints, debug);
 }
 void utils::factorizePdf(const RooArgSet &observables, RooAbsPdf &pdf, RooArgList &obsTerms, RooArgList &constraints, bool debug) {
+    DependencyCache deps(observables);
+    factorizePdf(deps, pdf, obsTerms, constraints);
+}
+void utils::factorizePdf(DependencyCache &deps, RooAbsPdf &pdf, RooArgList &obsTerms, RooArgList &constraints) {
+    TermList obsTermList(obsTerms), constraintTerms(constraints);
+    ::factorizePdf(deps, pdf, obsTermList, constraintTerms);
+}
+
+namespace {
+void factorizePdf(utils::DependencyCache &deps, RooAbsPdf &pdf, TermList &obsTerms, TermList &constraints) {
     //assert(&pdf); should be safe
     const std::type_info & id = typeid(pdf);
     if (id == typeid(RooProdPdf)) {
@@ -205,13 +268,13 @@ void utils::factorizePdf(const RooArgSet &observables, RooAbsPdf &pdf, RooArgLis
         RooArgList list(prod->pdfList());
         for (int i = 0, n = list.getSize(); i < n; ++i) {
             RooAbsPdf *pdfi = (RooAbsPdf *) list.at(i);
-            factorizePdf(observables, *pdfi, obsTerms, constraints);
+            factorizePdf(deps, *pdfi, obsTerms, constraints);
         }
     } else if (id == typeid(RooSimultaneous) || id == typeid(RooSimultaneousOpt)) {
         if (id == typeid(RooSimultaneousOpt)) {
             RooSimultaneousOpt &o = dynamic_cast<RooSimultaneousOpt &>(pdf);
             for (RooAbsArg *a : o.extraConstraints()) {
-                if (!constraints.contains(*a) && (!a->getAttribute("ignoreConstraint"))) constraints.add(*a);
+                if (!a->getAttribute("ignoreConstraint")) constraints.add(*a);
             }
         }
         RooSimultaneous *sim  = dynamic_cast<RooSimultaneous *>(&pdf);
@@ -219,21 +282,33 @@ void utils::factorizePdf(const RooArgSet &observables, RooAbsPdf &pdf, RooArgLis
         for (int ic = 0, nc = cat->numBins((const char *)0); ic < nc; ++ic) {
             cat->setBin(ic);
             RooAbsPdf *pdfi = sim->getPdf(cat->getLabel());
-            if (pdfi != 0) factorizePdf(observables, *pdfi, obsTerms, constraints);
+            if (pdfi != 0) factorizePdf(deps, *pdfi, obsTerms, constraints);
         }
         delete cat;
-    } else if (pdf.dependsOn(observables)) {
-        if (!obsTerms.contains(pdf)) obsTerms.add(pdf);
+    } else if (deps.dependsOn(pdf)) {
+        obsTerms.add(pdf);
     } else {
-        if (!constraints.contains(pdf) && (!pdf.getAttribute("ignoreConstraint")) ) constraints.add(pdf);
+        if (!pdf.getAttribute("ignoreConstraint")) constraints.add(pdf);
     }
+}  // namespace
 }
 
 
 void utils::factorizeFunc(const RooArgSet &observables, RooAbsReal &func, RooArgList &obsTerms, RooArgList &constraints, bool keepDuplicate, bool debug) {
+    DependencyCache deps(observables);
+    factorizeFunc(deps, func, obsTerms, constraints, keepDuplicate);
+}
+
+void utils::factorizeFunc(DependencyCache &deps, RooAbsReal &func, RooArgList &obsTerms, RooArgList &constraints, bool keepDuplicate) {
+    TermList obsTermList(obsTerms), constraintTerms(constraints);
+    ::factorizeFunc(deps, func, obsTermList, constraintTerms, keepDuplicate);
+}
+
+namespace {
+void factorizeFunc(utils::DependencyCache &deps, RooAbsReal &func, TermList &obsTerms, TermList &constraints, bool keepDuplicate) {
     RooAbsPdf *pdf = dynamic_cast<RooAbsPdf *>(&func);
     if (pdf != 0) { 
-        factorizePdf(observables, *pdf, obsTerms, constraints, debug); 
+        factorizePdf(deps, *pdf, obsTerms, constraints); 
         return; 
     }
     const std::type_info & id = typeid(func);
@@ -246,14 +321,15 @@ void utils::factorizeFunc(const RooArgSet &observables, RooAbsReal &func, RooArg
 #endif
         //std::cout << "Function " << func.GetName() << " is a RooProduct with " << components.getSize() << " components." << std::endl;
         for (RooAbsArg * funci : components) {
-            //std::cout << "  component " << funci->GetName() << " of type " << funci->ClassName() << "(dep obs? " << funci->dependsOn(observables) << ")" << std::endl;
-            factorizeFunc(observables, static_cast<RooAbsReal&>(*funci), obsTerms, constraints, true);
+            //std::cout << "  component " << funci->GetName() << " of type " << funci->ClassName() << "(dep obs? " << deps.dependsOn(*funci) << ")" << std::endl;
+            factorizeFunc(deps, static_cast<RooAbsReal&>(*funci), obsTerms, constraints, true);
         }
-    } else if (func.dependsOn(observables)) {
-        if (!obsTerms.contains(func) || keepDuplicate) obsTerms.add(func);
+    } else if (deps.dependsOn(func)) {
+        obsTerms.add(func, keepDuplicate);
     } else {
-        if (( !constraints.contains(func) && (!func.getAttribute("ignoreConstraint")) ) || keepDuplicate) constraints.add(func);
+        if (keepDuplicate || !func.getAttribute("ignoreConstraint")) constraints.add(func, keepDuplicate);
     }
+}  // namespace
 }
 
 RooAbsPdf *utils::makeNuisancePdf(RooStats::ModelConfig &model, const char *name) { 
@@ -296,9 +372,10 @@ RooAbsReal *utils::fullCloneFunc(const RooAbsReal *pdf, const RooArgSet &obs, Ro
   RooArgSet tmp("RealBranchNodeList"), toClone;
   pdf->branchNodeServerList(&tmp);
   unsigned int nitems = tmp.getSize();
+  DependencyCache deps(obs);
   for (RooAbsArg *a : tmp) {
       if (a == pdf) toClone.add(*a);
-      else if (a->dependsOn(obs)) toClone.add(*a);
+      else if (deps.dependsOn(*a)) toClone.add(*a);
   }
   unsigned int nobsitems = toClone.getSize();
   toClone.snapshot(holder, cloneLeafNodes); 
@@ -437,11 +514,12 @@ RooSimultaneous * utils::rebuildSimPdf(const RooArgSet &observables, RooSimultan
     int nbins = cat->numBins((const char *)0);
     TObjArray factorizedPdfs(nbins); 
     RooArgSet newOwned;
+    DependencyCache deps(observables);
     for (int ic = 0, nc = nbins; ic < nc; ++ic) {
         cat->setBin(ic);
         RooAbsPdf *pdfi = sim->getPdf(cat->getLabel());
         if (pdfi == 0) { factorizedPdfs[ic] = 0; continue; }
-        RooAbsPdf *newpdf = factorizePdf(observables, *pdfi, constraints);
+        RooAbsPdf *newpdf = factorizePdf(deps, *pdfi, constraints);
         factorizedPdfs[ic] = newpdf;
         if (newpdf == 0) { continue; }
         if (newpdf != pdfi) { newOwned.add(*newpdf);  }
@@ -46,12 +46,7 @@ double vectorized::nll_reduce(const uint32_t size, double* __restrict__ pdfvals,
 #endif
 
 
-    DefaultAccumulator<double> ret = 0;
-    for (uint32_t i = 0; i < size; ++i) {
-        ret += pdfvals[i];
-    }
-
-    return ret.sum();
+    return sumPairwise(pdfvals, size);
 }
 
 void vectorized::gaussians(const uint32_t size, double mean, double sigma, double norm, const double* __restrict__ xvals, double * __restrict__ out, double * __restrict__ workingArea, double * __restrict__ workingArea2)
@@ -91,6 +86,17 @@ void vectorized::exponentials(const uint32_t size, double lambda, double norm, c
 #endif
 }
 
+void vectorized::exps(const uint32_t size, double const * __restrict__ iarray, double* __restrict__ oarray)
+{
+#ifndef COMBINE_NO_VDT
+    vdt::fast_expv(size, iarray, oarray);
+#else
+    for (uint32_t i = 0; i < size; ++i) {
+        oarray[i] = std::exp(iarray[i]);
+    }
+#endif
+}
+
 void vectorized::powers(const uint32_t size, double exponent, double norm, const double* __restrict__ xvals, double * __restrict__ out, double * __restrict__ workingArea)
 {
     //out[i] = std::pow(xvals[i],exponent) * nfact; // nfact = 1.0/norm
@@ -108,12 +114,40 @@ void vectorized::powers(const uint32_t size, double exponent, double norm, const
 #endif
 }
 
-double vectorized::dot_product(const uint32_t size, double const * __restrict__ vec1, double const *  __restrict__ vec2) {
-    DefaultAccumulator<double> ret = 0;
+double vectorized::gaussian_constraints(const uint32_t size, double const * __restrict__ x, double const * __restrict__ mean, double const * __restrict__ scale, double const * __restrict__ zero)
+{
+    return sumPairwise<double>(size, [=](uint32_t i) {
+        const double arg = x[i] - mean[i];
+        return scale[i] * arg * arg + zero[i];
+    });
+}
+
+double vectorized::poisson_constraints(const uint32_t size, double const * __restrict__ obs, double const * __restrict__ mean, double const * __restrict__ logGamma, double const * __restrict__ zero, double * __restrict__ workingArea)
+{
+#ifndef COMBINE_NO_VDT
+    vdt::fast_logv(size, mean, workingArea);
+#else
     for (uint32_t i = 0; i < size; ++i) {
-        ret += vec1[i]*vec2[i];
+        workingArea[i] = std::log(mean[i]);
     }
-    return ret.sum();
+#endif
+    for (uint32_t i = 0; i < size; ++i) {
+        double val;
+        if (std::abs(obs[i]) < 1e-10) {
+            val = (std::abs(mean[i]) < 1e-10) ? 0 : -mean[i];
+        } else if (obs[i] < 1000000) {
+            val = obs[i] * workingArea[i] - mean[i] - logGamma[i];
+        } else {
+            const double diff = obs[i] - mean[i];
+            val = 0.5 * workingArea[i] - (diff * diff) / (2 * mean[i]);
+        }
+        workingArea[i] = val + zero[i];
+    }
+    return sumPairwise(workingArea, size);
+}
+
+double vectorized::dot_product(const uint32_t size, double const * __restrict__ vec1, double const *  __restrict__ vec2) {
+    return sumPairwise<double>(size, [=](uint32_t i) { return vec1[i]*vec2[i]; });
 }
 
 
@@ -1,5 +1,6 @@
 #include <cstdint>
 
+// The sums are done with sumPairwise (see Accumulators.h), so their result does not depend on how the loops are vectorized
 namespace vectorized {
     // oarray += coeff * iarray
     void mul_add(const uint32_t size, double coeff, double const * __restrict__ iarray, double* __restrict__ oarray) ;
@@ -22,9 +23,19 @@ namespace vectorized {
     // exponentials
     void exponentials(const uint32_t size, double lambda, double norm, const double* __restrict__ xvals, double * __restrict__ out, double * __restrict__ workingArea) ;
 
+    // oarray = exp(iarray)
+    void exps(const uint32_t size, double const * __restrict__ iarray, double* __restrict__ oarray) ;
+
     // powers
     void powers(const uint32_t size, double lambda, double norm, const double* __restrict__ xvals, double * __restrict__ out, double * __restrict__ workingArea) ;
 
+    // sum ( scale * (x - mean)^2 + zero ), i.e. the log of gaussian constraints, with zero points
+    double gaussian_constraints(const uint32_t size, double const * __restrict__ x, double const * __restrict__ mean, double const * __restrict__ scale, double const * __restrict__ zero) ;
+
+    // sum ( obs * log(mean) - mean - logGamma + zero ), i.e. the log of poisson constraints, with zero points
+    // (with the same special cases for obs ~ 0 and obs > 1e6 as SimplePoissonConstraint::getLogValFast)
+    double poisson_constraints(const uint32_t size, double const * __restrict__ obs, double const * __restrict__ mean, double const * __restrict__ logGamma, double const * __restrict__ zero, double * __restrict__ workingArea) ;
+
     // dot product of two vectors 
     double dot_product(const uint32_t size, double const * __restrict__ iarray, double const * __restrict__ iarray2) ;
 }
@@ -1,4 +1,5 @@
 #include "../../interface/Accumulators.h"
+#include <chrono>
 #include <cstdio>
 #include <TRandom3.h>
 
@@ -22,6 +23,7 @@ void testTwo(int n) {
     double best = sumPrecise(signal);
     printf("Naive   sum: %.7g \n", sumFast(terms)-best);
     printf("Precise sum: %.7g \n", sumPrecise(terms)-best);
+    printf("Pairwise sum: %.7g \n", sumPairwise(terms)-best);
 }
 
 void testOne() {
@@ -46,11 +48,98 @@ void testOne() {
     }
     printf("Naive   sum/eps: %.7g \n", sumFast(terms)/eps);
     printf("Precise sum/eps: %.7g \n", sumPrecise(terms)/eps);
+    printf("Pairwise sum/eps: %.7g \n", sumPairwise(terms)/eps);
     printf("True    sum/eps: %.7g \n", sumFast(ok)/eps);
 
 }
 
+int failures = 0;
+
+void check(bool ok, const char *what) {
+    if (!ok) { printf("FAILED: %s\n", what); ++failures; }
+}
+
+// Scalar version of the same reduction tree, one lane at a time, to check that sumPairwise
+// does not depend on how the compiler vectorizes the lanes
+NeumaierAccumulator<double> referenceLanes(const std::vector<double> & terms, uint32_t begin, uint32_t end) {
+    uint32_t full = begin + ((end - begin) / kSumLanes) * kSumLanes;
+    double sums[kSumLanes] = {}, comps[kSumLanes] = {};
+    for (uint32_t k = 0; k < kSumLanes; ++k) {
+        for (uint32_t i = begin + k; i < full; i += kSumLanes) {
+            double sumnew = sums[k] + terms[i];
+            double incpart = sumnew - sums[k];
+            comps[k] += (sums[k] - (sumnew - incpart)) + (terms[i] - incpart);
+            sums[k] = sumnew;
+        }
+    }
+    NeumaierAccumulator<double> ret = 0;
+    for (uint32_t k = 0; k < kSumLanes; ++k) ret += sums[k];
+    for (uint32_t i = full; i < end; ++i) ret += terms[i];
+    double comp = 0;
+    for (uint32_t k = 0; k < kSumLanes; ++k) comp += comps[k];
+    ret += comp;
+    return ret;
+}
+
+NeumaierAccumulator<double> referencePairwise(const std::vector<double> & terms, uint32_t begin, uint32_t end) {
+    if (end - begin <= kSumBlockSize) return referenceLanes(terms, begin, end);
+    uint32_t nblocks = (end - begin + kSumBlockSize - 1) / kSumBlockSize;
+    uint32_t mid = begin + ((nblocks + 1) / 2) * kSumBlockSize;
+    NeumaierAccumulator<double> ret = referencePairwise(terms, begin, mid);
+    ret += referencePairwise(terms, mid, end);
+    return ret;
+}
+
+// The result must be the same to the last bit when the blocks are summed separately, and the same as the scalar reference
+void testTree(uint32_t n) {
+    std::vector<double> terms;
+    for (uint32_t i = 0; i < n; ++i) {
+        terms.push_back(gRandom->Gaus(0,1) * gRandom->Exp(100));
+    }
+    auto term = [&terms](uint32_t i) { return terms[i]; };
+    double all = sumPairwise<double>(0, n, term).sum();
+    char what[100];
+    snprintf(what, sizeof(what), "sum of %u terms as the scalar reference", n);
+    check(all == referencePairwise(terms, 0, n).sum(), what);
+    snprintf(what, sizeof(what), "sum of %u terms as the sum of the vector", n);
+    check(all == sumPairwise(terms), what);
+    if (n <= kSumBlockSize) return;
+    uint32_t nblocks = (n + kSumBlockSize - 1) / kSumBlockSize;
+    uint32_t mid = ((nblocks + 1) / 2) * kSumBlockSize;
+    NeumaierAccumulator<double> halves = sumPairwise<double>(0, mid, term);
+    halves += sumPairwise<double>(mid, n, term);
+    snprintf(what, sizeof(what), "sum of %u terms as the sum of its halves at %u", n, mid);
+    check(all == halves.sum(), what);
+}
+
+template<typename S> void timeSum(const char *name, const std::vector<double> & terms, int reps, S sum) {
+    double ret = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < reps; ++r) ret += sum(terms);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    printf("%-14s %8.3f ns/term  (sum %.17g)\n", name, 1e9 * elapsed.count() / (double(reps) * terms.size()), ret / reps);
+}
+
+// Micro-benchmark of the accumulators, for sums of the size of the NLL reductions
+void testSpeed(int n, int reps) {
+    std::vector<double> terms;
+    for (int i = 0; i < n; ++i) {
+        terms.push_back(gRandom->Gaus(0,1) * gRandom->Exp(100));
+    }
+    printf("Sum of %d terms:\n", n);
+    timeSum("Naive", terms, reps, [](const std::vector<double> & v) { return sumFast(v); });
+    timeSum("Kahan", terms, reps, [](const std::vector<double> & v) { return sumPrecise(v); });
+    timeSum("Neumaier", terms, reps, [](const std::vector<double> & v) { return sumWith<double, NeumaierAccumulator<double>>(v); });
+    timeSum("Pairwise lanes", terms, reps, [](const std::vector<double> & v) { return sumPairwise(v); });
+}
+
 int main(int argc, char **argv) {
     //testOne();
     testTwo(2000);
+    for (uint32_t n : {0u, 1u, 7u, 8u, 1000u, 1024u, 1025u, 3000u, 4096u, 10000u, 1000003u}) testTree(n);
+    testSpeed(100, 200000);
+    testSpeed(10000, 2000);
+    testSpeed(1000000, 20);
+    printf(failures ? "%d checks FAILED\n" : "All checks passed\n", failures);
+    return failures ? 1 : 0;
 }
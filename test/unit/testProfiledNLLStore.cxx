@@ -0,0 +1,46 @@
+#include "../../interface/ProfiledNLLStore.h"
+#include "../../interface/CMSHistFunc.h"
+#include <cstdio>
+#include <RooConstVar.h>
+#include <RooDataHist.h>
+#include <RooHistPdf.h>
+#include <RooRealVar.h>
+#include <RooWorkspace.h>
+#include <TH1D.h>
+
+int failures = 0;
+
+void check(bool ok, const char *what) {
+    if (!ok) { printf("FAILED: %s\n", what); ++failures; }
+}
+
+// always the same names and structure, only the contents of the templates and the constant change
+std::uint64_t hashOf(double signalScale, double backgroundScale, double lumi) {
+    RooWorkspace w("w");
+    RooRealVar x("x", "", 0, 10);
+    TH1D signal("signal", "", 10, 0, 10), background("background", "", 10, 0, 10);
+    signal.SetDirectory(nullptr);
+    background.SetDirectory(nullptr);
+    for (int i = 1; i <= 10; ++i) {
+        signal.SetBinContent(i, signalScale * i);
+        background.SetBinContent(i, backgroundScale * (11 - i));
+    }
+    CMSHistFunc shape("shape_sig", "", x, signal);
+    RooDataHist hist("hist_bkg", "", RooArgList(x), &background);
+    RooHistPdf pdf("shape_bkg", "", RooArgSet(x), hist);
+    RooConstVar constant("lumi", "", lumi);
+    w.import(shape);
+    w.import(pdf);
+    w.import(constant);
+    return ProfiledNLLStore::hashWorkspace(w);
+}
+
+int main() {
+    std::uint64_t nominal = hashOf(1., 1., 1.);
+    check(hashOf(1., 1., 1.) == nominal, "same workspace, same hash");
+    check(hashOf(1.5, 1., 1.) != nominal, "new CMSHistFunc template, new hash");
+    check(hashOf(1., 1.5, 1.) != nominal, "new RooDataHist template, new hash");
+    check(hashOf(1., 1., 1.5) != nominal, "new constant, new hash");
+    printf(failures ? "%d checks FAILED\n" : "All checks passed\n", failures);
+    return failures ? 1 : 0;
+}